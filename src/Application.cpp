@@ -2,27 +2,97 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
 #include <iostream>	
 #include <stdexcept>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
+#include <fstream>
 
 #include "Application.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+// Number of frames the CPU may record ahead of the GPU
+const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+// Frames between fence wait reports
+const uint32_t FRAME_STATS_INTERVAL = 1000;
+// Resize benchmark: frames drawn before the storm for a steady state reference, and after each resize
+const uint32_t RESIZE_BENCHMARK_WARMUP_FRAMES = 120;
+const uint32_t RESIZE_BENCHMARK_FRAMES_PER_RESIZE = 2;
+// Recordings averaged per thread count by the record benchmark
+const uint32_t RECORD_BENCHMARK_ITERATIONS = 50;
+// Offscreen color format when running headless; also the byte order of the readback
+const VkFormat HEADLESS_COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+// Simulated frame rate driving animation when headless, so every run renders the same frames
+const float HEADLESS_FRAME_RATE = 60.0f;
+// Bytes of uniform ring reserved for each frame in flight, grown when many meshes are drawn
+const VkDeviceSize UNIFORM_RING_FRAME_SIZE = 256 * 1024;
+// Distance between mesh copies on the grid drawn with setMeshCount
+const float MESH_GRID_SPACING = 2.5f;
+// Closest a bounding sphere counts as for level of detail selection, so the camera inside it does not divide by zero
+const float LOD_MIN_DISTANCE = 0.1f;
+// GPU and CPU culling round plane distances differently; spheres this close to a plane, relative to their
+// distance from the origin, may go either way
+const float CULL_VALIDATION_TOLERANCE = 1e-4f;
+// Checker cell size of the generated texture drawn with setTextureSize
+const uint32_t GENERATED_TEXTURE_CELL = 32;
+
 const std::string MODEL_PATH = "../../models/viking_room.obj";
 const std::string TEXTURE_PATH = "../../textures/viking_room.png";
+// Variants of TEXTURE_PATH written by the TextureCooker, most preferred first
+const char* const COOKED_TEXTURE_EXTENSIONS[] = { ".bc7.ktx2", ".bc1.ktx2", ".etc2.ktx2", ".rgba8.ktx2" };
+const std::string MESH_CACHE_EXTENSION = ".meshcache";
+// SPIR-V built from the GLSL in src/, CMake points SHADER_DIR at the build tree
+#ifndef SHADER_DIR
+#define SHADER_DIR "shaders/"
+#endif
+const std::string DOWNSAMPLE_SHADER_PATH = SHADER_DIR "downsample.spv";
+// Vertex shaders decode the vertex format this build uploads
+#ifdef COMPACT_VERTICES
+const std::string VERTEX_SHADER_PATH = SHADER_DIR "vert_compact.spv";
+const std::string INSTANCED_VERTEX_SHADER_PATH = SHADER_DIR "instanced_compact.spv";
+#else
+const std::string VERTEX_SHADER_PATH = SHADER_DIR "vert.spv";
+const std::string INSTANCED_VERTEX_SHADER_PATH = SHADER_DIR "instanced.spv";
+#endif
+// Shading with a texture array indexed per material, or with the one texture the bound set holds
+const std::string FRAGMENT_SHADER_PATH = SHADER_DIR "frag.spv";
+const std::string BINDLESS_FRAGMENT_SHADER_PATH = SHADER_DIR "frag_bindless.spv";
+// Size of the bindless texture array, further clamped by the device's descriptor limits
+const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+const std::string CULL_SHADER_PATH = SHADER_DIR "cull.spv";
+// Position-only vertex shaders of the depth prepass, the same for every vertex format
+const std::string DEPTH_VERTEX_SHADER_PATH = SHADER_DIR "depth.spv";
+const std::string DEPTH_INSTANCED_VERTEX_SHADER_PATH = SHADER_DIR "depth_instanced.spv";
+// Start of the attribute stream behind the positions in the vertex buffer
+const VkDeviceSize VERTEX_STREAM_ALIGNMENT = 256;
+// Written on shutdown and reused when the device and driver still match
+const std::string PIPELINE_CACHE_PATH = "pipeline.cache";
+// Upper bound on sampler anisotropy, further clamped by the device limit
+const float MAX_TEXTURE_ANISOTROPY = 16.0f;
 
 Application* Application::sInstance = nullptr;
 
 
 Application::Application()
-	: mWidth(WIDTH), mHeight(HEIGHT), enableValidationLayer(true), mPhysicalDevice(VK_NULL_HANDLE)
+	: mWidth(WIDTH), mHeight(HEIGHT), enableValidationLayer(true), mPhysicalDevice(VK_NULL_HANDLE),
+	mFramesInFlight(MAX_FRAMES_IN_FLIGHT), mCurrentFrame(0), mUniformRingMapped(nullptr), mUniformAlignment(256),
+	mUniformFrameBase(0), mUniformFrameCursor(0), mUniformBytesUploaded(0), mUniformRingFrameSize(UNIFORM_RING_FRAME_SIZE), mLightOffset(0),
+	mMaintenance2(false), mPipelineCreationFeedback(false), mTextureMipsEnabled(true), mViewDistanceScale(1.0f),
+	mSubmitSerial(0), mFramebufferResized(false), mResizeBenchmarkCount(0),
+	mHeadless(false), mHeadlessFrameCount(0), mFrameNumber(0),
+	mBenchmark(false), mBenchmarkWarmupFrames(0), mMeshCount(1), mTextureSize(0), mStartupMs(0.0),
+	mRecordThreadCount(0), mInheritedQueries(false), mRecordBenchmark(false),
+	mInstancedPipeline(VK_NULL_HANDLE), mInstancing(false), mInstanceBuffer(VK_NULL_HANDLE), mInstanceFrameSize(0), mInstanceOffset(0),
+	mFrustumCulling(true), mDrawCount(0), mLodThreshold(1.0f), mTrianglesSubmitted(0), mTrianglesFullDetail(0), mMeshletCulling(false), mGpuCulling(false), mDrawIndirectCount(false), mMultiDrawIndirect(false),
+	mAttributeStreamOffset(0), mDepthPrepass(false), mDepthPipeline(VK_NULL_HANDLE), mDepthInstancedPipeline(VK_NULL_HANDLE),
+	mMaterialBuffer(VK_NULL_HANDLE), mBindlessMaterials(true), mPhysicalDeviceProperties2(false), mBindlessTextureCapacity(0),
+	mQueueMultiDraw(true)
 {
 	sInstance = this;
 
@@ -44,42 +114,108 @@ Application::~Application()
 
 void Application::run()
 {
-	initWindow();
+	auto startupStart = std::chrono::high_resolution_clock::now();
+
+	if (!mHeadless) initWindow();
 	initVulkan();
+
+	mStartupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupStart).count();
 	mainLoop();
 	cleanUp();;
 }
 
 void Application::initVulkan()
 {
-	createInstance();
-	setupDebugMessenger();
-	createSurface();
-	pickPhysicalDevice();
-	createLogicalDevice();
-	createSwapChain();
-	createImageViews();
-	createRenderPass();
-	createDescriptorSetLayout();
-	createGraphicsPipeline();
-	createCommandPool();
-	createDepthResources();
-	createFramebuffers();
-	createTextureImage();
-	createTextureImageView();
-	createTextureSampler();
-	loadModel();
-	createVertexBuffers();
-	createIndexBuffers();
-	createUniformBuffers();
-	createDescriptorPool();
-	createDescriptorSets();
-	createCommandBuffers();
-	createSemaphores();
+	ProfileScope initScope(mProfiler, "initVulkan");
+
+	// Each step is its own scope when profiling
+	auto step = [this](const char* name, void (Application::*create)())
+	{
+		ProfileScope scope(mProfiler, name);
+		(this->*create)();
+	};
+
+	// Without a surface there is no swap chain to ask for
+	if (mHeadless) deviceExtensions.clear();
+
+	step("createInstance", &Application::createInstance);
+	step("setupDebugMessenger", &Application::setupDebugMessenger);
+	if (!mHeadless) step("createSurface", &Application::createSurface);
+	step("pickPhysicalDevice", &Application::pickPhysicalDevice);
+	step("createLogicalDevice", &Application::createLogicalDevice);
+	step("createProfiler", &Application::createProfiler);
+	step("createAllocator", &Application::createAllocator);
+	step("createUploader", &Application::createUploader);
+	step("createPipelineCache", &Application::createPipelineCache);
+	if (mHeadless)
+	{
+		step("createOffscreenTargets", &Application::createOffscreenTargets);
+	}
+	else
+	{
+		ProfileScope scope(mProfiler, "createSwapChain");
+		createSwapChain();
+	}
+	step("createImageViews", &Application::createImageViews);
+	step("createRenderPass", &Application::createRenderPass);
+	step("loadMaterials", &Application::loadMaterials);
+	step("createDescriptorSetLayout", &Application::createDescriptorSetLayout);
+	step("createGraphicsPipeline", &Application::createGraphicsPipeline);
+	step("createCommandPool", &Application::createCommandPool);
+	step("createDepthResources", &Application::createDepthResources);
+	step("createFramebuffers", &Application::createFramebuffers);
+	step("createTextureImage", &Application::createTextureImage);
+	step("createTextureImageView", &Application::createTextureImageView);
+	step("createTextureSampler", &Application::createTextureSampler);
+	step("createMaterialBuffer", &Application::createMaterialBuffer);
+
+	// The texture copy runs while the model is parsed
+	{
+		ProfileScope scope(mProfiler, "flushTextureUploads");
+		mUploader.flush();
+	}
+
+	step("loadModels", &Application::loadModels);
+	step("createVertexBuffers", &Application::createVertexBuffers);
+	step("createIndexBuffers", &Application::createIndexBuffers);
+
+	// Not waited on: the graphics queue orders the first frame after these uploads
+	{
+		ProfileScope scope(mProfiler, "flushMeshUploads");
+		mUploader.flush();
+	}
+
+	step("createUniformBuffers", &Application::createUniformBuffers);
+	step("createGpuCuller", &Application::createGpuCuller);
+	step("createDescriptorPool", &Application::createDescriptorPool);
+	step("createDescriptorSets", &Application::createDescriptorSets);
+	step("createCommandBuffers", &Application::createCommandBuffers);
+	step("createSyncObjects", &Application::createSyncObjects);
+
+	mAllocator.dumpStats(std::cerr);
 }
 
 void Application::mainLoop()
 {
+	if (mRecordBenchmark)
+	{
+		runRecordBenchmark();
+		return;
+	}
+
+	if (mHeadless)
+	{
+		runHeadless();
+		return;
+	}
+
+	if (mResizeBenchmarkCount > 0)
+	{
+		runResizeBenchmark();
+		vkDeviceWaitIdle(mDevice);
+		return;
+	}
+
 	while (!glfwWindowShouldClose(mWindow))
 	{
 		glfwPollEvents();
@@ -91,36 +227,94 @@ void Application::mainLoop()
 
 void Application::cleanUp()
 {
+	// The device is idle, so everything retired can go right away
+	mDeletionQueue.flush();
+
 	cleanUpSwapChain();
 
-	if (enableValidationLayer)
+	vkDestroyPipeline(mDevice, mGraphicsPipeline, nullptr);
+	vkDestroyPipeline(mDevice, mInstancedPipeline, nullptr);
+	vkDestroyPipeline(mDevice, mDepthPipeline, nullptr);
+	vkDestroyPipeline(mDevice, mDepthInstancedPipeline, nullptr);
+	vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+	vkDestroyRenderPass(mDevice, mRenderPass, nullptr);
+
+	vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
+
+	vkDestroyBuffer(mDevice, mUniformRingBuffer, nullptr);
+	mAllocator.free(mUniformRingMemory);
+
+	vkDestroyBuffer(mDevice, mInstanceBuffer, nullptr);
+	mAllocator.free(mInstanceMemory);
+
+	for (size_t i = 0; i < mIndirectBuffers.size(); i++)
 	{
-		DestroyDebugUtilsMessengerEXT(mInstance, mDebugMessenger, nullptr);
+		if (mIndirectBuffers[i] == VK_NULL_HANDLE) continue;
+		vkDestroyBuffer(mDevice, mIndirectBuffers[i], nullptr);
+		mAllocator.free(mIndirectMemory[i]);
 	}
 
-	vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
-	vkDestroyInstance(mInstance, nullptr);
-
-	vkDestroyShaderModule(mDevice, mVertexShaderModule, nullptr);
-	vkDestroyShaderModule(mDevice, mFragmentShaderModule, nullptr);
+	// Texture Related
+	for (Texture& texture : mTextures)
+	{
+		vkDestroyImageView(mDevice, texture.view, nullptr);
+		vkDestroyImage(mDevice, texture.image, nullptr);
+		mAllocator.free(texture.memory);
+	}
+	vkDestroySampler(mDevice, mTextureSampler, nullptr);
 
-	vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
+	vkDestroyBuffer(mDevice, mMaterialBuffer, nullptr);
+	mAllocator.free(mMaterialMemory);
 
 	vkDestroyBuffer(mDevice, mIndexBuffer, nullptr);
-	vkFreeMemory(mDevice, mIndexBufferMemory, nullptr);
+	mAllocator.free(mIndexBufferMemory);
 
 	vkDestroyBuffer(mDevice, mVertexBuffer, nullptr);
-	vkFreeMemory(mDevice, mVertexBufferMemory, nullptr);
+	mAllocator.free(mVertexBufferMemory);
 	
+	mUploader.cleanUp();
+	mMipGenerator.cleanUp();
+	mGpuCuller.cleanUp();
+
+	mPipelineCache.dumpStats(std::cerr);
+	mPipelineCache.cleanUp();
+
+	mProfiler.cleanUp();
+
+	mParallelRecorder.cleanUp();
+	mRecordPool.reset();
+	mCullPool.reset();
+
+	vkFreeCommandBuffers(mDevice, mCommandPool, static_cast<uint32_t>(mCommandBuffers.size()), mCommandBuffers.data());
 	vkDestroyCommandPool(mDevice, mCommandPool, nullptr);
 
-	vkDestroySemaphore(mDevice, imageAvailableSemaphore, nullptr);
-	vkDestroySemaphore(mDevice, renderFinishedSemaphore, nullptr);
+	for (uint32_t i = 0; i < mFramesInFlight; i++)
+	{
+		vkDestroySemaphore(mDevice, mImageAvailableSemaphores[i], nullptr);
+		vkDestroyFence(mDevice, mInFlightFences[i], nullptr);
+	}
+
+	for (VkSemaphore semaphore : mRenderFinishedSemaphores) vkDestroySemaphore(mDevice, semaphore, nullptr);
+
+	mAllocator.cleanUp();
 
 	vkDestroyDevice(mDevice, nullptr);
 
-	glfwDestroyWindow(mWindow);
-	glfwTerminate();
+	// Instance level objects outlive the device
+	if (enableValidationLayer)
+	{
+		DestroyDebugUtilsMessengerEXT(mInstance, mDebugMessenger, nullptr);
+	}
+
+	if (!mHeadless) vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
+	vkDestroyInstance(mInstance, nullptr);
+
+	if (!mHeadless)
+	{
+		glfwDestroyWindow(mWindow);
+		glfwTerminate();
+	}
 }
 
 void Application::cleanUpSwapChain()
@@ -130,31 +324,27 @@ void Application::cleanUpSwapChain()
 		vkDestroyFramebuffer(mDevice, framebuffer, nullptr);
 	}
 
-	for (uint32_t i = 0; i < mSwapChainImages.size(); i++)
-	{
-		vkDestroyBuffer(mDevice, mUniformBuffers[i], nullptr);
-		vkFreeMemory(mDevice, mUniformBuffersMemory[i], nullptr);
-	}
-
-	vkFreeCommandBuffers(mDevice, mCommandPool, mCommandBuffers.size(), mCommandBuffers.data());
-
-	vkDestroyPipeline(mDevice, mGraphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
-	vkDestroyRenderPass(mDevice, mRenderPass, nullptr);
-
 	for (auto imageView : mImageViews)
 	{
 		vkDestroyImageView(mDevice, imageView, nullptr);
 	}
 
-	// Texture Related
-	vkDestroyImageView(mDevice, mTextureImageView, nullptr);
-
-	vkDestroyImage(mDevice, mTextureImage, nullptr);
-	vkFreeMemory(mDevice, mTextureImageMemory, nullptr);
-	vkDestroySampler(mDevice, mTextureSampler, nullptr);
+	vkDestroyImageView(mDevice, mDepthImageView, nullptr);
+	vkDestroyImage(mDevice, mDepthImage, nullptr);
+	mAllocator.free(mDepthImageMemory);
 
-	vkDestroySwapchainKHR(mDevice, mSwapChain, nullptr);
+	if (mHeadless)
+	{
+		for (uint32_t i = 0; i < mSwapChainImages.size(); i++)
+		{
+			vkDestroyImage(mDevice, mSwapChainImages[i], nullptr);
+			mAllocator.free(mOffscreenImageMemory[i]);
+		}
+	}
+	else
+	{
+		vkDestroySwapchainKHR(mDevice, mSwapChain, nullptr);
+	}
 }
 
 void Application::initWindow()
@@ -162,14 +352,24 @@ void Application::initWindow()
 	glfwInit();
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 	
 	mWindow = glfwCreateWindow(mWidth, mHeight, "Vulkan-Study", nullptr, nullptr);
+
+	glfwSetWindowUserPointer(mWindow, this);
+	glfwSetFramebufferSizeCallback(mWindow, FramebufferResizeCallback);
 }
 
 void Application::createInstance()
 {
 
+	// Render nodes and software drivers often ship without the layers, headless runs go on without them
+	if (enableValidationLayer && mHeadless && !CheckValidationLayerSupport())
+	{
+		std::cerr << "Validation layers not available, running headless without them" << std::endl;
+		enableValidationLayer = false;
+	}
+
 	if (enableValidationLayer && !CheckValidationLayerSupport())
 	{
 		throw std::runtime_error("vaildation layers requested, but not available!");
@@ -220,9 +420,63 @@ void Application::createInstance()
 
 void Application::drawFrame()
 {
-	uint32_t imageIndex;
-	
-	VkResult result = vkAcquireNextImageKHR(mDevice, mSwapChain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	ProfileScope frameScope(mProfiler, "drawFrame");
+
+	// Wait until the GPU has finished with this frame's resources
+	auto waitStart = std::chrono::high_resolution_clock::now();
+	vkWaitForFences(mDevice, 1, &mInFlightFences[mCurrentFrame], VK_TRUE, UINT64_MAX);
+	auto waitEnd = std::chrono::high_resolution_clock::now();
+
+	if (mProfiler.isEnabled()) mProfiler.recordCpuScope("waitForFence", waitStart, waitEnd);
+
+	mFenceWaitStats.record(std::chrono::duration<double, std::milli>(waitEnd - waitStart).count());
+
+	// Recycle staging memory of uploads the GPU has finished
+	mUploader.collect();
+
+	// Submissions complete in order, so everything up to this frame's last one is done
+	mDeletionQueue.collect(mFrameSerials[mCurrentFrame]);
+
+	if (mFenceWaitStats.samples == FRAME_STATS_INTERVAL)
+	{
+		std::cerr << "Frames in flight: " << mFramesInFlight
+			<< ", fence wait avg: " << mFenceWaitStats.averageMs() << " ms"
+			<< ", max: " << mFenceWaitStats.maxMs << " ms"
+			<< ", uniform upload: " << mUniformBytesUploaded << " bytes/frame"
+			<< ", visible: " << (mGpuCulling ? "culled on the GPU" : std::to_string(mDrawCount) + "/" + std::to_string(mMeshCount))
+			<< ", triangles: " << mTrianglesSubmitted << " (" << 100.0 * mTrianglesSubmitted / std::max<uint64_t>(1, mTrianglesFullDetail)
+			<< "% of LOD 0)";
+
+		if (mMeshletStats.tested > 0)
+		{
+			double percent = 100.0 / mMeshletStats.tested;
+			std::cerr << ", clusters culled: " << percent * (mMeshletStats.frustumCulled + mMeshletStats.backfaceCulled)
+				<< "% (frustum " << percent * mMeshletStats.frustumCulled << "%, backface " << percent * mMeshletStats.backfaceCulled << "%)";
+		}
+
+		if (mRenderQueueStats.frames > 0)
+		{
+			double frames = static_cast<double>(mRenderQueueStats.frames);
+			std::cerr << ", packets: " << mRenderQueueStats.packets / frames << "/frame, binds: " << mRenderQueueStats.binds / frames
+				<< "/frame (" << mRenderQueueStats.bindsElided / frames << " elided), draw calls: " << mRenderQueueStats.draws / frames
+				<< "/frame, queue sort: " << mRenderQueueStats.sortMs / frames << " ms";
+		}
+
+		std::cerr << std::endl;
+		mFenceWaitStats.reset();
+		mMeshletStats = MeshletCullStats();
+		mRenderQueueStats = RenderQueueStats();
+	}
+
+	// Headless frames own their target, so there is nothing to acquire
+	uint32_t imageIndex = mCurrentFrame;
+	VkResult result = VK_SUCCESS;
+
+	if (!mHeadless)
+	{
+		ProfileScope scope(mProfiler, "acquireNextImage");
+		result = vkAcquireNextImageKHR(mDevice, mSwapChain, UINT64_MAX, mImageAvailableSemaphores[mCurrentFrame], VK_NULL_HANDLE, &imageIndex);
+	}
 	
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
@@ -234,28 +488,57 @@ void Application::drawFrame()
 		throw std::runtime_error("Failed to acquire swap chain image!");
 	}
 
-	updateUniformBuffer(imageIndex);
+	// Only reset the fence once we are sure work will be submitted with it
+	vkResetFences(mDevice, 1, &mInFlightFences[mCurrentFrame]);
+
+	updateUniformBuffer(mCurrentFrame);
+
+	VkCommandBuffer commandBuffer = mCommandBuffers[mCurrentFrame];
+	{
+		ProfileScope scope(mProfiler, "recordCommandBuffer");
+		vkResetCommandBuffer(commandBuffer, 0);
+		recordCommandBuffer(commandBuffer, imageIndex);
+	}
+
+	if (!mGpuCulling)
+	{
+		RenderQueueStats queueStats = mRenderQueue.frameStats();
+		mRenderQueueStats.add(queueStats);
+		mRenderQueueTotals.add(queueStats);
+	}
 
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+	VkSemaphore waitSemaphores[] = { mImageAvailableSemaphores[mCurrentFrame] };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = mHeadless ? 0 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &mCommandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &commandBuffer;
 	
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
-	submitInfo.signalSemaphoreCount = 1;
+	VkSemaphore signalSemaphores[] = { mRenderFinishedSemaphores[imageIndex] };
+	submitInfo.signalSemaphoreCount = mHeadless ? 0 : 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
 	{
-		throw std::runtime_error("Failed to submit draw command buffers!");
+		ProfileScope scope(mProfiler, "queueSubmit");
+		if (vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, mInFlightFences[mCurrentFrame]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit draw command buffers!");
+		}
+	}
+
+	mFrameSerials[mCurrentFrame] = ++mSubmitSerial;
+	mFrameNumber++;
+
+	if (mHeadless)
+	{
+		mCurrentFrame = (mCurrentFrame + 1) % mFramesInFlight;
+		return;
 	}
 
 	VkPresentInfoKHR presentInfo{};
@@ -270,13 +553,19 @@ void Application::drawFrame()
 
 	presentInfo.pResults = nullptr; // optional
 
-	VkResult presentResult = vkQueuePresentKHR(mPresentQueue, &presentInfo);
+	VkResult presentResult;
+	{
+		ProfileScope scope(mProfiler, "queuePresent");
+		presentResult = vkQueuePresentKHR(mPresentQueue, &presentInfo);
+	}
+
+	mCurrentFrame = (mCurrentFrame + 1) % mFramesInFlight;
 
-	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR || mFramebufferResized)
 	{ 
 		recreateSwapChain();
 	}
-	else if (result != VK_SUCCESS)
+	else if (presentResult != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to present swap chain image!");
 	}
@@ -335,7 +624,7 @@ void Application::createLogicalDevice()
 	QueueFamilyIndices indices = FindQueueFamilies(mPhysicalDevice);
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.GraphicsFamily, indices.PresentFamily };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.GraphicsFamily, indices.PresentFamily, indices.TransferFamily };
 
 	float queuePriority = 1.0f;
 
@@ -350,7 +639,57 @@ void Application::createLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(mPhysicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+	deviceFeatures.pipelineStatisticsQuery = mProfiler.isEnabled() && supportedFeatures.pipelineStatisticsQuery;
+	deviceFeatures.inheritedQueries = mProfiler.isEnabled() && supportedFeatures.inheritedQueries;
+	mInheritedQueries = deviceFeatures.inheritedQueries == VK_TRUE;
+
+	// Indirect draws pick their transform through firstInstance; many draws per call are optional
+	if (mGpuCulling && !supportedFeatures.drawIndirectFirstInstance)
+	{
+		std::cerr << "GPU culling needs drawIndirectFirstInstance, culling on the CPU instead" << std::endl;
+		mGpuCulling = false;
+	}
+
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	mMultiDrawIndirect = deviceFeatures.multiDrawIndirect == VK_TRUE;
+
+	// Merged render queue packets are instanced draws too
+	mQueueMultiDraw = mQueueMultiDraw && mMultiDrawIndirect && deviceFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+	// Bindless materials index a partially bound texture array with a per-fragment material
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedIndexing{};
+	supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	auto getFeatures2 = mPhysicalDeviceProperties2 ?
+		(PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(mInstance, "vkGetPhysicalDeviceFeatures2KHR") : nullptr;
+
+	if (mBindlessMaterials && getFeatures2 && HasDeviceExtension(mPhysicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+		HasDeviceExtension(mPhysicalDevice, VK_KHR_MAINTENANCE3_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2KHR features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features2.pNext = &supportedIndexing;
+		getFeatures2(mPhysicalDevice, &features2);
+	}
+
+	if (mBindlessMaterials && !(supportedIndexing.shaderSampledImageArrayNonUniformIndexing &&
+		supportedIndexing.descriptorBindingPartiallyBound && supportedIndexing.runtimeDescriptorArray))
+	{
+		std::cerr << "No descriptor indexing, binding a descriptor set per material texture instead" << std::endl;
+		mBindlessMaterials = false;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexing{};
+	descriptorIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	descriptorIndexing.shaderSampledImageArrayNonUniformIndexing = mBindlessMaterials ? VK_TRUE : VK_FALSE;
+	descriptorIndexing.descriptorBindingPartiallyBound = mBindlessMaterials ? VK_TRUE : VK_FALSE;
+	descriptorIndexing.runtimeDescriptorArray = mBindlessMaterials ? VK_TRUE : VK_FALSE;
 
 	VkDeviceCreateInfo createInfo{};
 
@@ -360,8 +699,29 @@ void Application::createLogicalDevice()
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	// Optional: lets the pipeline cache report hits per pipeline
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+
+	mPipelineCreationFeedback = HasDeviceExtension(mPhysicalDevice, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	if (mPipelineCreationFeedback) enabledExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
+	// Optional: lets the GPU culling pass decide the draw count
+	mDrawIndirectCount = mGpuCulling && HasDeviceExtension(mPhysicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (mDrawIndirectCount) enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+	// Optional: compute mips for sRGB textures, whose storage views need extended usage
+	mMaintenance2 = HasDeviceExtension(mPhysicalDevice, VK_KHR_MAINTENANCE2_EXTENSION_NAME);
+	if (mMaintenance2) enabledExtensions.push_back(VK_KHR_MAINTENANCE2_EXTENSION_NAME);
+
+	if (mBindlessMaterials)
+	{
+		enabledExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		createInfo.pNext = &descriptorIndexing;
+	}
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	if (enableValidationLayer)
 	{
@@ -381,9 +741,51 @@ if (vkCreateDevice(mPhysicalDevice, &createInfo, nullptr, &mDevice) != VK_SUCCES
 // Create the Queues
 vkGetDeviceQueue(mDevice, indices.GraphicsFamily, 0, &mGraphicsQueue);
 vkGetDeviceQueue(mDevice, indices.PresentFamily, 0, &mPresentQueue);
+vkGetDeviceQueue(mDevice, indices.TransferFamily, 0, &mTransferQueue);
+}
+
+void Application::createAllocator()
+{
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &memProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+
+	mAllocator.init(mDevice, memProperties, properties.limits);
+}
+
+void Application::createPipelineCache()
+{
+	mPipelineCache.init(mPhysicalDevice, mDevice, PIPELINE_CACHE_PATH, mPipelineCreationFeedback);
+}
+
+void Application::createProfiler()
+{
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(mPhysicalDevice, &supportedFeatures);
+
+	// Same condition createLogicalDevice enabled the feature with
+	bool pipelineStatistics = mProfiler.isEnabled() && supportedFeatures.pipelineStatisticsQuery;
+
+	mProfiler.initGpu(mPhysicalDevice, mDevice, FindQueueFamilies(mPhysicalDevice).GraphicsFamily, mFramesInFlight, pipelineStatistics);
+}
+
+void Application::createUploader()
+{
+	QueueFamilyIndices indices = FindQueueFamilies(mPhysicalDevice);
+
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &memProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+
+	mUploader.init(mDevice, mAllocator, memProperties, properties.limits,
+		indices.TransferFamily, mTransferQueue, indices.GraphicsFamily, mGraphicsQueue);
 }
 
-void Application::createSwapChain()
+void Application::createSwapChain(VkSwapchainKHR oldSwapChain)
 {
 	SwapChainSupportDetails details = QuerySwapChainSupport(mPhysicalDevice);
 
@@ -429,7 +831,8 @@ void Application::createSwapChain()
 	createInfo.presentMode = presentMode;
 	createInfo.preTransform = details.capabilities.currentTransform;
 
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Lets the presentation engine hand over from the old swap chain without a gap
+	createInfo.oldSwapchain = oldSwapChain;
 
 	if (vkCreateSwapchainKHR(mDevice, &createInfo, nullptr, &mSwapChain) != VK_SUCCESS)
 	{
@@ -440,13 +843,30 @@ void Application::createSwapChain()
 	uint32_t swapChainImageCount;
 	vkGetSwapchainImagesKHR(mDevice, mSwapChain, &swapChainImageCount, nullptr);
 
-	mSwapChainImages.resize(imageCount);
+	mSwapChainImages.resize(swapChainImageCount);
 	vkGetSwapchainImagesKHR(mDevice, mSwapChain, &swapChainImageCount, mSwapChainImages.data());
 
 	mSwapChainImageFormat = surfaceFormat.format;
 	mSwapChainImageExtent = imageExtent;
 }
 
+void Application::createOffscreenTargets()
+{
+	mSwapChainImageFormat = HEADLESS_COLOR_FORMAT;
+	mSwapChainImageExtent = { mWidth, mHeight };
+
+	// One per frame in flight, indexed like the frames themselves
+	mSwapChainImages.resize(mFramesInFlight);
+	mOffscreenImageMemory.resize(mFramesInFlight);
+
+	for (uint32_t i = 0; i < mFramesInFlight; i++)
+	{
+		createImage(mWidth, mHeight, 1, HEADLESS_COLOR_FORMAT, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			mSwapChainImages[i], mOffscreenImageMemory[i]);
+	}
+}
+
 void Application::createImageViews()
 {
 	mImageViews.resize(mSwapChainImages.size());
@@ -468,7 +888,8 @@ void Application::createRenderPass()
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Headless targets are only ever copied out
+	colorAttachment.finalLayout = mHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference colorAttachmentRef{};
 	colorAttachmentRef.attachment = 0;
@@ -522,25 +943,53 @@ void Application::createRenderPass()
 
 void Application::createDescriptorSetLayout()
 {   
+	// Combined image samplers count against both the sampler and the sampled image limits
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+
+	const VkPhysicalDeviceLimits& limits = properties.limits;
+	mBindlessTextureCapacity = std::min({ MAX_BINDLESS_TEXTURES, limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages,
+		limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages });
+
+	if (mBindlessMaterials && mMaterialLibrary.texturePaths.size() > mBindlessTextureCapacity)
+	{
+		std::cerr << mMaterialLibrary.texturePaths.size() << " textures do not fit the " << mBindlessTextureCapacity
+			<< " the device binds at once, binding a descriptor set per material texture instead" << std::endl;
+		mBindlessMaterials = false;
+	}
+
 	VkDescriptorSetLayoutBinding uboLayoutBinding{};
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
 	VkDescriptorSetLayoutBinding imageSamplerLayoutBinding{};
 	imageSamplerLayoutBinding.binding = 1;
 	imageSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	imageSamplerLayoutBinding.descriptorCount = 1;
+	imageSamplerLayoutBinding.descriptorCount = mBindlessMaterials ? mBindlessTextureCapacity : 1;
 	imageSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
 	VkDescriptorSetLayoutBinding lightLayoutBinding{};
 	lightLayoutBinding.binding = 2;
-	lightLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	lightLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	lightLayoutBinding.descriptorCount = 1;
 	lightLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::array<VkDescriptorSetLayoutBinding, 3> bindings{ uboLayoutBinding, imageSamplerLayoutBinding, lightLayoutBinding };
+	VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+	instanceLayoutBinding.binding = 3;
+	instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	instanceLayoutBinding.descriptorCount = 1;
+	instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutBinding materialLayoutBinding{};
+	materialLayoutBinding.binding = 4;
+	materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialLayoutBinding.descriptorCount = 1;
+	materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	std::array<VkDescriptorSetLayoutBinding, 5> bindings{ uboLayoutBinding, imageSamplerLayoutBinding, lightLayoutBinding, instanceLayoutBinding,
+		materialLayoutBinding };
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 
@@ -548,6 +997,17 @@ void Application::createDescriptorSetLayout()
 	layoutInfo.pBindings = bindings.data();
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 
+	// Only as many array elements as there are textures are ever written
+	std::array<VkDescriptorBindingFlagsEXT, 5> bindingFlags{};
+	bindingFlags[1] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+	if (mBindlessMaterials) layoutInfo.pNext = &bindingFlagsInfo;
+
 	if (vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mDescriptorSetLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create descriptor set layout!");
@@ -556,7 +1016,7 @@ void Application::createDescriptorSetLayout()
 
 void Application::createGraphicsPipeline()
 {
-	createShaderModule(mDevice, "../../src/vert.spv", "../../src/frag.spv");
+	createShaderModule(mDevice, VERTEX_SHADER_PATH, mBindlessMaterials ? BINDLESS_FRAGMENT_SHADER_PATH : FRAGMENT_SHADER_PATH);
 
 	// Create ShaderStage Info
 	VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
@@ -574,16 +1034,19 @@ void Application::createGraphicsPipeline()
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
 
 	// Create Vertex Input Info
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescription = Vertex::getAttributeDescriptions();
+	// Shading reads both streams; the depth prepass only binding 0
+	constexpr auto bindingDescriptions = GpuVertexFormat::Layout::getBindingDescriptions();
+	constexpr auto attributeDescriptions = GpuVertexFormat::Layout::getAttributeDescriptions();
+	constexpr auto positionBindingDescriptions = GpuVertexFormat::PositionLayout::getBindingDescriptions();
+	constexpr auto positionAttributeDescriptions = GpuVertexFormat::PositionLayout::getAttributeDescriptions();
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
 	// Create Depth Stencil State Info
 	VkPipelineDepthStencilStateCreateInfo depthStencil{};
@@ -592,6 +1055,13 @@ void Application::createGraphicsPipeline()
 	depthStencil.depthTestEnable = VK_TRUE;
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	// After a depth prepass only the nearest surface is left to shade, and depth is already final
+	if (mDepthPrepass)
+	{
+		depthStencil.depthWriteEnable = VK_FALSE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	}
 	depthStencil.minDepthBounds = 0.0f;
 	depthStencil.maxDepthBounds = 1.0f;
 	depthStencil.stencilTestEnable = VK_FALSE;
@@ -602,24 +1072,9 @@ void Application::createGraphicsPipeline()
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	// Create Viewport & Scissors Info
-	VkViewport viewPort{};
-	viewPort.x = 0.0f;
-	viewPort.y = 0.0f;
-	viewPort.height = (float)mSwapChainImageExtent.height;
-	viewPort.width = (float)mSwapChainImageExtent.width;
-	viewPort.maxDepth = 1.0f;
-	viewPort.minDepth = 0.0f;
-	
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = mSwapChainImageExtent;
-
-	// Create viewport state Info to bind viewport & scissor
+	// Viewport & scissor are dynamic (set in recordCommandBuffer), so the pipeline survives resizes
 	VkPipelineViewportStateCreateInfo viewportState{};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.pScissors = &scissor;
-	viewportState.pViewports = &viewPort;
 	viewportState.scissorCount = 1;
 	viewportState.viewportCount = 1;
 
@@ -655,7 +1110,7 @@ void Application::createGraphicsPipeline()
 	VkDynamicState dynamicStates[] =
 	{
 		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
+		VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	VkPipelineDynamicStateCreateInfo dynamicState{};
@@ -686,7 +1141,7 @@ void Application::createGraphicsPipeline()
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil;
-	pipelineInfo.pDynamicState = nullptr;
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.pColorBlendState = &colorBlending;
 
 	pipelineInfo.layout = mPipelineLayout;
@@ -695,7 +1150,77 @@ void Application::createGraphicsPipeline()
 
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional 
 
-	if (vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mGraphicsPipeline) != VK_SUCCESS)
+	VkResult result = mPipelineCache.createGraphicsPipeline(pipelineInfo, mGraphicsPipeline, "graphics");
+
+	// Same state with the instanced vertex shader, which takes its model matrices from the instance buffer
+	VkShaderModule instancedShaderModule = VK_NULL_HANDLE;
+
+	if (result == VK_SUCCESS && mInstancing)
+	{
+		auto instancedCode = ReadFile(INSTANCED_VERTEX_SHADER_PATH);
+
+		VkShaderModuleCreateInfo moduleInfo{};
+		moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleInfo.codeSize = instancedCode.size();
+		moduleInfo.pCode = reinterpret_cast<const uint32_t*>(instancedCode.data());
+
+		result = vkCreateShaderModule(mDevice, &moduleInfo, nullptr, &instancedShaderModule);
+
+		if (result == VK_SUCCESS)
+		{
+			shaderStages[0].module = instancedShaderModule;
+			result = mPipelineCache.createGraphicsPipeline(pipelineInfo, mInstancedPipeline, "instanced");
+		}
+	}
+
+	// Depth prepass: position stream only, no fragment shader and no color writes
+	std::vector<VkShaderModule> depthShaderModules;
+
+	if (result == VK_SUCCESS && mDepthPrepass)
+	{
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(positionBindingDescriptions.size());
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(positionAttributeDescriptions.size());
+		vertexInputInfo.pVertexBindingDescriptions = positionBindingDescriptions.data();
+		vertexInputInfo.pVertexAttributeDescriptions = positionAttributeDescriptions.data();
+
+		depthStencil.depthWriteEnable = VK_TRUE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+		colorBlendAttachment.colorWriteMask = 0;
+		pipelineInfo.stageCount = 1;
+
+		auto createDepthPipeline = [&](const std::string& path, VkPipeline& pipeline, const char* name)
+		{
+			auto code = ReadFile(path);
+
+			VkShaderModuleCreateInfo moduleInfo{};
+			moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			moduleInfo.codeSize = code.size();
+			moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+			VkShaderModule module = VK_NULL_HANDLE;
+			VkResult moduleResult = vkCreateShaderModule(mDevice, &moduleInfo, nullptr, &module);
+			if (moduleResult != VK_SUCCESS) return moduleResult;
+
+			depthShaderModules.push_back(module);
+			shaderStages[0].module = module;
+			return mPipelineCache.createGraphicsPipeline(pipelineInfo, pipeline, name);
+		};
+
+		result = createDepthPipeline(DEPTH_VERTEX_SHADER_PATH, mDepthPipeline, "depth");
+
+		if (result == VK_SUCCESS && mInstancing)
+		{
+			result = createDepthPipeline(DEPTH_INSTANCED_VERTEX_SHADER_PATH, mDepthInstancedPipeline, "depthInstanced");
+		}
+	}
+
+	// Only needed while the pipelines are created
+	vkDestroyShaderModule(mDevice, mVertexShaderModule, nullptr);
+	vkDestroyShaderModule(mDevice, mFragmentShaderModule, nullptr);
+	vkDestroyShaderModule(mDevice, instancedShaderModule, nullptr);
+	for (VkShaderModule module : depthShaderModules) vkDestroyShaderModule(mDevice, module, nullptr);
+
+	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create graphics pipeline!");
 	}
@@ -731,7 +1256,7 @@ void Application::createCommandPool()
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = indices.GraphicsFamily;
-	poolInfo.flags = 0;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Per-frame buffers are re-recorded every frame
 
 	if (vkCreateCommandPool(mDevice, &poolInfo, nullptr, &mCommandPool) != VK_SUCCESS)
 	{
@@ -743,75 +1268,258 @@ void Application::createDepthResources()
 {
 	VkFormat format = findDepthFormat();
 	
-	createImage(mSwapChainImageExtent.width, mSwapChainImageExtent.height, format, VK_IMAGE_TILING_OPTIMAL,
+	createImage(mSwapChainImageExtent.width, mSwapChainImageExtent.height, 1, format, VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mDepthImage, mDepthImageMemory);
 
+	// The render pass moves the depth image out of UNDEFINED, no transition needed here
 	mDepthImageView = createImageView(mDepthImage, format, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-	transitionImageLayout(mDepthImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 }
 
-void Application::createTextureImage()
+void Application::loadMaterials()
 {
-	int width, height, channels;
+	if (mModelPaths.empty()) mModelPaths.push_back(MODEL_PATH);
 
-	stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-	VkDeviceSize textureSize = width * height * 4;
+	// Every model's library goes into one table, textures named by several models are loaded once
+	mModels.clear();
+	mMaterialLibrary = MaterialLibrary();
 
-	if (!pixels)
+	for (const std::string& path : mModelPaths)
 	{
-		throw std::runtime_error("Failed to load texture image!");
-	}
-
-	// Create Staging buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(textureSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		MappedFile source;
+		if (!source.open(path))
+		{
+			throw std::runtime_error("Failed to open model " + path);
+		}
 
-	void* data;
-	vkMapMemory(mDevice, stagingBufferMemory, 0, textureSize, 0, &data);
-	std::memcpy(data, pixels, static_cast<size_t>(textureSize));
-	vkUnmapMemory(mDevice, stagingBufferMemory);
+		std::unique_ptr<Model> model(new Model());
+		model->path = path;
 
-	stbi_image_free(pixels);
+		MaterialLibrary library = Materials::load(path, source.data(), source.size(), TEXTURE_PATH);
+		model->materialNames = library.names();
+		model->materialBase = Materials::append(mMaterialLibrary, library);
 
-	// Create Texture Image
-	createImage(width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mTextureImage, mTextureImageMemory);
-	
-	transitionImageLayout(mTextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		mModels.push_back(std::move(model));
+	}
 
-	copyBufferToImage(stagingBuffer, mTextureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+	// The generated texture stands in for every material texture
+	if (mTextureSize > 0)
+	{
+		mMaterialLibrary.texturePaths.assign(1, "");
+		for (uint32_t& index : mMaterialLibrary.textureIndices)
+		{
+			if (index != Materials::NO_TEXTURE) index = 0;
+		}
+	}
 
-	transitionImageLayout(mTextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	std::cerr << "Materials: " << mMaterialLibrary.materials.size() << " with " << mMaterialLibrary.texturePaths.size() << " textures, "
+		<< (mBindlessMaterials ? "bindless" : "a descriptor set per texture") << std::endl;
 }
 
-void Application::createTextureImageView()
+void Application::createTextureImage()
 {
-	mTextureImageView = createImageView(mTextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-}
+	auto loadStart = std::chrono::high_resolution_clock::now();
 
-void Application::createTextureSampler()
-{
-	VkSamplerCreateInfo createInfo{};
+	mTextures.resize(mMaterialLibrary.texturePaths.size());
+	bool mipGeneratorReady = false;
+	VkDeviceSize imageBytes = 0;
+
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		const std::string& path = mMaterialLibrary.texturePaths[i];
+
+		// Prefer a cooked texture with precomputed mips in a format the device samples, decode the source otherwise
+		if (path.empty() || !createCookedTextureImage(path, mTextures[i]))
+		{
+			// Blit when the format filters linearly, compute downsampling otherwise, or no mips at all
+			if (!mipGeneratorReady) mMipGenerator.init(mPhysicalDevice, mDevice, DOWNSAMPLE_SHADER_PATH, mPipelineCache, mMaintenance2);
+			mipGeneratorReady = true;
+
+			createSourceTextureImage(path, mTextures[i]);
+		}
+
+		imageBytes += mTextures[i].memory.size;
+	}
+
+	auto loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+
+	std::cerr << mTextures.size() << (mTextures.size() == 1 ? " texture" : " textures") << " loaded in " << loadTime << " ms, "
+		<< imageBytes / 1024 << " KiB of image memory" << std::endl;
+}
+
+bool Application::createCookedTextureImage(const std::string& sourcePath, Texture& result)
+{
+	std::string basePath = sourcePath.substr(0, sourcePath.find_last_of('.'));
+
+	for (const char* extension : COOKED_TEXTURE_EXTENSIONS)
+	{
+		std::string path = basePath + extension;
+
+		MappedFile file;
+		Ktx2Texture texture;
+		if (!file.open(path) || !Ktx2::parse(file.data(), file.size(), texture)) continue;
+
+		VkFormat format = static_cast<VkFormat>(texture.vkFormat);
+		if (!isTextureFormatSampleable(format)) continue;
+
+		result.format = format;
+		result.mipLevels = mTextureMipsEnabled ? static_cast<uint32_t>(texture.levels.size()) : 1;
+
+		createImage(texture.width, texture.height, result.mipLevels, format, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			result.image, result.memory);
+
+		// Levels are stored smallest first, stage the span covering the ones we use straight from the mapping
+		uint64_t begin = file.size(), end = 0;
+		for (uint32_t level = 0; level < result.mipLevels; level++)
+		{
+			begin = std::min(begin, texture.levels[level].offset);
+			end = std::max(end, texture.levels[level].offset + texture.levels[level].size);
+		}
+
+		std::vector<VkBufferImageCopy> regions(result.mipLevels);
+		for (uint32_t level = 0; level < result.mipLevels; level++)
+		{
+			regions[level].bufferOffset = texture.levels[level].offset - begin;
+			regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			regions[level].imageSubresource.mipLevel = level;
+			regions[level].imageSubresource.layerCount = 1;
+			regions[level].imageExtent = { std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u), 1 };
+		}
+
+		mUploader.uploadImage(result.image, VK_IMAGE_ASPECT_COLOR_BIT, result.mipLevels, file.data() + begin, end - begin, regions,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		std::cerr << "Texture " << path << ": " << texture.width << "x" << texture.height << ", " << result.mipLevels
+			<< " precomputed mip levels (" << TextureCompressor::formatName(static_cast<TextureFormat>(texture.vkFormat)) << ")" << std::endl;
+
+		return true;
+	}
+
+	std::cerr << "No cooked texture the device can sample for " << sourcePath << ", build the CookTextures target to create them" << std::endl;
+	return false;
+}
+
+void Application::createSourceTextureImage(const std::string& path, Texture& texture)
+{
+	int width, height, channels;
+	std::vector<stbi_uc> generatedPixels;
+	stbi_uc* pixels = nullptr;
+
+	if (path.empty())
+	{
+		// Checkerboard of any size for benchmark scenarios
+		width = height = static_cast<int>(mTextureSize);
+		generatedPixels.resize(static_cast<size_t>(mTextureSize) * mTextureSize * 4);
+
+		for (uint32_t y = 0; y < mTextureSize; y++)
+		{
+			for (uint32_t x = 0; x < mTextureSize; x++)
+			{
+				stbi_uc* texel = &generatedPixels[(static_cast<size_t>(y) * mTextureSize + x) * 4];
+				bool odd = ((x / GENERATED_TEXTURE_CELL) + (y / GENERATED_TEXTURE_CELL)) & 1;
+
+				texel[0] = odd ? 224 : 32;
+				texel[1] = static_cast<stbi_uc>(x * 255 / mTextureSize);
+				texel[2] = static_cast<stbi_uc>(y * 255 / mTextureSize);
+				texel[3] = 255;
+			}
+		}
+
+		pixels = generatedPixels.data();
+	}
+	else
+	{
+		pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	}
+
+	if (!pixels)
+	{
+		throw std::runtime_error("Failed to load texture image " + path + "!");
+	}
+
+	VkDeviceSize textureSize = width * height * 4;
+
+	MipGenerator::Method mipMethod = mTextureMipsEnabled ? mMipGenerator.chooseMethod(VK_FORMAT_R8G8B8A8_SRGB) : MipGenerator::Method::None;
+	texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+	texture.viewUsage = mMipGenerator.viewUsage(mipMethod);
+	texture.mipLevels = mipMethod != MipGenerator::Method::None ? MipGenerator::mipLevelCount(width, height) : 1;
+
+	if (mTextureMipsEnabled && mipMethod == MipGenerator::Method::None)
+	{
+		std::cerr << "No mip generation method for the texture format, sampling level 0 only" << std::endl;
+	}
+
+	// Create Texture Image
+	createImage(width, height, texture.mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | mMipGenerator.imageUsage(mipMethod),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.memory, mMipGenerator.imageFlags(mipMethod));
+
+	VkBufferImageCopy region{};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 };
+
+	mUploader.uploadImage(texture.image, VK_IMAGE_ASPECT_COLOR_BIT, texture.mipLevels, pixels, textureSize, { region },
+		mMipGenerator.inputLayout(mipMethod), mMipGenerator.inputStage(mipMethod), mMipGenerator.inputAccess(mipMethod));
+
+	if (generatedPixels.empty()) stbi_image_free(pixels);
+
+	// Recorded on the graphics queue after the upload is acquired there
+	mMipGenerator.generate(mUploader.graphicsCommands(), mipMethod, texture.image, VK_FORMAT_R8G8B8A8_SRGB,
+		static_cast<uint32_t>(width), static_cast<uint32_t>(height), texture.mipLevels);
+
+	std::cerr << "Texture " << (path.empty() ? "generated" : path) << ": " << width << "x" << height << ", " << texture.mipLevels << " mip levels ("
+		<< (mipMethod == MipGenerator::Method::Blit ? "blit" : mipMethod == MipGenerator::Method::Compute ? "compute" : "none") << ")" << std::endl;
+}
+
+bool Application::isTextureFormatSampleable(VkFormat format)
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, format, &properties);
+
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (properties.optimalTilingFeatures & required) == required;
+}
+
+void Application::createTextureImageView()
+{
+	for (Texture& texture : mTextures)
+	{
+		texture.view = createImageView(texture.image, texture.format, VK_IMAGE_ASPECT_COLOR_BIT, texture.mipLevels, texture.viewUsage);
+	}
+}
+
+void Application::createTextureSampler()
+{
+	VkSamplerCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	createInfo.minFilter = VK_FILTER_LINEAR;
 	createInfo.magFilter = VK_FILTER_LINEAR;
 	createInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	createInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	createInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	createInfo.anisotropyEnable = VK_TRUE;
 
 	VkPhysicalDeviceProperties properties{};
 	vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
-	
-	createInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+
+	VkPhysicalDeviceFeatures features{};
+	vkGetPhysicalDeviceFeatures(mPhysicalDevice, &features);
+
+	// Only enabled on the device when supported, see createLogicalDevice
+	createInfo.anisotropyEnable = features.samplerAnisotropy;
+	createInfo.maxAnisotropy = features.samplerAnisotropy ? std::min(MAX_TEXTURE_ANISOTROPY, properties.limits.maxSamplerAnisotropy) : 1.0f;
 	createInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_WHITE;
 	createInfo.unnormalizedCoordinates = VK_FALSE;
 
 	createInfo.compareEnable = VK_FALSE;
 	createInfo.compareOp = VK_COMPARE_OP_ALWAYS;
 	createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	createInfo.minLod = 0.0f;
+	// Shared by every texture, so the longest chain decides
+	uint32_t maxMipLevels = 1;
+	for (const Texture& texture : mTextures) maxMipLevels = std::max(maxMipLevels, texture.mipLevels);
+	createInfo.maxLod = static_cast<float>(maxMipLevels);
+	createInfo.mipLodBias = 0.0f;
 
 	if (vkCreateSampler(mDevice, &createInfo, nullptr, &mTextureSampler) != VK_SUCCESS)
 	{
@@ -819,128 +1527,311 @@ void Application::createTextureSampler()
 	}
 }
 
-void Application::loadModel()
+void Application::createMaterialBuffer()
+{
+	std::vector<GpuMaterial> materials = Materials::buildGpuMaterials(mMaterialLibrary);
+	VkDeviceSize bufferSize = sizeof(GpuMaterial) * materials.size();
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		mMaterialBuffer, mMaterialMemory);
+
+	mUploader.uploadBuffer(mMaterialBuffer, 0, materials.data(), bufferSize,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void Application::loadModels()
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string war, err;
+	mMeshRegistry.clear();
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &war, &err, MODEL_PATH.c_str()))
+	for (const std::unique_ptr<Model>& model : mModels)
 	{
-		throw std::runtime_error(war + err);
+		loadModel(*model);
+		model->meshId = mMeshRegistry.add(model->mesh);
 	}
 
-	for (const auto& shape : shapes)
+	std::cerr << mModels.size() << " model" << (mModels.size() > 1 ? "s" : "") << " in shared buffers: " << mMeshRegistry.vertexCount()
+		<< " vertices, " << mMeshRegistry.indexCount() << " indices, " << mMeshRegistry.lods().size() << " levels of detail" << std::endl;
+
+	// Per-texture sets draw every level one material at a time, in shared buffer indices and merged library materials
+	mMaterialRanges.clear();
+	mLodRangeStart.assign(1, 0);
+	for (size_t i = 0; i < mModels.size() && !mBindlessMaterials; i++)
 	{
-		for (const auto& index : shape.mesh.indices)
+		const Model& model = *mModels[i];
+		const MeshAllocation& allocation = mMeshRegistry.mesh(model.meshId);
+
+		for (size_t lod = 0; lod < model.mesh.lodCount; lod++)
 		{
-			Vertex vertex{};
+			size_t firstRange = mMaterialRanges.size();
+			Materials::findRanges(model.mesh.vertices, model.mesh.indices, model.mesh.lods[lod].firstIndex, model.mesh.lods[lod].indexCount,
+				mMaterialRanges);
 
-			vertex.pos =
+			for (size_t range = firstRange; range < mMaterialRanges.size(); range++)
 			{
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-			};
-
-			vertex.normal = 
-			{ 
-				attrib.normals[3 * index.normal_index + 0],
-				attrib.normals[3 * index.normal_index + 1],
-				attrib.normals[3 * index.normal_index + 2]
-			};
-
-			vertex.texCoord =
-			{
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-			};
+				mMaterialRanges[range].firstIndex += allocation.firstIndex;
+				mMaterialRanges[range].material += model.materialBase;
+			}
+			mLodRangeStart.push_back(static_cast<uint32_t>(mMaterialRanges.size()));
+		}
+	}
+
+	// One pass over the vertex cache ordered LOD 0, cheap enough to redo instead of caching.
+	// Only the first model's, which is level 0 of the shared buffers at base vertex 0; other models draw LOD 0 whole.
+	if (mMeshletCulling && !mGpuCulling)
+	{
+		auto meshletStart = std::chrono::high_resolution_clock::now();
+		const MeshView& mesh = mModels[0]->mesh;
+
+		mMeshlets = Meshlets::build(mesh.vertices, mesh.indices, mesh.lods[0].firstIndex, mesh.lods[0].indexCount);
+
+		uint64_t meshletVertices = 0;
+		for (const Meshlet& meshlet : mMeshlets.meshlets) meshletVertices += meshlet.vertexCount;
+
+		std::cerr << "  " << mMeshlets.meshlets.size() << " meshlets in "
+			<< std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - meshletStart).count() << " ms, "
+			<< double(mesh.lods[0].indexCount / 3) / std::max<size_t>(1, mMeshlets.meshlets.size()) << " triangles and "
+			<< double(meshletVertices) / std::max<size_t>(1, mMeshlets.meshlets.size()) << " vertices each" << std::endl;
+	}
+}
+
+void Application::loadModel(Model& model)
+{
+	auto loadStart = std::chrono::high_resolution_clock::now();
+
+	MappedFile source;
+	if (!source.open(model.path))
+	{
+		throw std::runtime_error("Failed to open model " + model.path);
+	}
 
-			vertices.push_back(vertex);
-			indices.push_back(indices.size());
+	uint64_t sourceSize = source.size();
+	uint64_t sourceHash = MeshCache::hashData(source.data(), source.size());
+
+	// Vertex::material indexes the library, so the cache is only valid for the same material order
+	std::string materialNames;
+	for (const std::string& name : model.materialNames) materialNames += name + '\n';
+	sourceHash ^= MeshCache::hashData(reinterpret_cast<const uint8_t*>(materialNames.data()), materialNames.size());
+
+	std::string cachePath = model.path + MESH_CACHE_EXTENSION;
+	bool cacheHit = model.cache.open(cachePath, sourceHash, sourceSize);
+
+	if (cacheHit)
+	{
+		// Used in place: the vertex and index blobs are uploaded straight from the mapping
+		model.mesh = model.cache.view();
+	}
+	else
+	{
+		loadModelFromObj(model, source);
+		model.mesh = MeshView{ model.vertices.data(), model.vertices.size(), model.indices.data(), model.indices.size(),
+			model.lods.data(), model.lods.size() };
+
+		if (!MeshCache::write(cachePath, sourceHash, sourceSize, model.vertices, model.indices, model.lods))
+		{
+			std::cerr << "Failed to write mesh cache " << cachePath << std::endl;
 		}
 	}
+
+	model.bounds = FrustumCulling::computeBounds(model.mesh.vertices, model.mesh.vertexCount);
+
+	auto loadEnd = std::chrono::high_resolution_clock::now();
+
+	std::cerr << "Model " << model.path << (cacheHit ? " loaded from mesh cache" : " parsed and cached")
+		<< " in " << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+}
+
+void Application::loadModelFromObj(Model& model, const MappedFile& source)
+{
+	ThreadPool pool;
+	ObjLoader::load(source.data(), source.size(), pool, model.vertices, model.indices, model.materialNames);
+
+	// Share identical corners, then reorder for the post-transform cache, overdraw and vertex fetch
+	size_t rawVertexCount = model.vertices.size();
+	VertexCacheStats rawStats = MeshOptimizer::analyzeVertexCache(model.indices, model.vertices.size());
+
+	MeshOptimizer::weldVertices(model.vertices, model.indices);
+	VertexCacheStats weldedStats = MeshOptimizer::analyzeVertexCache(model.indices, model.vertices.size());
+
+	MeshOptimizer::optimizeVertexCache(model.indices, model.vertices.size());
+	MeshOptimizer::optimizeOverdraw(model.indices, model.vertices);
+
+	// Coarser levels go behind LOD 0 in the same index buffer, before vertex fetch order is fixed for all of them
+	auto lodStart = std::chrono::high_resolution_clock::now();
+	model.lods = MeshSimplifier::buildLodChain(model.vertices, model.indices);
+	double lodMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - lodStart).count();
+
+	// One run per material in every level, for renderers that bind a texture per draw
+	Materials::sortByMaterial(model.vertices, model.indices, model.lods);
+
+	MeshOptimizer::optimizeVertexFetch(model.vertices, model.indices);
+
+	// Measured on LOD 0 in its final order, after the material sort moved whole triangles between clusters
+	std::vector<uint32_t> finalIndices(model.indices.begin() + model.lods[0].firstIndex,
+		model.indices.begin() + model.lods[0].firstIndex + model.lods[0].indexCount);
+	VertexCacheStats optimizedStats = MeshOptimizer::analyzeVertexCache(finalIndices, model.vertices.size());
+
+	uint32_t materialRuns = 0;
+	for (size_t i = 0; i < finalIndices.size(); i += 3)
+	{
+		if (i == 0 || model.vertices[finalIndices[i]].material != model.vertices[finalIndices[i - 3]].material) materialRuns++;
+	}
+
+	std::cerr << "Model " << model.path << ": " << model.lods[0].indexCount / 3 << " triangles, "
+		<< rawVertexCount << " -> " << model.vertices.size() << " vertices" << std::endl;
+	std::cerr << "  ACMR/ATVR raw " << rawStats.acmr << "/" << rawStats.atvr
+		<< ", welded " << weldedStats.acmr << "/" << weldedStats.atvr
+		<< ", optimized " << optimizedStats.acmr << "/" << optimizedStats.atvr
+		<< " (overdraw order kept within each of " << materialRuns << " material runs)" << std::endl;
+
+	uint64_t simplifiedTriangles = 0;
+	for (size_t i = 1; i < model.lods.size(); i++) simplifiedTriangles += model.lods[i - 1].indexCount / 3;
+
+	std::cerr << "  " << model.lods.size() - 1 << " LODs in " << lodMs << " ms (" << simplifiedTriangles / (lodMs / 1000.0) << " triangles/s):";
+	for (size_t i = 1; i < model.lods.size(); i++) std::cerr << " " << model.lods[i].indexCount / 3 << " (error " << model.lods[i].error << ")";
+	std::cerr << std::endl;
 }
 
 void Application::createVertexBuffers()
 {
-	VkDeviceSize buffersize = sizeof(vertices[0]) * vertices.size();
+	using Format = GpuVertexFormat;
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(buffersize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer, stagingBufferMemory);
+	// Every model's positions first, the other attributes after them in the same buffer, one binding each.
+	// A model's vertices start at its base vertex in both streams.
+	uint32_t vertexCount = mMeshRegistry.vertexCount();
+	std::vector<Format::Position> positions(vertexCount);
+	std::vector<Format::Attributes> attributes(vertexCount);
 
-	void* data;
-	vkMapMemory(mDevice, stagingBufferMemory, 0, buffersize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)buffersize);
-	vkUnmapMemory(mDevice, stagingBufferMemory);
+	VkDeviceSize positionSize = sizeof(Format::Position) * vertexCount;
+	VkDeviceSize attributeSize = sizeof(Format::Attributes) * vertexCount;
+	mAttributeStreamOffset = (positionSize + VERTEX_STREAM_ALIGNMENT - 1) & ~(VERTEX_STREAM_ALIGNMENT - 1);
+	VkDeviceSize buffersize = mAttributeStreamOffset + attributeSize;
 
 	createBuffer(buffersize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		mVertexBuffer, mVertexBufferMemory);
 
-	copyBuffer(stagingBuffer, mVertexBuffer, buffersize);
+	auto convertStart = std::chrono::high_resolution_clock::now();
+
+	for (const std::unique_ptr<Model>& model : mModels)
+	{
+		const MeshAllocation& allocation = mMeshRegistry.mesh(model->meshId);
+		Format::Position* modelPositions = positions.data() + allocation.vertexOffset;
+		Format::Attributes* modelAttributes = attributes.data() + allocation.vertexOffset;
+
+		// Compact vertices are quantized inside each model's bounds; its model matrix takes unorm positions back to model space
+		VertexQuantization quantization = VertexFormat::computeQuantization(model->bounds.min, model->bounds.max);
+		VertexFormat::convert(model->mesh.vertices, model->mesh.vertexCount, quantization, modelPositions, modelAttributes);
+		VertexFormat::offsetMaterials(model->materialBase, model->mesh.vertexCount, modelPositions, modelAttributes);
+
+		if (Format::QUANTIZED) model->dequantization = glm::scale(glm::translate(glm::mat4(1.0f), quantization.offset), quantization.scale);
+	}
+
+	std::cerr << "Vertex streams (" << Format::NAME << "): " << vertexCount << " vertices in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - convertStart).count() << " ms, "
+		<< sizeof(Vertex) * vertexCount << " -> " << positionSize + attributeSize << " bytes, "
+		<< Format::PositionLayout::STRIDE << " of " << Format::Layout::STRIDE << " bytes/vertex fetched by position-only passes" << std::endl;
 
-	vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
-	vkFreeMemory(mDevice, stagingBufferMemory, nullptr);
+	mUploader.uploadBuffer(mVertexBuffer, 0, positions.data(), positionSize,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	mUploader.uploadBuffer(mVertexBuffer, mAttributeStreamOffset, attributes.data(), attributeSize,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 }
 
 void Application::createIndexBuffers()
 {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	VkDeviceSize bufferSize = sizeof(uint32_t) * mMeshRegistry.indexCount();
 
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingBuffer, stagingBufferMemory);
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mIndexBuffer, mIndexBufferMemory);
 
-	void* data;
-	vkMapMemory(mDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(mDevice, stagingBufferMemory);
-
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mIndexBuffer, mIndexBufferMemory);
-
-	copyBuffer(stagingBuffer, mIndexBuffer, bufferSize);
+	// Index values stay relative to their model, draws add the base vertex
+	for (const std::unique_ptr<Model>& model : mModels)
+	{
+		const MeshAllocation& allocation = mMeshRegistry.mesh(model->meshId);
 
-	vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
-	vkFreeMemory(mDevice, stagingBufferMemory, nullptr);
+		mUploader.uploadBuffer(mIndexBuffer, sizeof(uint32_t) * allocation.firstIndex, model->mesh.indices,
+			sizeof(uint32_t) * allocation.indexCount, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	}
 }
 
 void Application::createUniformBuffers()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+
+	mUniformAlignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 16);
 
-	mUniformBuffers.resize(mSwapChainImages.size());
-	mUniformBuffersMemory.resize(mSwapChainImages.size());
+	// Every mesh copy pushes its own block, plus the light
+	VkDeviceSize blockSize = std::max(sizeof(UniformBufferObject), sizeof(LightBufferObject));
+	blockSize = (blockSize + mUniformAlignment - 1) & ~(mUniformAlignment - 1);
+	mUniformRingFrameSize = std::max(UNIFORM_RING_FRAME_SIZE, blockSize * (mMeshCount + 1));
 
-	for (size_t i = 0; i < mSwapChainImages.size(); i++)
+	// One buffer holds every frame's uniforms; frame i owns [i * mUniformRingFrameSize, (i + 1) * mUniformRingFrameSize)
+	VkDeviceSize bufferSize = mUniformRingFrameSize * mFramesInFlight;
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		mUniformRingBuffer, mUniformRingMemory);
+
+	// Host visible allocations stay mapped for their whole lifetime
+	mUniformRingMapped = static_cast<uint8_t*>(mUniformRingMemory.mapped);
+
+	// Instance transforms, partitioned per frame like the uniform ring
+	VkDeviceSize storageAlignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 16);
+	mInstanceFrameSize = (sizeof(InstanceData) * mMeshCount + storageAlignment - 1) & ~(storageAlignment - 1);
+
+	createBuffer(mInstanceFrameSize * mFramesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mInstanceBuffer, mInstanceMemory);
+
+	// Culling many copies is worth spreading across cores
+	mCullSpheres.resize(mMeshCount);
+	if (mFrustumCulling && !mGpuCulling && mMeshCount >= FrustumCulling::PARALLEL_THRESHOLD) mCullPool.reset(new ThreadPool());
+
+	// Render queue draw commands, created on first use and grown with the queue
+	mIndirectBuffers.assign(mFramesInFlight, VK_NULL_HANDLE);
+	mIndirectMemory.assign(mFramesInFlight, Allocation{});
+	mIndirectCapacity.assign(mFramesInFlight, 0);
+}
+
+void Application::createGpuCuller()
+{
+	if (!mGpuCulling) return;
+
+	// The indirect draws cover whole levels, which per-texture sets would have to split
+	if (!mBindlessMaterials && mTextures.size() > 1)
 	{
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mUniformBuffers[i], mUniformBuffersMemory[i]);
+		std::cerr << "GPU culling needs bindless materials to draw " << mTextures.size() << " textures, culling on the CPU instead" << std::endl;
+		mGpuCulling = false;
+		return;
 	}
 
-	VkDeviceSize LightBufferSize = sizeof(LightBufferObject);
-	
-	createBuffer(LightBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, mLightBuffer, mLightBufferMemory);
+	if (!mGpuCuller.init(mPhysicalDevice, mDevice, mAllocator, CULL_SHADER_PATH, mPipelineCache, mFramesInFlight, mMeshCount,
+		mDrawIndirectCount, mMultiDrawIndirect))
+	{
+		mGpuCulling = false;
+	}
 }
 
 void Application::createDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 3> poolSize;
-	poolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize[0].descriptorCount = static_cast<uint32_t>(mSwapChainImages.size());
+	// Bindless: one set holding the whole texture array; otherwise a set per texture
+	uint32_t setCount = mBindlessMaterials ? 1 : static_cast<uint32_t>(mTextures.size());
+
+	std::array<VkDescriptorPoolSize, 4> poolSize;
+	poolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSize[0].descriptorCount = 2 * setCount;
 
 	poolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSize[1].descriptorCount = static_cast<uint32_t>(mSwapChainImages.size());
-	
-	poolSize[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize[2].descriptorCount = static_cast<uint32_t>(mSwapChainImages.size());
+	poolSize[1].descriptorCount = mBindlessMaterials ? mBindlessTextureCapacity : setCount;
+
+	poolSize[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSize[2].descriptorCount = setCount;
+
+	poolSize[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[3].descriptorCount = setCount;
 
 	VkDescriptorPoolCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	createInfo.poolSizeCount = static_cast<uint32_t>(poolSize.size());
 	createInfo.pPoolSizes = poolSize.data();
-	createInfo.maxSets = static_cast<uint32_t>(mSwapChainImages.size());
+	createInfo.maxSets = setCount;
 
 	if (vkCreateDescriptorPool(mDevice, &createInfo, nullptr, &mDescriptorPool) != VK_SUCCESS)
 	{
@@ -950,174 +1841,898 @@ void Application::createDescriptorPool()
 
 void Application::createDescriptorSets()
 {	
-	std::vector<VkDescriptorSetLayout> layouts(mSwapChainImages.size(), mDescriptorSetLayout);
+	// Each set serves every frame; the frame's ring partition is selected by dynamic offsets
+	std::vector<VkDescriptorSetLayout> layouts(mBindlessMaterials ? 1 : mTextures.size(), mDescriptorSetLayout);
+	mDescriptorSets.resize(layouts.size());
 
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(mSwapChainImages.size());
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
 	allocInfo.descriptorPool = mDescriptorPool;
 	allocInfo.pSetLayouts = layouts.data();
 	
-	mDescriptorSets.resize(mSwapChainImages.size());
 	if (vkAllocateDescriptorSets(mDevice, &allocInfo, mDescriptorSets.data()) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to allocate descriptor sets!");
 	}
 
-	for (size_t i = 0; i < mSwapChainImages.size(); i++)
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = mUniformRingBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = sizeof(UniformBufferObject);
+
+	// Bindless: the first textures of the array, the rest stays unbound
+	std::vector<VkDescriptorImageInfo> imageInfos(mTextures.size());
+	for (size_t i = 0; i < mTextures.size(); i++)
 	{
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = mUniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
+		imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfos[i].imageView = mTextures[i].view;
+		imageInfos[i].sampler = mTextureSampler;
+	}
 
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mTextureImageView;
-		imageInfo.sampler = mTextureSampler;
+	VkDescriptorBufferInfo lightInfo{};
+	lightInfo.buffer = mUniformRingBuffer;
+	lightInfo.offset = 0;
+	lightInfo.range = sizeof(LightBufferObject);
 
-		VkDescriptorBufferInfo lightInfo{};
-		lightInfo.buffer = mLightBuffer;
-		lightInfo.offset = 0;
-		lightInfo.range = sizeof(LightBufferObject);
+	// The whole frame partition, instances are indexed from its start
+	VkDescriptorBufferInfo instanceInfo{};
+	instanceInfo.buffer = mInstanceBuffer;
+	instanceInfo.offset = 0;
+	instanceInfo.range = mInstanceFrameSize;
 
-		std::array<VkWriteDescriptorSet, 3> writeDescriptor{};
+	VkDescriptorBufferInfo materialInfo{};
+	materialInfo.buffer = mMaterialBuffer;
+	materialInfo.offset = 0;
+	materialInfo.range = VK_WHOLE_SIZE;
+
+	for (size_t set = 0; set < mDescriptorSets.size(); set++)
+	{
+		VkDescriptorSet descriptorSet = mDescriptorSets[set];
+
+		std::array<VkWriteDescriptorSet, 5> writeDescriptor{};
 		writeDescriptor[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptor[0].dstBinding = 0;
 		writeDescriptor[0].dstArrayElement = 0;
-		writeDescriptor[0].dstSet = mDescriptorSets[i];
-		writeDescriptor[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writeDescriptor[0].dstSet = descriptorSet;
+		writeDescriptor[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		writeDescriptor[0].descriptorCount = 1;
 		writeDescriptor[0].pBufferInfo = &bufferInfo;
 
 		writeDescriptor[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptor[1].dstBinding = 1;
 		writeDescriptor[1].dstArrayElement = 0;
-		writeDescriptor[1].dstSet = mDescriptorSets[i];
+		writeDescriptor[1].dstSet = descriptorSet;
 		writeDescriptor[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		writeDescriptor[1].descriptorCount = 1;
-		writeDescriptor[1].pImageInfo = &imageInfo;
+		writeDescriptor[1].descriptorCount = mBindlessMaterials ? static_cast<uint32_t>(imageInfos.size()) : 1;
+		writeDescriptor[1].pImageInfo = &imageInfos[mBindlessMaterials ? 0 : set];
 
 		writeDescriptor[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptor[2].dstBinding = 2;
 		writeDescriptor[2].dstArrayElement = 0;
-		writeDescriptor[2].dstSet = mDescriptorSets[i];
-		writeDescriptor[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writeDescriptor[2].dstSet = descriptorSet;
+		writeDescriptor[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		writeDescriptor[2].descriptorCount = 1;
 		writeDescriptor[2].pBufferInfo = &lightInfo;
 
-		vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(writeDescriptor.size()), writeDescriptor.data(), 0, nullptr);
+		writeDescriptor[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptor[3].dstBinding = 3;
+		writeDescriptor[3].dstArrayElement = 0;
+		writeDescriptor[3].dstSet = descriptorSet;
+		writeDescriptor[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		writeDescriptor[3].descriptorCount = 1;
+		writeDescriptor[3].pBufferInfo = &instanceInfo;
+
+		writeDescriptor[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptor[4].dstBinding = 4;
+		writeDescriptor[4].dstArrayElement = 0;
+		writeDescriptor[4].dstSet = descriptorSet;
+		writeDescriptor[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptor[4].descriptorCount = 1;
+		writeDescriptor[4].pBufferInfo = &materialInfo;
+
+		vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(writeDescriptor.size()), writeDescriptor.data(), 0, nullptr);
+	}
+}
+
+void Application::createCommandBuffers()
+{
+	// One command buffer per frame in flight, re-recorded every frame
+	mCommandBuffers.resize(mFramesInFlight);
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = mCommandPool;
+	allocInfo.commandBufferCount = (uint32_t)mCommandBuffers.size();
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	
+	if (vkAllocateCommandBuffers(mDevice, &allocInfo, mCommandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate command buffers!");
+	}
+
+	if (mRecordThreadCount > 0) createParallelRecorder(mRecordThreadCount);
+}
+
+void Application::createParallelRecorder(uint32_t threadCount)
+{
+	mParallelRecorder.cleanUp();
+
+	// One job per worker, each recording a contiguous slice of the draws
+	mRecordPool.reset(new ThreadPool(threadCount));
+	mParallelRecorder.init(mDevice, FindQueueFamilies(mPhysicalDevice).GraphicsFamily, mFramesInFlight, threadCount);
+	mRecordThreadCount = threadCount;
+}
+
+void Application::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	// Begin recording commands in command buffer
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed beginning command buffer!");
+	}
+
+	// Resolves this frame slot's queries from mFramesInFlight frames ago
+	mProfiler.beginFrame(commandBuffer, mCurrentFrame);
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.framebuffer = mSwapChainFramebuffers[imageIndex];
+	renderPassInfo.renderPass = mRenderPass;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = mSwapChainImageExtent;
+	
+	std::array<VkClearValue, 2> clearValues{};
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	// Secondary command buffers may only run inside a statistics query when they inherit it
+	bool secondaries = mRecordThreadCount > 0;
+	bool statistics = !secondaries || mInheritedQueries;
+
+	// The draw list is written before the render pass begins
+	if (mGpuCulling)
+	{
+		mProfiler.beginGpuScope(commandBuffer, "gpuCull");
+		mGpuCuller.recordCull(commandBuffer, mCurrentFrame, mFrustum, mMeshCount);
+		mProfiler.endGpuScope(commandBuffer);
+	}
+
+	mProfiler.beginGpuScope(commandBuffer, "mainPass", statistics);
+
+	// The frame's sorted render queue, whose keys put every depth prepass packet ahead of the shading ones.
+	// Ranges execute in order, so splitting it across workers keeps that. GPU culled, one indirect call per pass.
+	uint32_t drawCount = mGpuCulling ? (mDepthPrepass ? 2 : 1) : mRenderQueue.size();
+
+	auto recordRange = [this](VkCommandBuffer rangeBuffer, uint32_t first, uint32_t end)
+	{
+		recordDraws(rangeBuffer, first, end);
+	};
+
+	if (secondaries)
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		VkCommandBufferInheritanceInfo inheritance{};
+		inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.renderPass = mRenderPass;
+		inheritance.subpass = 0;
+		inheritance.framebuffer = mSwapChainFramebuffers[imageIndex];
+		inheritance.pipelineStatistics = statistics ? mProfiler.pipelineStatisticsFlags() : 0;
+
+		const std::vector<VkCommandBuffer>& secondaries = mParallelRecorder.record(*mRecordPool, mCurrentFrame, drawCount, inheritance, recordRange);
+
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	}
+	else
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		recordRange(commandBuffer, 0, drawCount);
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+
+	mProfiler.endGpuScope(commandBuffer);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to record command buffers!");
+	}
+}
+
+void Application::recordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t end)
+{
+	// Secondary command buffers inherit no state, so each range sets everything itself
+	VkViewport viewport{};
+	viewport.width = static_cast<float>(mSwapChainImageExtent.width);
+	viewport.height = static_cast<float>(mSwapChainImageExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.extent = mSwapChainImageExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	if (!mGpuCulling)
+	{
+		mRenderQueue.submit(commandBuffer, first, end, mQueueMultiDraw ? mIndirectBuffers[mCurrentFrame] : VK_NULL_HANDLE);
+		return;
+	}
+
+	// Pass 0 is the depth prepass when there is one, the last pass shades
+	for (uint32_t pass = first; pass < end; pass++)
+	{
+		bool depthOnly = mDepthPrepass && pass == 0;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthOnly ? mDepthInstancedPipeline : mInstancedPipeline);
+
+		// Position stream in binding 0, attribute stream in binding 1; position-only pipelines bind just the first
+		VkBuffer vertexBuffers[] = { mVertexBuffer, mVertexBuffer };
+		VkDeviceSize offsets[] = { 0, mAttributeStreamOffset };
+		vkCmdBindVertexBuffers(commandBuffer, 0, depthOnly ? 1 : 2, vertexBuffers, offsets);
+
+		vkCmdBindIndexBuffer(commandBuffer, mIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		// Dynamic offsets follow binding order: UBO (binding 0), light (binding 2), instances (binding 3)
+		uint32_t dynamicOffsets[] = { mUboOffsets[0], mLightOffset, mInstanceOffset };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSets[0], 3, dynamicOffsets);
+
+		mGpuCuller.recordDraws(commandBuffer, mCurrentFrame);
+	}
+}
+
+void Application::buildRenderQueue(float nearPlane, float farPlane)
+{
+	mRenderQueue.clear();
+
+	// GPU culled frames draw straight from the culling output
+	if (mGpuCulling) return;
+
+	for (uint32_t pass = mDepthPrepass ? 0 : 1; pass < 2; pass++)
+	{
+		if (!mInstancing)
+		{
+			for (uint32_t draw = 0; draw < mDrawCount; draw++)
+			{
+				uint32_t depthBucket = RenderQueue::depthBucket(mDrawDepths[draw], nearPlane, farPlane);
+
+				if (mDrawLods[draw] == 0 && !mDrawRunStart.empty())
+				{
+					for (uint32_t run = mDrawRunStart[draw]; run < mDrawRunStart[draw + 1]; run++)
+						queueIndexRange(pass, 0, mMeshletRuns[run].firstIndex, mMeshletRuns[run].indexCount, 1, 0, mUboOffsets[draw], depthBucket);
+					continue;
+				}
+
+				const MeshLod& lod = mMeshRegistry.lods()[mDrawLods[draw]];
+				queueIndexRange(pass, mDrawLods[draw], lod.firstIndex, lod.indexCount, 1, 0, mUboOffsets[draw], depthBucket);
+			}
+			continue;
+		}
+
+		// gl_InstanceIndex starts at firstInstance, so each packet reads its own transforms.
+		// Instances are sorted by level of detail, one packet per level, keyed by its nearest copy.
+		for (uint32_t first = 0; first < mDrawCount;)
+		{
+			uint32_t end = first + 1;
+			while (end < mDrawCount && mDrawLods[end] == mDrawLods[first]) end++;
+
+			// Meshlet culled copies each draw their own visible ranges, still reading transforms at firstInstance
+			if (mDrawLods[first] == 0 && !mDrawRunStart.empty())
+			{
+				for (uint32_t draw = first; draw < end; draw++)
+				{
+					uint32_t depthBucket = RenderQueue::depthBucket(mDrawDepths[draw], nearPlane, farPlane);
+					for (uint32_t run = mDrawRunStart[draw]; run < mDrawRunStart[draw + 1]; run++)
+						queueIndexRange(pass, 0, mMeshletRuns[run].firstIndex, mMeshletRuns[run].indexCount, 1, draw, mUboOffsets[0], depthBucket);
+				}
+			}
+			else
+			{
+				float nearest = *std::min_element(mDrawDepths.begin() + first, mDrawDepths.begin() + end);
+				const MeshLod& lod = mMeshRegistry.lods()[mDrawLods[first]];
+				queueIndexRange(pass, mDrawLods[first], lod.firstIndex, lod.indexCount, end - first, first, mUboOffsets[0],
+					RenderQueue::depthBucket(nearest, nearPlane, farPlane));
+			}
+			first = end;
+		}
+	}
+
+	{
+		ProfileScope sortScope(mProfiler, "sortRenderQueue");
+		mRenderQueue.sort();
+	}
+
+	if (mQueueMultiDraw) writeIndirectCommands(mCurrentFrame);
+}
+
+void Application::writeIndirectCommands(uint32_t frame)
+{
+	// The frame's fence has been waited on, so its old buffer can go right away when the queue outgrows it
+	if (mRenderQueue.size() > mIndirectCapacity[frame])
+	{
+		if (mIndirectBuffers[frame] != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(mDevice, mIndirectBuffers[frame], nullptr);
+			mAllocator.free(mIndirectMemory[frame]);
+		}
+
+		uint32_t capacity = std::max<uint32_t>(mIndirectCapacity[frame], 64);
+		while (capacity < mRenderQueue.size()) capacity *= 2;
+
+		createBuffer(sizeof(VkDrawIndexedIndirectCommand) * capacity, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mIndirectBuffers[frame], mIndirectMemory[frame]);
+		mIndirectCapacity[frame] = capacity;
+	}
+
+	mRenderQueue.writeCommands(static_cast<VkDrawIndexedIndirectCommand*>(mIndirectMemory[frame].mapped));
+}
+
+void Application::queueIndexRange(uint32_t pass, uint32_t lod, uint32_t firstIndex, uint32_t indexCount, uint32_t instanceCount,
+	uint32_t firstInstance, uint32_t uboOffset, uint32_t depthBucket)
+{
+	bool depthOnly = pass == 0;
+
+	DrawPacket packet{};
+	packet.pipeline = depthOnly ? (mInstancing ? mDepthInstancedPipeline : mDepthPipeline) : (mInstancing ? mInstancedPipeline : mGraphicsPipeline);
+	packet.pipelineLayout = mPipelineLayout;
+	packet.descriptorSet = mDescriptorSets[0];
+	// Dynamic offsets follow binding order: UBO (binding 0), light (binding 2), instances (binding 3)
+	packet.dynamicOffsets[0] = uboOffset;
+	packet.dynamicOffsets[1] = mLightOffset;
+	packet.dynamicOffsets[2] = mInstanceOffset;
+	// Position stream in binding 0, attribute stream in binding 1; position-only pipelines bind just the first
+	packet.vertexBuffers[0] = packet.vertexBuffers[1] = mVertexBuffer;
+	packet.vertexOffsets[1] = mAttributeStreamOffset;
+	packet.vertexBindingCount = depthOnly ? 1 : 2;
+	packet.indexBuffer = mIndexBuffer;
+	packet.command.instanceCount = instanceCount;
+	packet.command.vertexOffset = mMeshRegistry.mesh(mMeshRegistry.lodMesh(lod)).vertexOffset;
+	packet.command.firstInstance = firstInstance;
+
+	// One pipeline per pass is in use, the key's material is the descriptor set and its mesh the level drawn
+	uint32_t pipeline = mInstancing ? 1 : 0;
+
+	// Depth-only draws sample nothing, so only shading splits per texture set
+	if (mBindlessMaterials || depthOnly)
+	{
+		packet.command.firstIndex = firstIndex;
+		packet.command.indexCount = indexCount;
+		mRenderQueue.push(RenderQueue::makeKey(pass, pipeline, 0, depthBucket, lod), packet);
+		return;
+	}
+
+	if (indexCount == 0) return;
+
+	// Untextured materials only read the storage buffer, any set does
+	auto textureSet = [this](uint32_t material)
+	{
+		uint32_t texture = mMaterialLibrary.textureIndices[material];
+		return texture == Materials::NO_TEXTURE ? 0 : texture;
+	};
+
+	// Last material run starting at or before firstIndex
+	const MaterialRange* rangesBegin = mMaterialRanges.data() + mLodRangeStart[lod];
+	const MaterialRange* rangesEnd = mMaterialRanges.data() + mLodRangeStart[lod + 1];
+	const MaterialRange* range = std::upper_bound(rangesBegin, rangesEnd, firstIndex,
+		[](uint32_t index, const MaterialRange& materialRange) { return index < materialRange.firstIndex; }) - 1;
+
+	uint32_t end = firstIndex + indexCount;
+
+	// Neighbouring runs that sample the same texture go into one packet
+	for (uint32_t first = firstIndex; first < end;)
+	{
+		uint32_t set = textureSet(range->material);
+		uint32_t last = range->firstIndex + range->indexCount;
+
+		while (++range < rangesEnd && range->firstIndex < end && textureSet(range->material) == set)
+		{
+			last = range->firstIndex + range->indexCount;
+		}
+		last = std::min(last, end);
+
+		packet.descriptorSet = mDescriptorSets[set];
+		packet.command.firstIndex = first;
+		packet.command.indexCount = last - first;
+		mRenderQueue.push(RenderQueue::makeKey(pass, pipeline, set, depthBucket, lod), packet);
+
+		first = last;
+	}
+}
+
+void Application::createSyncObjects()
+{
+	mImageAvailableSemaphores.resize(mFramesInFlight);
+	mFrameSerials.assign(mFramesInFlight, 0);
+	mInFlightFences.resize(mFramesInFlight);
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	// Start signaled so the first wait on each frame does not block
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < mFramesInFlight; i++)
+	{
+		if (vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &mImageAvailableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateFence(mDevice, &fenceInfo, nullptr, &mInFlightFences[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create synchronization objects for a frame!");
+		}
+	}
+
+	createRenderFinishedSemaphores();
+}
+
+void Application::createRenderFinishedSemaphores()
+{
+	// Per swap chain image: the present waiting on one is only known to be done once its image is acquired again,
+	// which the frame's fence does not cover
+	mRenderFinishedSemaphores.resize(mSwapChainImages.size());
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (size_t i = 0; i < mRenderFinishedSemaphores.size(); i++)
+	{
+		if (vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &mRenderFinishedSemaphores[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create synchronization objects for a swap chain image!");
+		}
+	}
+}
+
+void Application::recreateSwapChain()
+{
+	int width = 0, height = 0;
+
+	glfwGetFramebufferSize(mWindow, &width, &height);
+
+	while (width == 0 || height == 0)
+	{
+		glfwGetFramebufferSize(mWindow, &width, &height);
+		glfwWaitEvents();
+	}
+
+	auto recreateStart = std::chrono::high_resolution_clock::now();
+
+	// No idle wait: frames in flight keep their resources until their fences show they are done
+	retireSwapChainResources();
+
+	VkSwapchainKHR oldSwapChain = mSwapChain;
+	VkFormat oldFormat = mSwapChainImageFormat;
+
+	createSwapChain(oldSwapChain);
+
+	mDeletionQueue.retire(mSubmitSerial, [this, oldSwapChain]() { vkDestroySwapchainKHR(mDevice, oldSwapChain, nullptr); });
+
+	// Presents to the old images may still wait on their semaphores, so they go with the old swap chain
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+	renderFinishedSemaphores.swap(mRenderFinishedSemaphores);
+	mDeletionQueue.retire(mSubmitSerial, [this, renderFinishedSemaphores]()
+	{
+		for (VkSemaphore semaphore : renderFinishedSemaphores) vkDestroySemaphore(mDevice, semaphore, nullptr);
+	});
+	createRenderFinishedSemaphores();
+
+	// Viewport and scissor are dynamic, the render pass and pipeline only depend on the surface format
+	if (mSwapChainImageFormat != oldFormat)
+	{
+		VkRenderPass renderPass = mRenderPass;
+		VkPipeline pipeline = mGraphicsPipeline;
+		VkPipeline instancedPipeline = mInstancedPipeline;
+		VkPipeline depthPipeline = mDepthPipeline;
+		VkPipeline depthInstancedPipeline = mDepthInstancedPipeline;
+		VkPipelineLayout pipelineLayout = mPipelineLayout;
+
+		mDeletionQueue.retire(mSubmitSerial, [this, renderPass, pipeline, instancedPipeline, depthPipeline, depthInstancedPipeline, pipelineLayout]()
+		{
+			vkDestroyPipeline(mDevice, pipeline, nullptr);
+			vkDestroyPipeline(mDevice, instancedPipeline, nullptr);
+			vkDestroyPipeline(mDevice, depthPipeline, nullptr);
+			vkDestroyPipeline(mDevice, depthInstancedPipeline, nullptr);
+			vkDestroyPipelineLayout(mDevice, pipelineLayout, nullptr);
+			vkDestroyRenderPass(mDevice, renderPass, nullptr);
+		});
+
+		createRenderPass();
+		createGraphicsPipeline();
+	}
+
+	createImageViews();
+	createDepthResources();
+	createFramebuffers();
+
+	mFramebufferResized = false;
+
+	mRecreateStats.record(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recreateStart).count());
+}
+
+void Application::retireSwapChainResources()
+{
+	std::vector<VkFramebuffer> framebuffers;
+	std::vector<VkImageView> imageViews;
+	framebuffers.swap(mSwapChainFramebuffers);
+	imageViews.swap(mImageViews);
+
+	VkImage depthImage = mDepthImage;
+	VkImageView depthImageView = mDepthImageView;
+	Allocation depthImageMemory = mDepthImageMemory;
+
+	mDeletionQueue.retire(mSubmitSerial, [this, framebuffers, imageViews, depthImage, depthImageView, depthImageMemory]() mutable
+	{
+		for (auto framebuffer : framebuffers) vkDestroyFramebuffer(mDevice, framebuffer, nullptr);
+		for (auto imageView : imageViews) vkDestroyImageView(mDevice, imageView, nullptr);
+
+		vkDestroyImageView(mDevice, depthImageView, nullptr);
+		vkDestroyImage(mDevice, depthImage, nullptr);
+		mAllocator.free(depthImageMemory);
+	});
+}
+
+void Application::FramebufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+	auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
+	app->mFramebufferResized = true;
+}
+
+void Application::runHeadless()
+{
+	std::vector<double> cpuFrameTimes;
+	cpuFrameTimes.reserve(mHeadlessFrameCount);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto frameStart = start;
+
+	for (uint32_t i = 0; i < mHeadlessFrameCount; i++)
+	{
+		// Render queue totals cover the same frames as the measured frame times
+		if (i == mBenchmarkWarmupFrames) mRenderQueueTotals = RenderQueueStats();
+
+		drawFrame();
+
+		auto frameEnd = std::chrono::high_resolution_clock::now();
+		cpuFrameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+		frameStart = frameEnd;
+	}
+
+	vkDeviceWaitIdle(mDevice);
+	mProfiler.collect();
+
+	if (mGpuCulling) validateGpuCulling();
+
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::cerr << "Headless: " << mHeadlessFrameCount << " frames at " << mWidth << "x" << mHeight << " in " << totalMs
+		<< " ms (" << totalMs / mHeadlessFrameCount << " ms/frame), startup " << mStartupMs << " ms" << std::endl;
+
+	if (mBenchmark)
+	{
+		// Warm-up frames settle caches, pipelines and clocks and are left out
+		std::vector<double> cpuMeasured(cpuFrameTimes.begin() + std::min<size_t>(mBenchmarkWarmupFrames, cpuFrameTimes.size()), cpuFrameTimes.end());
+
+		const std::vector<double>& gpuFrameTimes = mProfiler.gpuFrameTimes();
+		size_t gpuMeasuredCount = std::min(gpuFrameTimes.size(), cpuMeasured.size());
+		std::vector<double> gpuMeasured(gpuFrameTimes.end() - gpuMeasuredCount, gpuFrameTimes.end());
+
+		if (mBenchmarkReportPath.empty())
+		{
+			writeBenchmarkReport(std::cout, cpuMeasured, gpuMeasured);
+		}
+		else
+		{
+			std::ofstream file(mBenchmarkReportPath, std::ios::trunc);
+			writeBenchmarkReport(file, cpuMeasured, gpuMeasured);
+
+			if (!file.good())
+			{
+				throw std::runtime_error("Failed to write benchmark report to " + mBenchmarkReportPath);
+			}
+
+			std::cerr << "Wrote benchmark report to " << mBenchmarkReportPath << std::endl;
+		}
+	}
+
+	if (!mReadbackPath.empty())
+	{
+		// drawFrame already advanced past the last frame's target
+		uint32_t lastFrame = (mCurrentFrame + mFramesInFlight - 1) % mFramesInFlight;
+		readBackImage(mSwapChainImages[lastFrame], mReadbackPath);
+	}
+}
+
+// mean, p50, p95, p99 and max as a JSON object, nearest-rank percentiles
+static void writeFrameTimeSummary(std::ostream& out, std::vector<double> frameTimes)
+{
+	if (frameTimes.empty())
+	{
+		out << "null";
+		return;
+	}
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+
+	double total = 0.0;
+	for (double frameTime : frameTimes) total += frameTime;
+
+	auto percentile = [&frameTimes](double p)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * frameTimes.size()));
+		return frameTimes[std::min(std::max<size_t>(rank, 1), frameTimes.size()) - 1];
+	};
+
+	out << "{ \"mean\": " << total / frameTimes.size() << ", \"p50\": " << percentile(50.0) << ", \"p95\": " << percentile(95.0)
+		<< ", \"p99\": " << percentile(99.0) << ", \"max\": " << frameTimes.back() << ", \"samples\": " << frameTimes.size() << " }";
+}
+
+void Application::writeBenchmarkReport(std::ostream& out, const std::vector<double>& cpuFrameTimes, const std::vector<double>& gpuFrameTimes)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+
+	out << "{\n";
+	out << "  \"device\": \"" << properties.deviceName << "\",\n";
+	out << "  \"scenario\": { \"width\": " << mWidth << ", \"height\": " << mHeight << ", \"meshCount\": " << mMeshCount
+		<< ", \"instanced\": " << (mInstancing ? "true" : "false") << ", \"frustumCulling\": " << (mFrustumCulling ? "true" : "false")
+		<< ", \"gpuCulling\": " << (mGpuCulling ? "true" : "false") << ", \"meshletCulling\": " << (!mMeshlets.meshlets.empty() ? "true" : "false")
+		<< ", \"lodThreshold\": " << mLodThreshold << ", \"modelCount\": " << mModels.size() << ", \"lodCount\": " << mMeshRegistry.lods().size() << ", \"recordThreads\": " << mRecordThreadCount
+		<< ", \"vertexFormat\": \"" << GpuVertexFormat::NAME << "\", \"vertexBufferBytes\": " << GpuVertexFormat::Layout::STRIDE * mMeshRegistry.vertexCount()
+		<< ", \"depthPrepass\": " << (mDepthPrepass ? "true" : "false")
+		<< ", \"positionFetchBytes\": " << GpuVertexFormat::PositionLayout::STRIDE << ", \"shadingFetchBytes\": " << GpuVertexFormat::Layout::STRIDE
+		<< ", \"textureSize\": " << mTextureSize << ", \"bindlessMaterials\": " << (mBindlessMaterials ? "true" : "false")
+		<< ", \"materialCount\": " << mMaterialLibrary.materials.size() << ", \"textureCount\": " << mTextures.size()
+		<< ", \"framesInFlight\": " << mFramesInFlight
+		<< ", \"warmupFrames\": " << mBenchmarkWarmupFrames << ", \"measuredFrames\": " << cpuFrameTimes.size() << " },\n";
+	out << "  \"startupMs\": " << mStartupMs << ",\n";
+	if (mRenderQueueTotals.frames > 0)
+	{
+		double frames = static_cast<double>(mRenderQueueTotals.frames);
+		out << "  \"renderQueue\": { \"packetsPerFrame\": " << mRenderQueueTotals.packets / frames << ", \"bindsPerFrame\": "
+			<< mRenderQueueTotals.binds / frames << ", \"bindsElidedPerFrame\": " << mRenderQueueTotals.bindsElided / frames
+			<< ", \"drawsPerFrame\": " << mRenderQueueTotals.draws / frames
+			<< ", \"multiDrawIndirect\": " << (mQueueMultiDraw ? "true" : "false") << ", \"sortMs\": " << mRenderQueueTotals.sortMs / frames << " },\n";
+	}
+	out << "  \"cpuFrameMs\": ";
+	writeFrameTimeSummary(out, cpuFrameTimes);
+	out << ",\n  \"gpuFrameMs\": ";
+	writeFrameTimeSummary(out, gpuFrameTimes);
+	out << "\n}\n";
+}
+
+void Application::validateGpuCulling()
+{
+	// drawFrame already moved on, the last frame is the one before
+	uint32_t lastFrame = (mCurrentFrame + mFramesInFlight - 1) % mFramesInFlight;
+
+	std::vector<uint32_t> gpuVisible;
+	mGpuCuller.readBack(mGraphicsQueue, mCommandPool, lastFrame, gpuVisible);
+
+	// mCullSpheres and mFrustum still hold the last frame's input
+	std::vector<uint32_t> cpuVisible(mMeshCount);
+	cpuVisible.resize(FrustumCulling::cull(mFrustum, mCullSpheres, 0, mMeshCount, FrustumCulling::Kernel::Scalar, cpuVisible.data()));
+
+	std::vector<uint8_t> gpuFlags(mMeshCount, 0), cpuFlags(mMeshCount, 0);
+	for (uint32_t i : gpuVisible) if (i < mMeshCount) gpuFlags[i] = 1;
+	for (uint32_t i : cpuVisible) cpuFlags[i] = 1;
+
+	// Only spheres clear of every plane by more than the tolerance must agree
+	uint32_t borderline = 0;
+	uint32_t mismatches = gpuVisible.size() > mMeshCount ? 1 : 0;
+	for (uint32_t i = 0; i < mMeshCount; i++)
+	{
+		if (gpuFlags[i] == cpuFlags[i]) continue;
+
+		float x = mCullSpheres.x[i], y = mCullSpheres.y[i], z = mCullSpheres.z[i], radius = mCullSpheres.radius[i];
+		float tolerance = CULL_VALIDATION_TOLERANCE * std::max(1.0f, std::abs(x) + std::abs(y) + std::abs(z) + radius);
+
+		bool nearPlane = false;
+		for (const glm::vec4& plane : mFrustum.planes)
+		{
+			float distance = plane.x * x + plane.y * y + plane.z * z + plane.w + radius;
+			nearPlane = nearPlane || std::abs(distance) <= tolerance;
+		}
+
+		if (nearPlane) borderline++;
+		else mismatches++;
+	}
+
+	std::cerr << "GPU culling: " << gpuVisible.size() << "/" << mMeshCount << " visible, CPU reference: " << cpuVisible.size()
+		<< ", " << borderline << " within rounding of a plane" << std::endl;
+
+	if (mismatches > 0)
+	{
+		throw std::runtime_error("GPU culling disagrees with the CPU reference!");
 	}
 }
 
-void Application::createCommandBuffers()
+void Application::readBackImage(VkImage image, const std::string& path)
 {
-	mCommandBuffers.resize(mSwapChainFramebuffers.size());
+	VkDeviceSize size = static_cast<VkDeviceSize>(mSwapChainImageExtent.width) * mSwapChainImageExtent.height * 4;
+
+	VkBuffer buffer;
+	Allocation memory;
+	createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		buffer, memory);
 
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.commandPool = mCommandPool;
-	allocInfo.commandBufferCount = (uint32_t)mCommandBuffers.size();
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	
-	if (vkAllocateCommandBuffers(mDevice, &allocInfo, mCommandBuffers.data()) != VK_SUCCESS)
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// The render pass left the image in TRANSFER_SRC_OPTIMAL
+	VkBufferImageCopy region{};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { mSwapChainImageExtent.width, mSwapChainImageExtent.height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	if (vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
 	{
-		throw std::runtime_error("Failed to allocate command buffers!");
+		throw std::runtime_error("Failed to submit readback!");
 	}
 
-	for (uint32_t i = 0; i < mCommandBuffers.size(); i++)
+	vkQueueWaitIdle(mGraphicsQueue);
+
+	// Binary PPM: drop alpha, the bytes are already sRGB encoded
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << "P6\n" << mSwapChainImageExtent.width << " " << mSwapChainImageExtent.height << "\n255\n";
+
+	const uint8_t* pixels = static_cast<const uint8_t*>(memory.mapped);
+	for (VkDeviceSize i = 0; i < size; i += 4)
 	{
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0;
-		beginInfo.pInheritanceInfo = nullptr;
+		file.write(reinterpret_cast<const char*>(pixels + i), 3);
+	}
 
-		// Begin recording commands in command buffer
-		if (vkBeginCommandBuffer(mCommandBuffers[i], &beginInfo) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed beginning command buffer : " + i);
-		}
+	bool written = file.good();
+	file.close();
 
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.framebuffer = mSwapChainFramebuffers[i];
-		renderPassInfo.renderPass = mRenderPass;
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = mSwapChainImageExtent;
-		
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
+	vkFreeCommandBuffers(mDevice, mCommandPool, 1, &commandBuffer);
+	vkDestroyBuffer(mDevice, buffer, nullptr);
+	mAllocator.free(memory);
 
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
+	if (!written)
+	{
+		throw std::runtime_error("Failed to write readback to " + path);
+	}
+
+	std::cerr << "Wrote the last frame to " << path << std::endl;
+}
 
-		// Begin Render Pass
-		vkCmdBeginRenderPass(mCommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE); 
+void Application::runRecordBenchmark()
+{
+	// Nothing is submitted, so frame 0's command buffers are free to re-record
+	mCurrentFrame = 0;
+	updateUniformBuffer(mCurrentFrame);
 
-		vkCmdBindPipeline(mCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, mGraphicsPipeline);
+	uint32_t drawCount = mDrawCount;
+	uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
 
-		VkBuffer vertexBuffers[] = { mVertexBuffer };
-		
-		VkDeviceSize offsets[] = { 0 };
+	// 0 is the inline path, then powers of two up to every hardware thread
+	std::vector<uint32_t> threadCounts = { 0 };
+	for (uint32_t count = 1; count < hardwareThreads; count *= 2) threadCounts.push_back(count);
+	threadCounts.push_back(hardwareThreads);
 
-		vkCmdBindVertexBuffers(mCommandBuffers[i], 0, 1, vertexBuffers, offsets);
+	std::cerr << "Recording " << drawCount << " draws, " << RECORD_BENCHMARK_ITERATIONS << " iterations each" << std::endl;
 
-		vkCmdBindIndexBuffer(mCommandBuffers[i], mIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	double singleThreadMs = 0.0;
 
-		vkCmdBindDescriptorSets(mCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSets[i], 0, nullptr);
-		
-		vkCmdDrawIndexed(mCommandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+	for (uint32_t threadCount : threadCounts)
+	{
+		if (threadCount > 0) createParallelRecorder(threadCount);
+		else mRecordThreadCount = 0;
 
-		vkCmdEndRenderPass(mCommandBuffers[i]);
+		VkCommandBuffer commandBuffer = mCommandBuffers[mCurrentFrame];
+		double totalMs = 0.0;
 
-		if (vkEndCommandBuffer(mCommandBuffers[i]) != VK_SUCCESS)
+		for (uint32_t i = 0; i < RECORD_BENCHMARK_ITERATIONS; i++)
 		{
-			throw std::runtime_error("Failed to record command buffers!");
+			auto start = std::chrono::high_resolution_clock::now();
+
+			vkResetCommandBuffer(commandBuffer, 0);
+			recordCommandBuffer(commandBuffer, 0);
+
+			totalMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 		}
-	}
-}
 
-void Application::createSemaphores()
-{
-	VkSemaphoreCreateInfo semaphoreInfo{};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		double averageMs = totalMs / RECORD_BENCHMARK_ITERATIONS;
+		if (threadCount == 1) singleThreadMs = averageMs;
 
-	if (vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create semaphores!");
+		if (threadCount == 0)
+		{
+			std::cerr << "  inline: " << averageMs << " ms" << std::endl;
+		}
+		else
+		{
+			std::cerr << "  " << threadCount << " thread" << (threadCount > 1 ? "s" : "") << ": " << averageMs << " ms ("
+				<< singleThreadMs / averageMs << "x of 1 thread)" << std::endl;
+		}
 	}
 }
 
-void Application::recreateSwapChain()
+void Application::runResizeBenchmark()
 {
-	int width = 0, height = 0;
+	auto drawTimed = [this]()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		glfwPollEvents();
+		drawFrame();
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
 
-	glfwGetFramebufferSize(mWindow, &width, &height);
+	TimingStats steadyStats;
+	for (uint32_t i = 0; i < RESIZE_BENCHMARK_WARMUP_FRAMES; i++) steadyStats.record(drawTimed());
 
-	while (width == 0 || height == 0)
+	MemoryUsage usageBefore = mAllocator.usage();
+	size_t maxPending = 0;
+
+	TimingStats stormStats;
+	mRecreateStats.reset();
+
+	for (uint32_t i = 0; i < mResizeBenchmarkCount; i++)
 	{
-		glfwGetFramebufferSize(mWindow, &width, &height);
-		glfwWaitEvents();
+		// Walk through a spread of sizes so consecutive resizes always differ
+		int width = static_cast<int>(mWidth) + static_cast<int>(i % 7) * 64 - 192;
+		int height = static_cast<int>(mHeight) + static_cast<int>(i % 5) * 48 - 96;
+		glfwSetWindowSize(mWindow, width, height);
+
+		for (uint32_t frame = 0; frame < RESIZE_BENCHMARK_FRAMES_PER_RESIZE; frame++)
+		{
+			stormStats.record(drawTimed());
+			maxPending = std::max(maxPending, mDeletionQueue.pendingCount());
+		}
 	}
 
-	vkDeviceWaitIdle(mDevice);
-	
-	cleanUpSwapChain();
+	// Let every frame in flight retire so only live memory remains
+	for (uint32_t i = 0; i <= mFramesInFlight; i++) drawTimed();
 
-	createSwapChain();
-	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
-	createFramebuffers();
-	createUniformBuffers();
-	createDescriptorPool();
-	createDescriptorSets();
-	createCommandBuffers();
+	MemoryUsage usageAfter = mAllocator.usage();
+
+	std::cerr << "Resize benchmark: " << mResizeBenchmarkCount << " resizes, " << mRecreateStats.samples << " swap chain recreations" << std::endl
+		<< "  recreate: avg " << mRecreateStats.averageMs() << " ms, max " << mRecreateStats.maxMs << " ms" << std::endl
+		<< "  frame: steady avg " << steadyStats.averageMs() << " ms, during resizes avg " << stormStats.averageMs()
+		<< " ms, max " << stormStats.maxMs << " ms" << std::endl
+		<< "  memory: " << usageBefore.usedBytes / 1024 << " -> " << usageAfter.usedBytes / 1024 << " KiB used, "
+		<< usageBefore.blockBytes / 1024 << " -> " << usageAfter.blockBytes / 1024 << " KiB in blocks, "
+		<< usageBefore.deviceAllocations << " -> " << usageAfter.deviceAllocations << " device allocations" << std::endl
+		<< "  deletion queue: at most " << maxPending << " entries pending, " << mDeletionQueue.pendingCount() << " left" << std::endl;
 }
 
-void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory)
+void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, Allocation & bufferMemory)
 {
 	VkBufferCreateInfo bufferInfo{};
 
@@ -1134,97 +2749,245 @@ void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMe
 	VkMemoryRequirements memRequirments{};
 	vkGetBufferMemoryRequirements(mDevice, buffer, &memRequirments);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirments.memoryTypeBits, properties);
-	
-	if (vkAllocateMemory(mDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate buffer memory!");
-	}
+	uint32_t memoryType = findMemoryType(memRequirments.memoryTypeBits, properties);
+	bufferMemory = mAllocator.allocate(memRequirments, memoryType, true);
 
-	vkBindBufferMemory(mDevice, buffer, bufferMemory, 0);
+	vkBindBufferMemory(mDevice, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-void Application::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void Application::updateUniformBuffer(uint32_t currentFrame)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	ProfileScope scope(mProfiler, "updateUniformBuffer");
 
-	VkBufferCopy copyRegion{};
-	copyRegion.size = size;
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
+	static auto startTime = std::chrono::high_resolution_clock::now();
 
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	auto currentTime = std::chrono::high_resolution_clock::now();
+	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 
-	endSingletimeCommands(commandBuffer);
-}
+	// Fixed time step when headless, so a given frame always looks the same
+	if (mHeadless) time = mFrameNumber / HEADLESS_FRAME_RATE;
 
-VkCommandBuffer Application::beginSingleTimeCommands()
-{
-	VkCommandBuffer commandBuffer;
+	// This frame's partition is free: its fence was waited on in drawFrame
+	mUniformFrameBase = mUniformRingFrameSize * currentFrame;
+	mUniformFrameCursor = 0;
+	mUniformBytesUploaded = 0;
 
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = mCommandPool;
-	allocInfo.commandBufferCount = 1;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	
-	vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer);
+	// Mesh copies sit on a square grid centered on the origin, the camera backs off to keep it in view
+	uint32_t gridSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(mMeshCount))));
+	float gridCenter = (gridSide - 1) * 0.5f;
+	float sceneScale = (1.0f + gridCenter * MESH_GRID_SPACING) * mViewDistanceScale;
 
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	glm::vec3 eye = glm::vec3(4.0f) * sceneScale;
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	// Scripted path: orbit while moving in and out and up and down, a pure function of the frame time
+	if (mBenchmark)
+	{
+		float angle = glm::radians(45.0f) + time * 0.5f;
+		float radius = 5.66f * (1.0f + 0.25f * std::sin(time * 0.3f));
+		float height = 4.0f * (1.0f + 0.5f * std::sin(time * 0.2f));
 
-	return commandBuffer;
-}
+		eye = glm::vec3(std::cos(angle) * radius, std::sin(angle) * radius, height) * sceneScale;
+	}
 
-void Application::endSingletimeCommands(VkCommandBuffer commandBuffer)
-{
-	vkEndCommandBuffer(commandBuffer);
+	UniformBufferObject ubo;
+	ubo.view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	float nearPlane = 0.1f;
+	float farPlane = 10.0f * sceneScale;
+	ubo.proj = glm::perspective(glm::radians(45.0f), mSwapChainImageExtent.width / (float)mSwapChainImageExtent.height, nearPlane, farPlane);
+	ubo.proj[1][1] *= -1;
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-	
-	vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(mGraphicsQueue);
+	glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 
-	vkFreeCommandBuffers(mDevice, mCommandPool, 1, &commandBuffer);
-}
+	auto copyPosition = [&](uint32_t i)
+	{
+		return glm::vec3((i % gridSide - gridCenter) * MESH_GRID_SPACING, (i / gridSide - gridCenter) * MESH_GRID_SPACING, 0.0f);
+	};
 
-void Application::updateUniformBuffer(uint32_t currentImage)
-{
-	static auto startTime = std::chrono::high_resolution_clock::now();
+	// Copies cycle through the models
+	auto copyModel = [&](uint32_t i) -> const Model& { return *mModels[i % mModels.size()]; };
 
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	// Rotation and translation move the bounding sphere's center but keep its radius
+	mModelCenters.resize(mModels.size());
+	for (size_t i = 0; i < mModels.size(); i++) mModelCenters[i] = glm::vec3(rotation * glm::vec4(mModels[i]->bounds.center, 1.0f));
+	auto copyCenter = [&](uint32_t i) { return copyPosition(i) + mModelCenters[i % mModels.size()]; };
 
-	UniformBufferObject ubo;
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.view = glm::lookAt(glm::vec3(4.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.proj = glm::perspective(glm::radians(45.0f), mSwapChainImageExtent.width / (float)mSwapChainImageExtent.height, 0.1f, 10.0f);
-	ubo.proj[1][1] *= -1;
+	if (mFrustumCulling || mGpuCulling || !mMeshlets.meshlets.empty())
+	{
+		for (uint32_t i = 0; i < mMeshCount; i++)
+		{
+			mCullSpheres.set(i, copyCenter(i), copyModel(i).bounds.radius);
+		}
+
+		mFrustum = FrustumCulling::extractFrustum(ubo.proj * ubo.view);
+	}
+
+	if (mFrustumCulling && !mGpuCulling)
+	{
+		ProfileScope cullScope(mProfiler, "frustumCull");
+		FrustumCulling::cull(mFrustum, mCullSpheres, mCullPool.get(), mVisibleCopies);
+	}
+	else
+	{
+		mVisibleCopies.resize(mMeshCount);
+		for (uint32_t i = 0; i < mMeshCount; i++) mVisibleCopies[i] = i;
+	}
+
+	mDrawCount = static_cast<uint32_t>(mVisibleCopies.size());
+
+	// Coarsest level whose simplification error projects to at most mLodThreshold pixels
+	float pixelsPerUnitAtUnitDistance = std::abs(ubo.proj[1][1]) * 0.5f * mSwapChainImageExtent.height;
+
+	// Levels are indices into the registry's levels, so copies of different models never share one
+	const std::vector<MeshLod>& lods = mMeshRegistry.lods();
+
+	auto selectLod = [&](uint32_t copy)
+	{
+		const Model& model = copyModel(copy);
+		const MeshAllocation& allocation = mMeshRegistry.mesh(model.meshId);
+
+		uint32_t lod = allocation.firstLod;
+		if (mLodThreshold <= 0.0f) return lod;
+
+		float distance = std::max(glm::length(copyCenter(copy) - eye) - model.bounds.radius, LOD_MIN_DISTANCE);
+		float pixelsPerUnit = pixelsPerUnitAtUnitDistance / distance;
+
+		uint32_t lodEnd = allocation.firstLod + allocation.lodCount;
+		while (lod + 1 < lodEnd && lods[lod + 1].error * pixelsPerUnit <= mLodThreshold) lod++;
+		return lod;
+	};
+
+	mDrawLods.resize(mDrawCount);
+	for (uint32_t draw = 0; draw < mDrawCount; draw++) mDrawLods[draw] = selectLod(mVisibleCopies[draw]);
+
+	// Instanced draws cover one level each, so the copies are grouped by level, keeping their order within it
+	if (mInstancing && !mGpuCulling && lods.size() > 1)
+	{
+		std::vector<uint32_t> levelStart(lods.size() + 1, 0);
+		for (uint32_t lod : mDrawLods) levelStart[lod + 1]++;
+		for (size_t i = 0; i < lods.size(); i++) levelStart[i + 1] += levelStart[i];
+
+		std::vector<uint32_t> sortedCopies(mDrawCount);
+		for (uint32_t draw = 0; draw < mDrawCount; draw++) sortedCopies[levelStart[mDrawLods[draw]]++] = mVisibleCopies[draw];
+
+		mVisibleCopies.swap(sortedCopies);
+		std::sort(mDrawLods.begin(), mDrawLods.end());
+	}
+
+	mTrianglesSubmitted = 0;
+	mTrianglesFullDetail = 0;
+	for (uint32_t draw = 0; draw < mDrawCount; draw++)
+	{
+		mTrianglesSubmitted += lods[mDrawLods[draw]].indexCount / 3;
+		mTrianglesFullDetail += lods[mMeshRegistry.mesh(copyModel(mVisibleCopies[draw]).meshId).firstLod].indexCount / 3;
+	}
+
+	// LOD 0 copies of the first model are near enough for meshlets to pay off, everything else is drawn whole
+	mMeshletRuns.clear();
+	mDrawRunStart.clear();
+	if (!mMeshlets.meshlets.empty())
+	{
+		ProfileScope meshletScope(mProfiler, "meshletCull");
+
+		mDrawRunStart.resize(mDrawCount + 1);
+		for (uint32_t draw = 0; draw < mDrawCount; draw++)
+		{
+			mDrawRunStart[draw] = static_cast<uint32_t>(mMeshletRuns.size());
+			if (mDrawLods[draw] != 0) continue;
+
+			// The copy's transform is a rotation then a translation, so its inverse is cheap
+			glm::vec3 position = copyPosition(mVisibleCopies[draw]);
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), position) * rotation;
+			glm::vec3 modelCamera = glm::vec3(glm::transpose(rotation) * glm::vec4(eye - position, 0.0f));
+
+			mMeshletStats.add(Meshlets::cull(mMeshlets, FrustumCulling::transformFrustum(mFrustum, model), modelCamera,
+				mMeshletVisible, mMeshletRuns));
+
+			mTrianglesSubmitted -= lods[0].indexCount / 3;
+			for (size_t run = mDrawRunStart[draw]; run < mMeshletRuns.size(); run++) mTrianglesSubmitted += mMeshletRuns[run].indexCount / 3;
+		}
+		mDrawRunStart[mDrawCount] = static_cast<uint32_t>(mMeshletRuns.size());
+	}
+
+	if (mGpuCulling)
+	{
+		// Every copy is uploaded at its level of detail, the compute pass picks the visible ones
+		GpuCullObject* objects = mGpuCuller.objects(currentFrame);
+		for (uint32_t i = 0; i < mMeshCount; i++)
+		{
+			const MeshLod& lod = lods[mDrawLods[i]];
+
+			objects[i].boundingSphere = glm::vec4(mCullSpheres.x[i], mCullSpheres.y[i], mCullSpheres.z[i], mCullSpheres.radius[i]);
+			objects[i].firstIndex = lod.firstIndex;
+			objects[i].indexCount = lod.indexCount;
+			objects[i].vertexOffset = mMeshRegistry.mesh(copyModel(i).meshId).vertexOffset;
+			objects[i].instanceIndex = i;
+		}
+
+		mUniformBytesUploaded += sizeof(GpuCullObject) * mMeshCount;
+	}
+
+	// Instanced: one uniform block for the camera, transforms go straight into this frame's instance partition
+	mInstanceOffset = static_cast<uint32_t>(mInstanceFrameSize * currentFrame);
+	InstanceData* instances = reinterpret_cast<InstanceData*>(static_cast<uint8_t*>(mInstanceMemory.mapped) + mInstanceOffset);
+
+	mUboOffsets.resize(mInstancing ? 1 : mDrawCount);
+	mDrawDepths.resize(mDrawCount);
+	for (uint32_t draw = 0; draw < mDrawCount; draw++)
+	{
+		uint32_t copy = mVisibleCopies[draw];
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), copyPosition(copy)) * rotation * copyModel(copy).dequantization;
 
-	void* data;
-	vkMapMemory(mDevice, mUniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(mDevice, mUniformBuffersMemory[currentImage]);
+		// View space looks down -z
+		mDrawDepths[draw] = -(ubo.view * glm::vec4(copyCenter(copy), 1.0f)).z;
+
+		if (mInstancing)
+		{
+			instances[draw].model = model;
+		}
+		else
+		{
+			ubo.model = model;
+			mUboOffsets[draw] = pushUniformData(&ubo, sizeof(ubo));
+		}
+	}
+
+	if (mInstancing)
+	{
+		ubo.model = glm::mat4(1.0f);
+		mUboOffsets[0] = pushUniformData(&ubo, sizeof(ubo));
+		mUniformBytesUploaded += sizeof(InstanceData) * mDrawCount;
+	}
 
 	LightBufferObject lbo;
 	lbo.pos = glm::vec3(0.5f);
 	lbo.playerPos = glm::vec3(2.0f);
 
-	vkMapMemory(mDevice, mLightBufferMemory, 0, sizeof(LightBufferObject), 0, &data);
-	memcpy(data, &lbo, sizeof(LightBufferObject));
-	vkUnmapMemory(mDevice, mLightBufferMemory);
+	mLightOffset = pushUniformData(&lbo, sizeof(lbo));
+
+	// Packets carry the offsets pushed above
+	ProfileScope queueScope(mProfiler, "buildRenderQueue");
+	buildRenderQueue(nearPlane, farPlane);
+}
+
+uint32_t Application::pushUniformData(const void* data, VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = (size + mUniformAlignment - 1) & ~(mUniformAlignment - 1);
+
+	if (mUniformFrameCursor + alignedSize > mUniformRingFrameSize)
+	{
+		throw std::runtime_error("Uniform ring frame partition overflow!");
+	}
+
+	VkDeviceSize offset = mUniformFrameBase + mUniformFrameCursor;
+	std::memcpy(mUniformRingMapped + offset, data, static_cast<size_t>(size));
+
+	mUniformFrameCursor += alignedSize;
+	mUniformBytesUploaded += size;
+
+	return static_cast<uint32_t>(offset);
 }
 
-void Application::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory)
+void Application::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, Allocation & imageMemory, VkImageCreateFlags flags)
 {
 	VkImageCreateInfo imageInfo{};
 
@@ -1237,87 +3000,37 @@ void Application::createImage(uint32_t width, uint32_t height, VkFormat format,
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
 	imageInfo.usage = usage;
 	imageInfo.tiling = tiling;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.flags = flags;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	
 	if (vkCreateImage(mDevice, &imageInfo, nullptr, &image) != VK_SUCCESS)
 	{
-		std::runtime_error("Failed to create Image!");
+		throw std::runtime_error("Failed to create Image!");
 	}
 
 	VkMemoryRequirements memRequirments;
 	vkGetImageMemoryRequirements(mDevice, image, &memRequirments);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirments.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirments.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(mDevice, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-	{
-		std::runtime_error("Failed to allocate image memory!");
-	}
-
-	vkBindImageMemory(mDevice, image, imageMemory, 0);
-}
-
-void Application::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
-{
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-	barrier.image = image;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (hasStenCilComponent(format)) barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-	}
-	else barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.baseMipLevel = 0;
-	
-	vkCmdPipelineBarrier(commandBuffer, 0, 0, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	endSingletimeCommands(commandBuffer);
-}
-
-void Application::copyBufferToImage(VkBuffer& buffer, VkImage& image, uint32_t width, uint32_t height)
-{
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkBufferImageCopy region{};
-	region.bufferImageHeight = height;
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageSubresource.mipLevel = 0;
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = { width, height, 1 };
+	uint32_t memoryType = findMemoryType(memRequirments.memoryTypeBits, properties);
+	imageMemory = mAllocator.allocate(memRequirments, memoryType, tiling == VK_IMAGE_TILING_LINEAR);
 
-	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-	endSingletimeCommands(commandBuffer);
+	vkBindImageMemory(mDevice, image, imageMemory.memory, imageMemory.offset);
 }
 
-VkImageView Application::createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags)
+VkImageView Application::createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags, uint32_t mipLevels, VkImageUsageFlags usage)
 {
 	VkImageView imageView;
 	VkImageViewCreateInfo createInfo{};
 
+	// Extended usage images can carry usage their view format does not support, the view narrows it
+	VkImageViewUsageCreateInfoKHR usageInfo{};
+	usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO_KHR;
+	usageInfo.usage = usage;
+	if (usage != 0) createInfo.pNext = &usageInfo;
+
 	createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	createInfo.image = image;
 	createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -1331,7 +3044,7 @@ VkImageView Application::createImageView(VkImage image, VkFormat format, VkImage
 	// Describes image's purpose & which part of image to access
 	createInfo.subresourceRange.aspectMask = flags;
 	createInfo.subresourceRange.layerCount = 1;
-	createInfo.subresourceRange.levelCount = 1;
+	createInfo.subresourceRange.levelCount = mipLevels;
 	createInfo.subresourceRange.baseMipLevel = 0;
 	createInfo.subresourceRange.baseArrayLayer = 0;
 
@@ -1373,16 +3086,26 @@ bool Application::CheckValidationLayerSupport()
 
 std::vector<const char*> Application::GetRequiredExtensions()
 {
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions;
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	// GLFW is never initialized when headless, and nothing is presented
+	if (!mHeadless)
+	{
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	if (enableValidationLayer)
 	{
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 	}
+
+	// Optional: the device features query that finds descriptor indexing on a 1.0 instance
+	mPhysicalDeviceProperties2 = mBindlessMaterials && HasInstanceExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	if (mPhysicalDeviceProperties2) extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	
 	return extensions;
 }
@@ -1427,8 +3150,8 @@ bool Application::isDeviceSuitable(VkPhysicalDevice device)  // Remain to return
 
 	bool extensionSupported = CheckDeviceExtensionSupport(device);
 
-	bool swapChainAdequate = false;
-	if (extensionSupported)
+	bool swapChainAdequate = mHeadless;
+	if (extensionSupported && !mHeadless)
 	{
 		// Device should be capable of at least format and present mode
 		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device);
@@ -1458,8 +3181,10 @@ QueueFamilyIndices Application::FindQueueFamilies(VkPhysicalDevice device)
 			indices.GraphicsFamily = i;
 		}
 
+		// Headless never presents, the graphics queue stands in
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, mSurface, &presentSupport);
+		if (mHeadless) presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		else vkGetPhysicalDeviceSurfaceSupportKHR(device, i, mSurface, &presentSupport);
 
 		if (presentSupport)
 		{
@@ -1471,10 +3196,52 @@ QueueFamilyIndices Application::FindQueueFamilies(VkPhysicalDevice device)
 		i++;
 	}
 
+	// Prefer a transfer-only family (a DMA engine), then any other non-graphics family that can copy
+	indices.TransferFamily = indices.GraphicsFamily;
+	VkQueueFlags bestExtraFlags = ~0u;
+
+	for (uint32_t family = 0; family < queueFamilyCount; family++)
+	{
+		VkQueueFlags flags = queueFamilies[family].queueFlags;
+		if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) continue;
+
+		VkQueueFlags extraFlags = flags & VK_QUEUE_COMPUTE_BIT;
+
+		if (extraFlags < bestExtraFlags)
+		{
+			indices.TransferFamily = family;
+			bestExtraFlags = extraFlags;
+		}
+	}
+
 	return indices;
 }
 
 bool Application::CheckDeviceExtensionSupport(VkPhysicalDevice device)
+{
+	for (const auto* extensionName : deviceExtensions)
+	{
+		if (!HasDeviceExtension(device, extensionName)) return false;
+	}
+	return true;
+}
+
+bool Application::HasInstanceExtension(const char* extensionName)
+{
+	uint32_t extensionCount;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extensionProperty : availableExtensions)
+	{
+		if (std::strcmp(extensionName, extensionProperty.extensionName) == 0) return true;
+	}
+	return false;
+}
+
+bool Application::HasDeviceExtension(VkPhysicalDevice device, const char* extensionName)
 {
 	uint32_t extensionCount;
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -1482,22 +3249,11 @@ bool Application::CheckDeviceExtensionSupport(VkPhysicalDevice device)
 	std::vector<VkExtensionProperties> avaiableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, avaiableExtensions.data());
 
-	for (const auto* extensionName : deviceExtensions)
+	for (const auto& extenstionProperty : avaiableExtensions)
 	{
-		bool extensionFound = false;
-
-		for (const auto& extenstionProperty : avaiableExtensions)
-		{
-			if (std::strcmp(extensionName, extenstionProperty.extensionName))
-			{
-				extensionFound = true;
-				break;
-			}
-		}
-
-		if (!extensionFound) return false;
+		if (std::strcmp(extensionName, extenstionProperty.extensionName) == 0) return true;
 	}
-	return true;
+	return false;
 }
 
 #pragma endregion
@@ -17,9 +17,26 @@
 #include <set>
 #include <cstdint>
 #include <algorithm>
+#include <memory>
 
 #include "Shader.h"
 #include "ApplicationData.h"
+#include "MemoryAllocator.h"
+#include "MeshCache.h"
+#include "Uploader.h"
+#include "MipGenerator.h"
+#include "Ktx2.h"
+#include "PipelineCache.h"
+#include "DeletionQueue.h"
+#include "Profiler.h"
+#include "ParallelRecorder.h"
+#include "FrustumCulling.h"
+#include "GpuCuller.h"
+#include "Meshlets.h"
+#include "VertexFormat.h"
+#include "Materials.h"
+#include "RenderQueue.h"
+#include "MeshRegistry.h"
 
 #define IMPOSSIBLE 121312
 
@@ -27,10 +44,11 @@ struct QueueFamilyIndices
 {
 	uint32_t GraphicsFamily;
 	uint32_t PresentFamily;
+	uint32_t TransferFamily; // Same as GraphicsFamily when there is no dedicated transfer family
 
 	bool isComplete() { return (GraphicsFamily == 0 && PresentFamily == 0); }
 
-	QueueFamilyIndices() : GraphicsFamily(IMPOSSIBLE), PresentFamily(IMPOSSIBLE) {}
+	QueueFamilyIndices() : GraphicsFamily(IMPOSSIBLE), PresentFamily(IMPOSSIBLE), TransferFamily(IMPOSSIBLE) {}
 };
 
 struct SwapChainSupportDetails
@@ -40,6 +58,54 @@ struct SwapChainSupportDetails
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// CPU time samples, e.g. fence waits or swap chain recreations, accumulated between reports
+struct TimingStats
+{
+	double totalMs = 0.0;
+	double maxMs = 0.0;
+	double lastMs = 0.0;
+	uint32_t samples = 0;
+
+	void record(double ms)
+	{
+		lastMs = ms;
+		totalMs += ms;
+		maxMs = std::max(maxMs, ms);
+		samples++;
+	}
+
+	double averageMs() const { return samples ? totalMs / samples : 0.0; }
+	void reset() { totalMs = 0.0; maxMs = 0.0; samples = 0; }
+};
+
+// A sampled image with its view
+struct Texture
+{
+	VkImage image = VK_NULL_HANDLE;
+	Allocation memory;
+	VkImageView view = VK_NULL_HANDLE;
+	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	uint32_t mipLevels = 1;
+	VkImageUsageFlags viewUsage = 0; // Restricts the view's usage when non-zero
+};
+
+// One OBJ: its mesh, mapped from the mesh cache or parsed into the vectors, and its place in the shared buffers
+struct Model
+{
+	std::string path;
+	std::vector<std::string> materialNames; // Its own library's, in Vertex::material order
+	uint32_t materialBase = 0;              // Its material 0 in the merged library
+	MeshCache cache;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshLod> lods;
+	MeshView mesh{};
+	MeshBounds bounds;
+	// Identity for float vertices; for compact ones maps unorm positions back to model space
+	glm::mat4 dequantization = glm::mat4(1.0f);
+	uint32_t meshId = 0;
+};
+
 class Application
 {
 public:
@@ -47,6 +113,64 @@ public:
 	~Application();
 	void run();
 
+	// Must be called before run()
+	void setFramesInFlight(uint32_t count) { mFramesInFlight = std::max(1u, count); }
+	void setTextureMips(bool enabled) { mTextureMipsEnabled = enabled; }
+	// Moves the camera away from the model, e.g. to compare texture bandwidth with and without mips
+	void setViewDistanceScale(float scale) { mViewDistanceScale = std::max(0.1f, scale); }
+	// Resizes the window resizeCount times instead of running the main loop and reports the hitches
+	void setResizeBenchmark(uint32_t resizeCount) { mResizeBenchmarkCount = resizeCount; }
+	// Records CPU scopes and GPU timestamps/pipeline statistics, written as a Chrome trace on exit
+	void setProfileOutput(const std::string& tracePath) { mProfiler.enable(tracePath); }
+	// Splits the draws across threadCount workers recording secondary command buffers, 0 records inline
+	void setRecordThreads(uint32_t threadCount) { mRecordThreadCount = threadCount; }
+	// Times command recording from 1 to all hardware threads instead of running the main loop
+	void setRecordBenchmark(bool enabled) { mRecordBenchmark = enabled; }
+	// Draws every mesh copy with one instanced draw, transforms read from a storage buffer
+	void setInstancing(bool enabled) { mInstancing = enabled; }
+	// Window or offscreen target size
+	void setResolution(uint32_t width, uint32_t height) { mWidth = std::max(1u, width); mHeight = std::max(1u, height); }
+	// Loads another OBJ into the shared vertex and index buffers, mesh copies cycle through the models in order.
+	// Without any, MODEL_PATH is drawn.
+	void addModel(const std::string& path) { mModelPaths.push_back(path); }
+	// Draws the model meshCount times on a square grid, one draw and one uniform block each
+	void setMeshCount(uint32_t meshCount) { mMeshCount = std::max(1u, meshCount); }
+	// Tests every mesh copy's bounding sphere against the view frustum and only draws the visible ones
+	void setFrustumCulling(bool enabled) { mFrustumCulling = enabled; }
+	// Picks each copy's level of detail so its simplification error stays below this many pixels, 0 always draws LOD 0
+	void setLodThreshold(float pixels) { mLodThreshold = std::max(0.0f, pixels); }
+	// Culls in a compute pass that writes indirect draws, recording stays constant in the mesh count. Implies instancing.
+	void setGpuCulling(bool enabled) { mGpuCulling = enabled; if (enabled) mInstancing = true; }
+	// Splits LOD 0 into meshlets and skips those outside the frustum or facing away from the camera. Not used with GPU culling.
+	void setMeshletCulling(bool enabled) { mMeshletCulling = enabled; }
+	// Merges render queue packets that share all state into one multi-draw indirect call, when the device allows
+	void setMultiDrawIndirect(bool enabled) { mQueueMultiDraw = enabled; }
+	// Draws everything position-only into depth first, so shading runs once per pixel
+	void setDepthPrepass(bool enabled) { mDepthPrepass = enabled; }
+	// Samples every material texture through one partially bound array (VK_EXT_descriptor_indexing), so the frame binds
+	// a single descriptor set. Off, or without device support, draws are split per material with a set per texture.
+	void setBindlessMaterials(bool enabled) { mBindlessMaterials = enabled; }
+	// Replaces every texture with a generated size x size one, 0 loads TEXTURE_PATH and the material textures
+	void setTextureSize(uint32_t size) { mTextureSize = size; }
+	// Headless run of warmupFrames + measuredFrames along a scripted camera path. Startup and the measured frames'
+	// CPU and GPU times are written to reportPath as JSON, or to stdout when it is empty.
+	void setBenchmark(uint32_t warmupFrames, uint32_t measuredFrames, const std::string& reportPath)
+	{
+		setHeadless(warmupFrames + std::max(1u, measuredFrames));
+		mBenchmark = true;
+		mBenchmarkWarmupFrames = warmupFrames;
+		mBenchmarkReportPath = reportPath;
+		if (!mProfiler.isEnabled()) mProfiler.enable("");
+	}
+	// Renders frameCount frames into offscreen images without a window, surface or swap chain.
+	// The last frame is written to readbackPath as a binary PPM when the path is not empty.
+	void setHeadless(uint32_t frameCount, const std::string& readbackPath = "")
+	{
+		mHeadless = true;
+		mHeadlessFrameCount = std::max(1u, frameCount);
+		mReadbackPath = readbackPath;
+	}
+
 	inline static Application* Get() { return sInstance; }
 	inline static Application* Create()
 	{
@@ -63,6 +187,11 @@ public:
 private:
 	void initVulkan();
 	void mainLoop();
+	void runResizeBenchmark();
+	void runHeadless();
+	void runRecordBenchmark();
+	void readBackImage(VkImage image, const std::string& path);
+	void writeBenchmarkReport(std::ostream& out, const std::vector<double>& cpuFrameTimes, const std::vector<double>& gpuFrameTimes);
 
 	void cleanUp();
 	void cleanUpSwapChain();
@@ -75,7 +204,12 @@ private:
 	void createSurface();
 	void pickPhysicalDevice();
 	void createLogicalDevice();
-	void createSwapChain();
+	void createAllocator();
+	void createUploader();
+	void createPipelineCache();
+	void createProfiler();
+	void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+	void createOffscreenTargets();
 	void createImageViews();
 	void createRenderPass();
 	void createDescriptorSetLayout();
@@ -83,30 +217,53 @@ private:
 	void createDepthResources();
 	void createFramebuffers();
 	void createCommandPool();
+	void loadMaterials();
 	void createTextureImage();
+	bool createCookedTextureImage(const std::string& sourcePath, Texture& texture);
+	// An empty path generates the mTextureSize checkerboard
+	void createSourceTextureImage(const std::string& path, Texture& texture);
+	bool isTextureFormatSampleable(VkFormat format);
 	void createTextureImageView();
 	void createTextureSampler();
-	void loadModel();
+	void createMaterialBuffer();
+	void loadModels();
+	void loadModel(Model& model);
+	void loadModelFromObj(Model& model, const MappedFile& source);
 	void createVertexBuffers();
 	void createIndexBuffers();
 	void createUniformBuffers();
 	void createDescriptorPool();
 	void createDescriptorSets();
 	void createCommandBuffers();
-	void createSemaphores();
+	void createSyncObjects();
+	void createRenderFinishedSemaphores();
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	// Records entries [first, end) of the frame's render queue, or GPU culled passes [first, end), with all state they need bound
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t end);
+	// Fills and sorts the render queue from the frame's draw list, after its uniform data was pushed
+	void buildRenderQueue(float nearPlane, float farPlane);
+	// Copies the sorted queue's draw commands into the frame's indirect buffer, growing it when needed
+	void writeIndirectCommands(uint32_t frame);
+	// Queues indices [firstIndex, firstIndex + indexCount) of a level for a pass, 0 being the depth prepass. Without
+	// bindless materials shading packets are split per material, each with its texture's set.
+	void queueIndexRange(uint32_t pass, uint32_t lod, uint32_t firstIndex, uint32_t indexCount, uint32_t instanceCount,
+		uint32_t firstInstance, uint32_t uboOffset, uint32_t depthBucket);
+	void createParallelRecorder(uint32_t threadCount);
+	void createGpuCuller();
+	// Compares the last frame's GPU draw list with the CPU culling of the same spheres and frustum, throwing on
+	// disagreement other than spheres within rounding of a plane
+	void validateGpuCulling();
 
 	void recreateSwapChain();
+	void retireSwapChainResources();
+	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-		VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-	VkCommandBuffer beginSingleTimeCommands();
-	void endSingletimeCommands(VkCommandBuffer commandBuffer);
-	void updateUniformBuffer(uint32_t currentImage);
-	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-		VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-	void copyBufferToImage(VkBuffer& buffer, VkImage& image, uint32_t width, uint32_t height);
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags);
+		VkBuffer& buffer, Allocation& bufferMemory);
+	void updateUniformBuffer(uint32_t currentFrame);
+	uint32_t pushUniformData(const void* data, VkDeviceSize size);
+	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling,
+		VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory, VkImageCreateFlags flags = 0);
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags, uint32_t mipLevels = 1, VkImageUsageFlags usage = 0);
 	
 #pragma region DebugMessenger
 	bool CheckValidationLayerSupport();
@@ -135,6 +292,8 @@ private:
 	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
 #pragma endregion
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+	bool HasDeviceExtension(VkPhysicalDevice device, const char* extensionName);
+	bool HasInstanceExtension(const char* extensionName);
 #pragma region Swap chain
 	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -165,46 +324,158 @@ private:
 	VkDebugUtilsMessengerEXT mDebugMessenger;
 	VkPhysicalDevice mPhysicalDevice;
 	VkDevice mDevice;
+	MemoryAllocator mAllocator;
+	Uploader mUploader;
+	MipGenerator mMipGenerator;
+	bool mMaintenance2; // VK_KHR_maintenance2, lets sRGB textures carry storage usage for compute mips
+	PipelineCache mPipelineCache;
+	bool mPipelineCreationFeedback;
+	Profiler mProfiler;
 	VkSurfaceKHR mSurface;
 	VkSwapchainKHR mSwapChain;
+	// Swap chain images, or one offscreen target per frame in flight when headless
 	std::vector<VkImage> mSwapChainImages;
+	std::vector<Allocation> mOffscreenImageMemory;
 	std::vector<VkImageView> mImageViews;
 	std::vector<VkFramebuffer> mSwapChainFramebuffers;
 	VkRenderPass mRenderPass;
 	VkPipeline mGraphicsPipeline;
+	VkPipeline mInstancedPipeline;
+	// Depth prepass: position stream only, then shading with depth writes off
+	bool mDepthPrepass;
+	VkPipeline mDepthPipeline;
+	VkPipeline mDepthInstancedPipeline;
 	VkShaderModule mVertexShaderModule;
 	VkShaderModule mFragmentShaderModule;
 	VkCommandPool mCommandPool;
-	VkImage mTextureImage;
-	VkDeviceMemory mTextureImageMemory;
-	VkImageView mTextureImageView;
+	// One per distinct material texture, or the generated one
+	std::vector<Texture> mTextures;
+	bool mTextureMipsEnabled;
+	float mViewDistanceScale;
 	VkSampler mTextureSampler;
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	// Materials: the storage buffer is indexed by Vertex::material
+	MaterialLibrary mMaterialLibrary;
+	VkBuffer mMaterialBuffer;
+	Allocation mMaterialMemory;
+	bool mBindlessMaterials;
+	bool mPhysicalDeviceProperties2; // VK_KHR_get_physical_device_properties2, needed to query descriptor indexing
+	uint32_t mBindlessTextureCapacity;
+	// Per-texture sets only: level i draws mMaterialRanges[mLodRangeStart[i], mLodRangeStart[i + 1])
+	std::vector<MaterialRange> mMaterialRanges;
+	std::vector<uint32_t> mLodRangeStart;
+	// Every model's mesh sub-allocated from one vertex buffer and one index buffer
+	std::vector<std::string> mModelPaths;
+	std::vector<std::unique_ptr<Model>> mModels;
+	std::vector<glm::vec3> mModelCenters; // Bounding sphere centers after this frame's rotation
+	MeshRegistry mMeshRegistry;
+	// Position streams of every mesh at 0, their attribute streams at mAttributeStreamOffset
 	VkBuffer mVertexBuffer;
-	VkDeviceMemory mVertexBufferMemory;
+	VkDeviceSize mAttributeStreamOffset;
+	Allocation mVertexBufferMemory;
 	VkBuffer mIndexBuffer;
-	VkDeviceMemory mIndexBufferMemory;
+	Allocation mIndexBufferMemory;
 	VkImage mDepthImage;
-	VkDeviceMemory mDepthImageMemory;
+	Allocation mDepthImageMemory;
 	VkImageView mDepthImageView;
-	std::vector<VkBuffer> mUniformBuffers;
-	std::vector<VkDeviceMemory> mUniformBuffersMemory;
-	VkBuffer mLightBuffer;
-	VkDeviceMemory mLightBufferMemory;
+	// Persistently mapped uniform ring, one partition per frame in flight
+	VkBuffer mUniformRingBuffer;
+	Allocation mUniformRingMemory;
+	uint8_t* mUniformRingMapped;
+	VkDeviceSize mUniformAlignment;
+	VkDeviceSize mUniformFrameBase;
+	VkDeviceSize mUniformFrameCursor;
+	uint64_t mUniformBytesUploaded;
+	VkDeviceSize mUniformRingFrameSize;
+	// One per mesh copy, or a single one shared by all instances
+	std::vector<uint32_t> mUboOffsets;
+	uint32_t mLightOffset;
+	// Persistently mapped instance transforms, one partition per frame in flight
+	bool mInstancing;
+	VkBuffer mInstanceBuffer;
+	Allocation mInstanceMemory;
+	VkDeviceSize mInstanceFrameSize;
+	uint32_t mInstanceOffset;
+	// Frustum culling: world space spheres of the mesh copies and the copies that survived, in draw order
+	bool mFrustumCulling;
+	SphereBounds mCullSpheres;
+	std::vector<uint32_t> mVisibleCopies;
+	std::unique_ptr<ThreadPool> mCullPool;
+	Frustum mFrustum;
+	uint32_t mDrawCount;
+	// Level of detail of every draw; instanced draws are grouped by level
+	float mLodThreshold;
+	std::vector<uint32_t> mDrawLods;
+	uint64_t mTrianglesSubmitted;
+	uint64_t mTrianglesFullDetail; // What the drawn copies would submit at LOD 0
+	// Meshlet culling of LOD 0 draws: draw i draws mMeshletRuns[mDrawRunStart[i], mDrawRunStart[i + 1])
+	bool mMeshletCulling;
+	MeshletSet mMeshlets;
+	std::vector<uint32_t> mMeshletVisible;
+	std::vector<IndexRange> mMeshletRuns;
+	std::vector<uint32_t> mDrawRunStart;
+	MeshletCullStats mMeshletStats; // Since the last stats line
+	// Draws of the frame as sort-keyed packets, built after culling and level selection
+	RenderQueue mRenderQueue;
+	std::vector<float> mDrawDepths; // View depth of every draw's bounding sphere center
+	RenderQueueStats mRenderQueueStats; // Since the last stats line
+	RenderQueueStats mRenderQueueTotals; // Benchmark frames after warm-up
+	// Sorted draw commands, a host visible buffer per frame in flight; off without multiDrawIndirect support
+	bool mQueueMultiDraw;
+	std::vector<VkBuffer> mIndirectBuffers;
+	std::vector<Allocation> mIndirectMemory;
+	std::vector<uint32_t> mIndirectCapacity; // In commands
+	// GPU-driven culling
+	bool mGpuCulling;
+	bool mDrawIndirectCount;
+	bool mMultiDrawIndirect;
+	GpuCuller mGpuCuller;
 	VkDescriptorPool mDescriptorPool;
+	// Bindless: a single set; otherwise one per texture, set i samples mTextures[i]
 	std::vector<VkDescriptorSet> mDescriptorSets;
 	std::vector<VkCommandBuffer> mCommandBuffers;
+	// Secondary command buffer recording
+	uint32_t mRecordThreadCount;
+	std::unique_ptr<ThreadPool> mRecordPool;
+	ParallelRecorder mParallelRecorder;
+	// Lets a pipeline statistics query stay active across vkCmdExecuteCommands
+	bool mInheritedQueries;
+	bool mRecordBenchmark;
 	VkDescriptorSetLayout mDescriptorSetLayout;
 	VkPipelineLayout mPipelineLayout;
 	VkFormat mSwapChainImageFormat;
 	VkExtent2D mSwapChainImageExtent;
 	VkQueue mGraphicsQueue;
 	VkQueue mPresentQueue;
-	const uint32_t mWidth, mHeight;
+	VkQueue mTransferQueue;
+	uint32_t mWidth, mHeight;
 	bool enableValidationLayer;
 	std::vector<const char*> validationLayers;
 	std::vector<const char*> deviceExtensions;
-	VkSemaphore imageAvailableSemaphore;
-	VkSemaphore renderFinishedSemaphore;
+	// Frames in flight
+	uint32_t mFramesInFlight;
+	uint32_t mCurrentFrame;
+	std::vector<VkSemaphore> mImageAvailableSemaphores;
+	std::vector<VkSemaphore> mRenderFinishedSemaphores; // One per swap chain image, indexed by image index
+	std::vector<VkFence> mInFlightFences;
+	TimingStats mFenceWaitStats;
+	// Submission serials: mFrameSerials[i] is the last one submitted with frame i's fence
+	uint64_t mSubmitSerial;
+	std::vector<uint64_t> mFrameSerials;
+	DeletionQueue mDeletionQueue;
+	// Resize
+	bool mFramebufferResized;
+	uint32_t mResizeBenchmarkCount;
+	TimingStats mRecreateStats;
+	// Headless
+	bool mHeadless;
+	uint32_t mHeadlessFrameCount;
+	std::string mReadbackPath;
+	uint64_t mFrameNumber;
+	// Benchmark
+	bool mBenchmark;
+	uint32_t mBenchmarkWarmupFrames;
+	std::string mBenchmarkReportPath;
+	uint32_t mMeshCount;
+	uint32_t mTextureSize;
+	double mStartupMs;
 };
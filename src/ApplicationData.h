@@ -2,6 +2,9 @@
 
 #include <vector>
 #include <array>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
 
 #include <glm/glm.hpp>
 
@@ -9,47 +12,35 @@
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 
+// Vertex as loaded and processed on the CPU; the vertex buffer format is GpuVertexFormat in VertexFormat.h
 struct Vertex
 {
 	glm::vec3 pos;
 	glm::vec3 normal;
 	glm::vec2 texCoord;
+	uint32_t material; // Index into the material table, from the face's usemtl
+};
 
-	static VkVertexInputBindingDescription getBindingDescription()
-	{
-		VkVertexInputBindingDescription bindingDescription{};
-
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		
-		return bindingDescription;
-	}
-
-	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions()
-	{
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescription{};
-
-		// Position Attribute
-		attributeDescription[0].binding = 0;
-		attributeDescription[0].location = 0;
-		attributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescription[0].offset = offsetof(Vertex, pos);
-
-		// Normal Attribute
-		attributeDescription[1].binding = 0;
-		attributeDescription[1].location = 1;
-		attributeDescription[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescription[1].offset = offsetof(Vertex, normal);
+// One level of detail: a range of the shared index buffer and how far it strays from LOD 0
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error; // Model space distance
+	uint32_t padding;
+};
 
-		// TexCoord Attribute
-		attributeDescription[2].binding = 0;
-		attributeDescription[2].location = 2;
-		attributeDescription[2].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescription[2].offset = offsetof(Vertex, texCoord);
+static_assert(sizeof(MeshLod) == 16, "MeshLod is stored in the mesh cache and must stay 16 bytes");
 
-		return attributeDescription;
-	}
+// Non-owning view of mesh data, either in CPU vectors or a mapped mesh cache
+struct MeshView
+{
+	const Vertex* vertices;
+	size_t vertexCount;
+	const uint32_t* indices;
+	size_t indexCount; // Every level of detail
+	const MeshLod* lods;
+	size_t lodCount;
 };
 
 struct UniformBufferObject {
@@ -58,6 +49,23 @@ struct UniformBufferObject {
 	glm::mat4 proj;
 };
 
+// One per instance in the instance storage buffer, std430 layout of InstanceData in Instanced.vert.
+// Materials come from the vertices, so an instance is only its transform.
+struct InstanceData {
+	glm::mat4 model;
+};
+
+static_assert(sizeof(InstanceData) == 64, "InstanceData must match its std430 layout");
+
+// One per material in the material storage buffer, std430 layout of Material in Shader.frag
+struct GpuMaterial {
+	glm::vec4 baseColor;
+	uint32_t textureIndex; // Materials::NO_TEXTURE when untextured
+	uint32_t padding[3];
+};
+
+static_assert(sizeof(GpuMaterial) == 32, "GpuMaterial must match its std430 layout");
+
 struct LightBufferObject {
 	glm::vec3 pos;
 	glm::vec3 playerPos;
@@ -0,0 +1,25 @@
+#include "DeletionQueue.h"
+
+void DeletionQueue::retire(uint64_t serial, std::function<void()> destroy)
+{
+	mEntries.emplace_back(serial, std::move(destroy));
+}
+
+void DeletionQueue::collect(uint64_t completedSerial)
+{
+	// Serials only grow, so the completed entries are all at the front
+	while (!mEntries.empty() && mEntries.front().first <= completedSerial)
+	{
+		mEntries.front().second();
+		mEntries.pop_front();
+	}
+}
+
+void DeletionQueue::flush()
+{
+	while (!mEntries.empty())
+	{
+		mEntries.front().second();
+		mEntries.pop_front();
+	}
+}
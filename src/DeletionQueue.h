@@ -0,0 +1,30 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+// Defers destruction of GPU objects until the work that may use them has finished.
+// Entries are tagged with the serial of the last submission when they were retired
+// and run once that submission is known to be complete.
+class DeletionQueue
+{
+public:
+	DeletionQueue() = default;
+
+	DeletionQueue(const DeletionQueue&) = delete;
+	DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+	void retire(uint64_t serial, std::function<void()> destroy);
+
+	// Runs every entry retired at or before completedSerial, oldest first
+	void collect(uint64_t completedSerial);
+
+	// Runs everything, only valid once the device is idle
+	void flush();
+
+	size_t pendingCount() const { return mEntries.size(); }
+private:
+	std::deque<std::pair<uint64_t, std::function<void()>>> mEntries;
+};
@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth prepass: reads the position stream (binding 0) and nothing else.
+// gl_Position is invariant here and in the shading vertex shaders, so both passes produce the same depth.
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+#ifdef INSTANCED
+struct InstanceData {
+    mat4 model;
+};
+
+layout(std430, binding = 3) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+#endif
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main() {
+#ifdef INSTANCED
+    mat4 model = instances[gl_InstanceIndex].model;
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition, 1.0);
+#else
+    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+#endif
+}
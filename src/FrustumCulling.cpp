@@ -0,0 +1,399 @@
+#include "FrustumCulling.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRUSTUM_CULLING_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC emits AVX2 intrinsics without flags, GCC and Clang need the function to opt in
+#if defined(FRUSTUM_CULLING_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+const uint32_t CULL_CHUNKS_PER_THREAD = 4;
+const uint32_t CULL_BENCHMARK_ITERATIONS = 20;
+
+namespace
+{
+	inline uint32_t lowestBit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+	}
+
+	// Lanes at or past end belong to the next range or the padding
+	inline uint32_t laneMask(uint32_t base, uint32_t end)
+	{
+		uint32_t lanes = std::min(end - base, FrustumCulling::BATCH_SIZE);
+		return (1u << lanes) - 1;
+	}
+
+	inline uint32_t appendVisible(uint32_t mask, uint32_t base, uint32_t* visible)
+	{
+		uint32_t written = 0;
+		while (mask)
+		{
+			visible[written++] = base + lowestBit(mask);
+			mask &= mask - 1;
+		}
+		return written;
+	}
+
+	uint32_t cullScalar(const Frustum& frustum, const SphereBounds& spheres, uint32_t begin, uint32_t end, uint32_t* visible)
+	{
+		uint32_t written = 0;
+
+		for (uint32_t i = begin; i < end; i++)
+		{
+			bool inside = true;
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				// Same operations in the same order as the SIMD kernels, without FMA, so every kernel rounds identically
+				float distance = plane.x * spheres.x[i] + plane.w;
+				distance = plane.y * spheres.y[i] + distance;
+				distance = plane.z * spheres.z[i] + distance;
+				inside = inside && distance + spheres.radius[i] >= 0.0f;
+			}
+
+			if (inside) visible[written++] = i;
+		}
+
+		return written;
+	}
+
+#ifdef FRUSTUM_CULLING_X86
+	uint32_t cullSse(const Frustum& frustum, const SphereBounds& spheres, uint32_t begin, uint32_t end, uint32_t* visible)
+	{
+		__m128 planes[6][4];
+		for (int p = 0; p < 6; p++)
+		{
+			for (int c = 0; c < 4; c++) planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		uint32_t written = 0;
+
+		for (uint32_t base = begin; base < end; base += 4)
+		{
+			__m128 x = _mm_loadu_ps(&spheres.x[base]);
+			__m128 y = _mm_loadu_ps(&spheres.y[base]);
+			__m128 z = _mm_loadu_ps(&spheres.z[base]);
+			__m128 r = _mm_loadu_ps(&spheres.radius[base]);
+
+			// Distance plus radius must not be negative for any plane
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_mul_ps(planes[p][0], x), planes[p][3]);
+				distance = _mm_add_ps(_mm_mul_ps(planes[p][1], y), distance);
+				distance = _mm_add_ps(_mm_mul_ps(planes[p][2], z), distance);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+			}
+
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside)) & laneMask(base, end);
+			written += appendVisible(mask, base, visible + written);
+		}
+
+		return written;
+	}
+
+	AVX2_TARGET uint32_t cullAvx2(const Frustum& frustum, const SphereBounds& spheres, uint32_t begin, uint32_t end, uint32_t* visible)
+	{
+		__m256 planes[6][4];
+		for (int p = 0; p < 6; p++)
+		{
+			for (int c = 0; c < 4; c++) planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+		uint32_t written = 0;
+
+		for (uint32_t base = begin; base < end; base += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&spheres.x[base]);
+			__m256 y = _mm256_loadu_ps(&spheres.y[base]);
+			__m256 z = _mm256_loadu_ps(&spheres.z[base]);
+			__m256 r = _mm256_loadu_ps(&spheres.radius[base]);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				// Multiply then add rather than FMA, which would round differently from the other kernels
+				__m256 distance = _mm256_add_ps(_mm256_mul_ps(planes[p][0], x), planes[p][3]);
+				distance = _mm256_add_ps(_mm256_mul_ps(planes[p][1], y), distance);
+				distance = _mm256_add_ps(_mm256_mul_ps(planes[p][2], z), distance);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, r), zero, _CMP_GE_OQ));
+			}
+
+			uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside)) & laneMask(base, end);
+			written += appendVisible(mask, base, visible + written);
+		}
+
+		return written;
+	}
+
+	bool cpuHasAvx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+
+		__cpuidex(info, 7, 0);
+		return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+void SphereBounds::resize(uint32_t sphereCount)
+{
+	count = sphereCount;
+
+	// Padding lanes are masked off, they only have to be readable
+	size_t padded = (static_cast<size_t>(sphereCount) + FrustumCulling::BATCH_SIZE - 1) / FrustumCulling::BATCH_SIZE * FrustumCulling::BATCH_SIZE;
+	x.assign(padded, 0.0f);
+	y.assign(padded, 0.0f);
+	z.assign(padded, 0.0f);
+	radius.assign(padded, 0.0f);
+}
+
+namespace FrustumCulling
+{
+	MeshBounds computeBounds(const Vertex* vertices, size_t vertexCount)
+	{
+		MeshBounds bounds;
+		if (vertexCount == 0) return bounds;
+
+		bounds.min = vertices[0].pos;
+		bounds.max = vertices[0].pos;
+
+		for (size_t i = 1; i < vertexCount; i++)
+		{
+			bounds.min = glm::min(bounds.min, vertices[i].pos);
+			bounds.max = glm::max(bounds.max, vertices[i].pos);
+		}
+
+		// Not the tightest sphere, but one pass and never smaller than the box
+		bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+		float radiusSquared = 0.0f;
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			glm::vec3 offset = vertices[i].pos - bounds.center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+
+		bounds.radius = std::sqrt(radiusSquared);
+		return bounds;
+	}
+
+	Frustum extractFrustum(const glm::mat4& viewProjection)
+	{
+		// glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+		auto row = [&viewProjection](int i)
+		{
+			return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		};
+
+		glm::vec4 row0 = row(0), row1 = row(1), row2 = row(2), row3 = row(3);
+
+		Frustum frustum;
+		frustum.planes[0] = row3 + row0; // Left
+		frustum.planes[1] = row3 - row0; // Right
+		frustum.planes[2] = row3 + row1; // Bottom
+		frustum.planes[3] = row3 - row1; // Top
+		frustum.planes[4] = row2;        // Near, z >= 0
+		frustum.planes[5] = row3 - row2; // Far, z <= w
+
+		// Unit normals, so the plane equation gives a distance comparable with a radius
+		for (glm::vec4& plane : frustum.planes)
+		{
+			float length = glm::length(glm::vec3(plane.x, plane.y, plane.z));
+			if (length > 0.0f) plane /= length;
+		}
+
+		return frustum;
+	}
+
+	Frustum transformFrustum(const Frustum& frustum, const glm::mat4& model)
+	{
+		// dot(plane, model * p) == dot(transpose(model) * plane, p)
+		glm::mat4 transposed = glm::transpose(model);
+
+		Frustum result;
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec4 plane = transposed * frustum.planes[i];
+			float length = glm::length(glm::vec3(plane.x, plane.y, plane.z));
+			result.planes[i] = length > 0.0f ? plane / length : plane;
+		}
+
+		return result;
+	}
+
+	Kernel bestKernel()
+	{
+#ifdef FRUSTUM_CULLING_X86
+		static const bool avx2 = cpuHasAvx2();
+		return avx2 ? Kernel::Avx2 : Kernel::Sse;
+#else
+		return Kernel::Scalar;
+#endif
+	}
+
+	const char* kernelName(Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case Kernel::Sse: return "SSE";
+		case Kernel::Avx2: return "AVX2";
+		default: return "scalar";
+		}
+	}
+
+	uint32_t cull(const Frustum& frustum, const SphereBounds& spheres, uint32_t begin, uint32_t end, Kernel kernel, uint32_t* visible)
+	{
+		end = std::min(end, spheres.count);
+		if (begin >= end) return 0;
+
+#ifdef FRUSTUM_CULLING_X86
+		if (kernel == Kernel::Avx2) return cullAvx2(frustum, spheres, begin, end, visible);
+		if (kernel == Kernel::Sse) return cullSse(frustum, spheres, begin, end, visible);
+#endif
+		return cullScalar(frustum, spheres, begin, end, visible);
+	}
+
+	void cull(const Frustum& frustum, const SphereBounds& spheres, ThreadPool* pool, std::vector<uint32_t>& visible)
+	{
+		Kernel kernel = bestKernel();
+		visible.resize(spheres.count);
+
+		if (pool == nullptr || pool->getThreadCount() < 2 || spheres.count < PARALLEL_THRESHOLD)
+		{
+			visible.resize(cull(frustum, spheres, 0, spheres.count, kernel, visible.data()));
+			return;
+		}
+
+		// Each chunk writes its indices at its own start, then the results are packed down in order
+		uint32_t chunkCount = pool->getThreadCount() * CULL_CHUNKS_PER_THREAD;
+		uint32_t chunkSize = (spheres.count + chunkCount - 1) / chunkCount;
+		chunkSize = (chunkSize + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+		chunkCount = (spheres.count + chunkSize - 1) / chunkSize;
+
+		std::vector<uint32_t> chunkVisible(chunkCount);
+
+		pool->parallelFor(chunkCount, [&](uint32_t chunk)
+		{
+			uint32_t begin = chunk * chunkSize;
+			chunkVisible[chunk] = cull(frustum, spheres, begin, begin + chunkSize, kernel, visible.data() + begin);
+		});
+
+		uint32_t written = chunkVisible[0];
+		for (uint32_t chunk = 1; chunk < chunkCount; chunk++)
+		{
+			std::memmove(visible.data() + written, visible.data() + chunk * chunkSize, chunkVisible[chunk] * sizeof(uint32_t));
+			written += chunkVisible[chunk];
+		}
+
+		visible.resize(written);
+	}
+
+	bool runBenchmark(uint32_t objectCount)
+	{
+		objectCount = std::max(1u, objectCount);
+
+		// Random spheres in a cube around a camera at its center, a 60 degree frustum sees roughly a tenth of them
+		const float extent = 1000.0f;
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> position(-extent, extent);
+		std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+		SphereBounds spheres;
+		spheres.resize(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			spheres.set(i, glm::vec3(position(random), position(random), position(random)), size(random));
+		}
+
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, extent);
+		Frustum frustum = extractFrustum(proj * view);
+
+		std::vector<uint32_t> reference(objectCount);
+		reference.resize(cull(frustum, spheres, 0, objectCount, Kernel::Scalar, reference.data()));
+
+		std::cout << objectCount << " spheres, " << reference.size() << " visible" << std::endl;
+
+		bool matches = true;
+		auto report = [&](const std::string& name, const std::vector<uint32_t>& result, double totalMs)
+		{
+			bool same = result == reference;
+			matches = matches && same;
+
+			std::cout << "  " << name << ": " << totalMs / CULL_BENCHMARK_ITERATIONS << " ms, "
+				<< objectCount * static_cast<double>(CULL_BENCHMARK_ITERATIONS) / totalMs << " objects/ms"
+				<< (same ? "" : ", MISMATCH") << std::endl;
+		};
+
+		std::vector<Kernel> kernels = { Kernel::Scalar };
+#ifdef FRUSTUM_CULLING_X86
+		kernels.push_back(Kernel::Sse);
+		if (bestKernel() == Kernel::Avx2) kernels.push_back(Kernel::Avx2);
+#endif
+
+		for (Kernel kernel : kernels)
+		{
+			std::vector<uint32_t> visible(objectCount);
+			uint32_t visibleCount = 0;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < CULL_BENCHMARK_ITERATIONS; i++)
+			{
+				visibleCount = cull(frustum, spheres, 0, objectCount, kernel, visible.data());
+			}
+			double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			visible.resize(visibleCount);
+			report(kernelName(kernel), visible, totalMs);
+		}
+
+		// The parallel path only splits above its threshold, like in the renderer
+		ThreadPool pool;
+		std::vector<uint32_t> visible;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < CULL_BENCHMARK_ITERATIONS; i++)
+		{
+			cull(frustum, spheres, &pool, visible);
+		}
+		double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		report(std::string(kernelName(bestKernel())) + " on " + std::to_string(pool.getThreadCount()) + " threads", visible, totalMs);
+
+		return matches;
+	}
+}
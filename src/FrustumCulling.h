@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "ApplicationData.h"
+#include "ThreadPool.h"
+
+// Object space bounds of a mesh
+struct MeshBounds
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+	glm::vec3 center = glm::vec3(0.0f); // Center of the box, also the sphere's
+	float radius = 0.0f;
+};
+
+// Normalized planes with normals pointing inside: a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Bounding spheres in structure of arrays layout, one SIMD lane per sphere.
+// Storage is padded to a whole number of batches so kernels never load past the end.
+struct SphereBounds
+{
+	std::vector<float> x, y, z, radius;
+	uint32_t count = 0;
+
+	void resize(uint32_t sphereCount);
+	void set(uint32_t index, const glm::vec3& center, float sphereRadius)
+	{
+		x[index] = center.x;
+		y[index] = center.y;
+		z[index] = center.z;
+		radius[index] = sphereRadius;
+	}
+};
+
+namespace FrustumCulling
+{
+	// Spheres per kernel iteration, also the alignment of the ranges handed to each worker
+	const uint32_t BATCH_SIZE = 8;
+	// Below this many spheres a single thread is faster than waking the pool
+	const uint32_t PARALLEL_THRESHOLD = 32768;
+
+	enum class Kernel
+	{
+		Scalar,
+		Sse,
+		Avx2
+	};
+
+	// Axis aligned box and enclosing sphere around the box center
+	MeshBounds computeBounds(const Vertex* vertices, size_t vertexCount);
+
+	// Gribb/Hartmann plane extraction for clip space depth in [0, w]
+	Frustum extractFrustum(const glm::mat4& viewProjection);
+
+	// The frustum in the space model maps to world, so model space bounds can be culled without transforming them
+	Frustum transformFrustum(const Frustum& frustum, const glm::mat4& model);
+
+	// Widest kernel this CPU runs, AVX2 is picked at runtime
+	Kernel bestKernel();
+	const char* kernelName(Kernel kernel);
+
+	// Writes the indices of spheres in [begin, end) that touch the frustum to visible, ascending, and returns how many.
+	// begin must be a multiple of BATCH_SIZE; visible needs room for end - begin indices.
+	uint32_t cull(const Frustum& frustum, const SphereBounds& spheres, uint32_t begin, uint32_t end, Kernel kernel, uint32_t* visible);
+
+	// Whole set, split across the pool in batch aligned chunks above PARALLEL_THRESHOLD. visible is resized to the result.
+	void cull(const Frustum& frustum, const SphereBounds& spheres, ThreadPool* pool, std::vector<uint32_t>& visible);
+
+	// Throughput in objects/ms of every kernel and of the parallel path over a random scene, checked against the scalar kernel
+	bool runBenchmark(uint32_t objectCount);
+}
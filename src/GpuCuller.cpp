@@ -0,0 +1,397 @@
+#include "GpuCuller.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <array>
+#include <cstring>
+#include <cstdint>
+
+// Must match Cull.comp
+const uint32_t CULL_WORKGROUP_SIZE = 64;
+
+struct CullParams
+{
+	glm::vec4 planes[6];
+	uint32_t objectCount;
+};
+
+bool GpuCuller::init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, const std::string& computeShaderPath,
+	PipelineCache& pipelineCache, uint32_t frameCount, uint32_t maxObjects, bool drawIndirectCount, bool multiDrawIndirect)
+{
+	mDevice = device;
+	mAllocator = &allocator;
+	mMaxObjects = std::max(1u, maxObjects);
+	mMultiDrawIndirect = multiDrawIndirect;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &mMemoryProperties);
+
+	if (drawIndirectCount)
+	{
+		mDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+			vkGetDeviceProcAddr(mDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+	}
+
+	if (!createPipeline(computeShaderPath, pipelineCache))
+	{
+		std::cerr << "GPU culling unavailable: could not load " << computeShaderPath << std::endl;
+		return false;
+	}
+
+	mFrames.resize(frameCount);
+
+	for (FrameData& frame : mFrames)
+	{
+		// Objects are rewritten by the CPU every frame, the draw list never leaves the GPU except for readBack()
+		createBuffer(sizeof(GpuCullObject) * mMaxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.objectBuffer, frame.objectMemory);
+
+		createBuffer(sizeof(VkDrawIndexedIndirectCommand) * mMaxObjects,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.drawBuffer, frame.drawMemory);
+
+		createBuffer(sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.countBuffer, frame.countMemory);
+	}
+
+	createDescriptorSets();
+
+	std::cerr << "GPU culling: up to " << mMaxObjects << " objects, "
+		<< (mDrawIndexedIndirectCount ? "indirect count" : mMultiDrawIndirect ? "multi-draw indirect" : "one indirect draw per object") << std::endl;
+
+	return true;
+}
+
+void GpuCuller::cleanUp()
+{
+	for (FrameData& frame : mFrames)
+	{
+		destroyBuffer(frame.objectBuffer, frame.objectMemory);
+		destroyBuffer(frame.drawBuffer, frame.drawMemory);
+		destroyBuffer(frame.countBuffer, frame.countMemory);
+	}
+
+	mFrames.clear();
+
+	if (mDescriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
+	if (mPipeline != VK_NULL_HANDLE) vkDestroyPipeline(mDevice, mPipeline, nullptr);
+	if (mPipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+	if (mDescriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
+
+	mDescriptorPool = VK_NULL_HANDLE;
+	mPipeline = VK_NULL_HANDLE;
+	mPipelineLayout = VK_NULL_HANDLE;
+	mDescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void GpuCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum, uint32_t objectCount)
+{
+	FrameData& data = mFrames[frame];
+	objectCount = std::min(objectCount, mMaxObjects);
+
+	// The fallback draws the whole list, so the unwritten tail must be empty draws
+	if (!mDrawIndexedIndirectCount) vkCmdFillBuffer(commandBuffer, data.drawBuffer, 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(commandBuffer, data.countBuffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	CullParams params{};
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), params.planes);
+	params.objectCount = objectCount;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipelineLayout, 0, 1, &data.descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vkCmdDispatch(commandBuffer, (objectCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+	VkMemoryBarrier drawBarrier{};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+		1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCuller::recordDraws(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	FrameData& data = mFrames[frame];
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (mDrawIndexedIndirectCount)
+	{
+		mDrawIndexedIndirectCount(commandBuffer, data.drawBuffer, 0, data.countBuffer, 0, mMaxObjects, stride);
+	}
+	else if (mMultiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, data.drawBuffer, 0, mMaxObjects, stride);
+	}
+	else
+	{
+		// Without multiDrawIndirect every command needs its own call, still no per-object CPU state
+		for (uint32_t i = 0; i < mMaxObjects; i++)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, data.drawBuffer, i * stride, 1, stride);
+		}
+	}
+}
+
+void GpuCuller::readBack(VkQueue queue, VkCommandPool commandPool, uint32_t frame, std::vector<uint32_t>& visible)
+{
+	FrameData& data = mFrames[frame];
+	VkDeviceSize drawSize = sizeof(VkDrawIndexedIndirectCommand) * mMaxObjects;
+
+	VkBuffer buffer;
+	Allocation memory;
+	createBuffer(drawSize + sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	VkBufferCopy drawRegion{};
+	drawRegion.size = drawSize;
+	vkCmdCopyBuffer(commandBuffer, data.drawBuffer, buffer, 1, &drawRegion);
+
+	VkBufferCopy countRegion{};
+	countRegion.dstOffset = drawSize;
+	countRegion.size = sizeof(uint32_t);
+	vkCmdCopyBuffer(commandBuffer, data.countBuffer, buffer, 1, &countRegion);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit cull readback!");
+	}
+
+	vkQueueWaitIdle(queue);
+
+	const uint8_t* mapped = static_cast<const uint8_t*>(memory.mapped);
+
+	uint32_t drawCount;
+	std::memcpy(&drawCount, mapped + drawSize, sizeof(drawCount));
+	drawCount = std::min(drawCount, mMaxObjects);
+
+	std::vector<VkDrawIndexedIndirectCommand> draws(drawCount);
+	std::memcpy(draws.data(), mapped, sizeof(VkDrawIndexedIndirectCommand) * drawCount);
+
+	visible.clear();
+	for (const VkDrawIndexedIndirectCommand& draw : draws) visible.push_back(draw.firstInstance);
+	std::sort(visible.begin(), visible.end());
+
+	vkFreeCommandBuffers(mDevice, commandPool, 1, &commandBuffer);
+	destroyBuffer(buffer, memory);
+}
+
+bool GpuCuller::createPipeline(const std::string& computeShaderPath, PipelineCache& pipelineCache)
+{
+	std::ifstream file(computeShaderPath, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) return false;
+
+	std::vector<char> code(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(code.data(), code.size());
+
+	VkShaderModuleCreateInfo moduleInfo{};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = code.size();
+	moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(mDevice, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) return false;
+
+	// Objects, draws, draw count
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+	for (uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mDescriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create cull descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &mDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr, &mPipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create cull pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = mPipelineLayout;
+
+	VkResult result = pipelineCache.createComputePipeline(pipelineInfo, mPipeline, "cull");
+	vkDestroyShaderModule(mDevice, shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		mPipeline = VK_NULL_HANDLE;
+		return false;
+	}
+
+	return true;
+}
+
+void GpuCuller::createDescriptorSets()
+{
+	uint32_t frameCount = static_cast<uint32_t>(mFrames.size());
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 3 * frameCount;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = frameCount;
+
+	if (vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mDescriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create cull descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(frameCount, mDescriptorSetLayout);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = mDescriptorPool;
+	allocInfo.descriptorSetCount = frameCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	std::vector<VkDescriptorSet> sets(frameCount);
+	if (vkAllocateDescriptorSets(mDevice, &allocInfo, sets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate cull descriptor sets!");
+	}
+
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		FrameData& frame = mFrames[i];
+		frame.descriptorSet = sets[i];
+
+		std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+		bufferInfos[0].buffer = frame.objectBuffer;
+		bufferInfos[0].range = VK_WHOLE_SIZE;
+		bufferInfos[1].buffer = frame.drawBuffer;
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+		bufferInfos[2].buffer = frame.countBuffer;
+		bufferInfos[2].range = VK_WHOLE_SIZE;
+
+		std::array<VkWriteDescriptorSet, 3> writes{};
+		for (uint32_t binding = 0; binding < writes.size(); binding++)
+		{
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = frame.descriptorSet;
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[binding].descriptorCount = 1;
+			writes[binding].pBufferInfo = &bufferInfos[binding];
+		}
+
+		vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void GpuCuller::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& memory)
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(mDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create cull buffer!");
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(mDevice, buffer, &requirements);
+
+	uint32_t memoryType = UINT32_MAX;
+	for (uint32_t i = 0; i < mMemoryProperties.memoryTypeCount; i++)
+	{
+		if ((requirements.memoryTypeBits & (1u << i)) && (mMemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			memoryType = i;
+			break;
+		}
+	}
+
+	if (memoryType == UINT32_MAX)
+	{
+		throw std::runtime_error("Failed to find memory for cull buffer!");
+	}
+
+	memory = mAllocator->allocate(requirements, memoryType, true);
+	vkBindBufferMemory(mDevice, buffer, memory.memory, memory.offset);
+}
+
+void GpuCuller::destroyBuffer(VkBuffer& buffer, Allocation& memory)
+{
+	if (buffer == VK_NULL_HANDLE) return;
+
+	vkDestroyBuffer(mDevice, buffer, nullptr);
+	mAllocator->free(memory);
+	buffer = VK_NULL_HANDLE;
+}
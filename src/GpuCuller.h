@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "FrustumCulling.h"
+
+// One per object in the cull input, std430 layout of CullObject in Cull.comp
+struct GpuCullObject
+{
+	glm::vec4 boundingSphere; // World space center, radius
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t instanceIndex; // Becomes firstInstance, so the vertex shader finds the transform at gl_InstanceIndex
+};
+
+static_assert(sizeof(GpuCullObject) == 32, "GpuCullObject must match its std430 layout");
+
+// GPU-driven frustum culling: a compute pass turns the per-object buffer into a compacted list of
+// VkDrawIndexedIndirectCommand plus a draw count, so recording costs the same for any number of objects.
+// Draws use vkCmdDrawIndexedIndirectCountKHR when VK_KHR_draw_indirect_count is enabled, otherwise the whole
+// zero-filled list is drawn, where the unwritten tail has no instances.
+// Every frame in flight owns its object, draw and count buffers.
+class GpuCuller
+{
+public:
+	GpuCuller() = default;
+
+	// Returns false if the SPIR-V at computeShaderPath does not load.
+	// drawIndirectCount: VK_KHR_draw_indirect_count is enabled; multiDrawIndirect: the feature is enabled.
+	bool init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, const std::string& computeShaderPath,
+		PipelineCache& pipelineCache, uint32_t frameCount, uint32_t maxObjects, bool drawIndirectCount, bool multiDrawIndirect);
+	void cleanUp();
+
+	bool isEnabled() const { return mPipeline != VK_NULL_HANDLE; }
+
+	// Persistently mapped input of a frame, free to write once the frame's fence was waited on
+	GpuCullObject* objects(uint32_t frame) { return static_cast<GpuCullObject*>(mFrames[frame].objectMemory.mapped); }
+
+	// Outside a render pass: clears the frame's draw list and culls the first objectCount objects into it
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum, uint32_t objectCount);
+
+	// Inside the render pass, with the graphics pipeline, vertex/index buffers and descriptor sets bound
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t frame);
+
+	// Only valid once the device is idle. Copies the frame's draw list back and returns its instance indices, sorted.
+	void readBack(VkQueue queue, VkCommandPool commandPool, uint32_t frame, std::vector<uint32_t>& visible);
+private:
+	struct FrameData
+	{
+		VkBuffer objectBuffer = VK_NULL_HANDLE;
+		Allocation objectMemory;
+		VkBuffer drawBuffer = VK_NULL_HANDLE;
+		Allocation drawMemory;
+		VkBuffer countBuffer = VK_NULL_HANDLE;
+		Allocation countMemory;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	bool createPipeline(const std::string& computeShaderPath, PipelineCache& pipelineCache);
+	void createDescriptorSets();
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& memory);
+	void destroyBuffer(VkBuffer& buffer, Allocation& memory);
+private:
+	VkDevice mDevice = VK_NULL_HANDLE;
+	MemoryAllocator* mAllocator = nullptr;
+	VkPhysicalDeviceMemoryProperties mMemoryProperties{};
+
+	VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline mPipeline = VK_NULL_HANDLE;
+	VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;
+
+	PFN_vkCmdDrawIndexedIndirectCountKHR mDrawIndexedIndirectCount = nullptr;
+	bool mMultiDrawIndirect = false;
+
+	uint32_t mMaxObjects = 0;
+	std::vector<FrameData> mFrames;
+};
@@ -0,0 +1,61 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Only view and proj are used, every instance brings its own model matrix
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+struct InstanceData {
+    mat4 model;
+};
+
+layout(std430, binding = 3) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+layout(location = 2) in vec2 inTexCoord;
+
+#ifdef COMPACT_VERTICES
+// Octahedral normal; positions arrive as unorm and the model matrix carries the mesh's scale and offset.
+// w holds the material index.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#else
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 3) in uint inMaterial;
+#endif
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragPos;
+layout(location = 3) flat out uint fragMaterial;
+
+// Matches Depth.vert bit for bit, the depth prepass relies on it
+invariant gl_Position;
+
+void main() {
+    mat4 model = instances[gl_InstanceIndex].model;
+
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition.xyz, 1.0);
+    fragPos = vec3(model * vec4(inPosition.xyz, 1.0));
+#ifdef COMPACT_VERTICES
+    fragNormal = decodeNormal(inNormal);
+    fragMaterial = uint(round(inPosition.w * 65535.0));
+#else
+    fragNormal = inColor;
+    fragMaterial = inMaterial;
+#endif
+    fragTexCoord = inTexCoord;
+}
@@ -0,0 +1,221 @@
+#include "Ktx2.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+const char KTX2_WRITER[] = "Vulkan-Study TextureCooker";
+
+// Khronos Data Format values used by the descriptors below
+const uint32_t KHR_DF_MODEL_RGBSDA = 1;
+const uint32_t KHR_DF_MODEL_BC1A = 128;
+const uint32_t KHR_DF_MODEL_BC7 = 135;
+const uint32_t KHR_DF_MODEL_ETC2 = 161;
+const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+const uint32_t KHR_DF_TRANSFER_SRGB = 2;
+const uint32_t KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10;
+
+struct Ktx2LevelIndex
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+struct DfdSample
+{
+	uint32_t bitOffset;
+	uint32_t bitLength;
+	uint32_t channelType;
+};
+
+static uint64_t alignOffset(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool isKnownFormat(uint32_t vkFormat)
+{
+	switch (static_cast<TextureFormat>(vkFormat))
+	{
+	case TextureFormat::RGBA8_SRGB:
+	case TextureFormat::BC1_RGB_SRGB:
+	case TextureFormat::BC7_SRGB:
+	case TextureFormat::ETC2_RGB8_SRGB:
+		return true;
+	}
+
+	return false;
+}
+
+// Basic data format descriptor block, preceded by the total DFD size
+static std::vector<uint32_t> dataFormatDescriptor(TextureFormat format)
+{
+	uint32_t model = KHR_DF_MODEL_RGBSDA;
+	std::vector<DfdSample> samples;
+
+	switch (format)
+	{
+	case TextureFormat::RGBA8_SRGB:
+		// Alpha is never sRGB encoded
+		samples = { { 0, 8, 0 }, { 8, 8, 1 }, { 16, 8, 2 }, { 24, 8, 15 | KHR_DF_SAMPLE_DATATYPE_LINEAR } };
+		break;
+	case TextureFormat::BC1_RGB_SRGB:
+		model = KHR_DF_MODEL_BC1A;
+		samples = { { 0, 64, 0 } };
+		break;
+	case TextureFormat::BC7_SRGB:
+		model = KHR_DF_MODEL_BC7;
+		samples = { { 0, 128, 0 } };
+		break;
+	case TextureFormat::ETC2_RGB8_SRGB:
+		model = KHR_DF_MODEL_ETC2;
+		samples = { { 0, 64, 2 } };
+		break;
+	}
+
+	uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+	uint32_t texelBlockDimensions = TextureCompressor::isBlockCompressed(format) ? (3 | (3 << 8)) : 0;
+
+	std::vector<uint32_t> words = {
+		4 + blockSize,
+		0, // Khronos vendor, basic descriptor type
+		2 | (blockSize << 16),
+		model | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_SRGB << 16),
+		texelBlockDimensions,
+		TextureCompressor::blockSize(format),
+		0
+	};
+
+	for (const auto& sample : samples)
+	{
+		uint32_t upper = sample.bitLength < 32 ? (1u << sample.bitLength) - 1 : 0xFFFFFFFFu;
+
+		words.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channelType << 24));
+		words.push_back(0);
+		words.push_back(0);
+		words.push_back(upper);
+	}
+
+	return words;
+}
+
+namespace Ktx2
+{
+	bool write(const std::string& path, TextureFormat format, uint32_t width, uint32_t height,
+		const std::vector<std::vector<uint8_t>>& levels)
+	{
+		std::vector<uint32_t> dfd = dataFormatDescriptor(format);
+
+		// One key/value pair naming the writer, padded to 4 bytes
+		uint32_t kvdEntryLength = sizeof("KTXwriter") + sizeof(KTX2_WRITER);
+		std::vector<uint8_t> kvd(alignOffset(sizeof(uint32_t) + kvdEntryLength, 4));
+		std::memcpy(kvd.data(), &kvdEntryLength, sizeof(uint32_t));
+		std::memcpy(kvd.data() + sizeof(uint32_t), "KTXwriter", sizeof("KTXwriter"));
+		std::memcpy(kvd.data() + sizeof(uint32_t) + sizeof("KTXwriter"), KTX2_WRITER, sizeof(KTX2_WRITER));
+
+		Ktx2Header header{};
+		std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+		header.vkFormat = static_cast<uint32_t>(format);
+		header.typeSize = 1;
+		header.pixelWidth = width;
+		header.pixelHeight = height;
+		header.faceCount = 1;
+		header.levelCount = static_cast<uint32_t>(levels.size());
+		header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2LevelIndex));
+		header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+		header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+		header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+
+		// Levels go smallest first, each aligned to the block size and 4 bytes
+		uint64_t alignment = std::max<uint64_t>(TextureCompressor::blockSize(format), 4);
+		uint64_t offset = header.kvdByteOffset + kvd.size();
+
+		std::vector<Ktx2LevelIndex> index(levels.size());
+		for (size_t i = levels.size(); i-- > 0;)
+		{
+			offset = alignOffset(offset, alignment);
+
+			index[i].byteOffset = offset;
+			index[i].byteLength = levels[i].size();
+			index[i].uncompressedByteLength = levels[i].size();
+
+			offset += levels[i].size();
+		}
+
+		std::vector<uint8_t> file(offset);
+		std::memcpy(file.data(), &header, sizeof(header));
+		std::memcpy(file.data() + sizeof(header), index.data(), index.size() * sizeof(Ktx2LevelIndex));
+		std::memcpy(file.data() + header.dfdByteOffset, dfd.data(), header.dfdByteLength);
+		std::memcpy(file.data() + header.kvdByteOffset, kvd.data(), kvd.size());
+
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			std::memcpy(file.data() + index[i].byteOffset, levels[i].data(), levels[i].size());
+		}
+
+		// Write next to the target and rename, like the mesh cache
+		std::string tempPath = path + ".tmp";
+
+		{
+			std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+			if (!stream.is_open()) return false;
+
+			stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+			if (!stream.good()) return false;
+		}
+
+#ifdef _WIN32
+		std::remove(path.c_str());
+#endif
+
+		return std::rename(tempPath.c_str(), path.c_str()) == 0;
+	}
+
+	bool parse(const uint8_t* data, size_t size, Ktx2Texture& texture)
+	{
+		if (size < sizeof(Ktx2Header)) return false;
+
+		Ktx2Header header;
+		std::memcpy(&header, data, sizeof(header));
+
+		bool supported = std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0 &&
+			isKnownFormat(header.vkFormat) &&
+			header.pixelWidth > 0 && header.pixelHeight > 0 && header.pixelDepth == 0 &&
+			header.layerCount == 0 && header.faceCount == 1 &&
+			header.levelCount > 0 && header.levelCount <= 32 &&
+			header.supercompressionScheme == 0 &&
+			sizeof(Ktx2Header) + header.levelCount * sizeof(Ktx2LevelIndex) <= size;
+
+		if (!supported) return false;
+
+		TextureFormat format = static_cast<TextureFormat>(header.vkFormat);
+
+		texture.vkFormat = header.vkFormat;
+		texture.width = header.pixelWidth;
+		texture.height = header.pixelHeight;
+		texture.levels.resize(header.levelCount);
+
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			Ktx2LevelIndex index;
+			std::memcpy(&index, data + sizeof(Ktx2Header) + i * sizeof(Ktx2LevelIndex), sizeof(index));
+
+			uint32_t levelWidth = std::max(header.pixelWidth >> i, 1u);
+			uint32_t levelHeight = std::max(header.pixelHeight >> i, 1u);
+
+			if (index.byteLength != TextureCompressor::levelSize(format, levelWidth, levelHeight) ||
+				index.byteOffset % TextureCompressor::blockSize(format) != 0 ||
+				index.byteOffset > size || index.byteLength > size - index.byteOffset)
+			{
+				return false;
+			}
+
+			texture.levels[i] = { index.byteOffset, index.byteLength };
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "TextureCompressor.h"
+
+// On-disk KTX2 header, followed by the level index
+struct Ktx2Header
+{
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must stay 80 bytes");
+
+struct Ktx2Level
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+// A 2D texture inside a KTX2 file, levels[0] is the largest
+struct Ktx2Texture
+{
+	uint32_t vkFormat = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<Ktx2Level> levels;
+};
+
+// Minimal KTX2 container support: single 2D images without supercompression
+namespace Ktx2
+{
+	// levels[0] is the full size image, each following level halves it
+	bool write(const std::string& path, TextureFormat format, uint32_t width, uint32_t height,
+		const std::vector<std::vector<uint8_t>>& levels);
+
+	// Validates the header and level index against the file size; false for anything this loader cannot upload
+	bool parse(const uint8_t* data, size_t size, Ktx2Texture& texture);
+}
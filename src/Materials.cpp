@@ -0,0 +1,232 @@
+#include "Materials.h"
+#include "MappedFile.h"
+
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <cstdlib>
+
+namespace
+{
+	// Whitespace separated tokens of one line, without the trailing carriage return
+	std::vector<std::string> splitLine(const char* p, const char* end)
+	{
+		if (end > p && end[-1] == '\r') end--;
+
+		std::vector<std::string> tokens;
+		while (p < end)
+		{
+			while (p < end && (*p == ' ' || *p == '\t')) p++;
+			const char* tokenStart = p;
+			while (p < end && *p != ' ' && *p != '\t') p++;
+			if (p > tokenStart) tokens.emplace_back(tokenStart, p);
+		}
+		return tokens;
+	}
+
+	// Calls visit(tokens) per non-empty line until it returns false
+	template<typename Visitor>
+	void forEachLine(const uint8_t* data, size_t size, Visitor visit)
+	{
+		const char* p = reinterpret_cast<const char*>(data);
+		const char* end = p + size;
+
+		while (p < end)
+		{
+			const char* lineEnd = std::find(p, end, '\n');
+			std::vector<std::string> tokens = splitLine(p, lineEnd);
+
+			if (!tokens.empty() && !visit(tokens)) return;
+
+			p = lineEnd < end ? lineEnd + 1 : end;
+		}
+	}
+
+	std::string directoryOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	// Exporters on Windows write backslashes
+	std::string resolvePath(const std::string& directory, std::string path)
+	{
+		std::replace(path.begin(), path.end(), '\\', '/');
+		return path.empty() || path[0] == '/' ? path : directory + path;
+	}
+}
+
+std::vector<std::string> MaterialLibrary::names() const
+{
+	std::vector<std::string> result;
+	result.reserve(materials.size());
+	for (const Material& material : materials) result.push_back(material.name);
+	return result;
+}
+
+namespace Materials
+{
+	MaterialLibrary load(const std::string& objPath, const uint8_t* objData, size_t objSize, const std::string& defaultTexture)
+	{
+		MaterialLibrary library;
+
+		Material defaultMaterial;
+		defaultMaterial.diffuseTexture = defaultTexture;
+		library.materials.push_back(defaultMaterial);
+
+		// Exporters write mtllib in the header, so the vertex and face records are not scanned
+		std::vector<std::string> libraryPaths;
+		forEachLine(objData, objSize, [&](const std::vector<std::string>& tokens)
+		{
+			if (tokens[0] == "f") return false;
+			if (tokens[0] == "mtllib") libraryPaths.insert(libraryPaths.end(), tokens.begin() + 1, tokens.end());
+			return true;
+		});
+
+		std::string directory = directoryOf(objPath);
+
+		for (const std::string& name : libraryPaths)
+		{
+			std::string path = resolvePath(directory, name);
+
+			MappedFile file;
+			if (!file.open(path))
+			{
+				std::cerr << "Failed to open material library " << path << ", its materials use the default" << std::endl;
+				continue;
+			}
+
+			parseLibrary(file.data(), file.size(), directoryOf(path), library.materials);
+		}
+
+		// One texture per distinct file
+		std::map<std::string, uint32_t> textureIndices;
+
+		for (const Material& material : library.materials)
+		{
+			if (material.diffuseTexture.empty())
+			{
+				library.textureIndices.push_back(NO_TEXTURE);
+				continue;
+			}
+
+			auto inserted = textureIndices.emplace(material.diffuseTexture, static_cast<uint32_t>(library.texturePaths.size()));
+			if (inserted.second) library.texturePaths.push_back(material.diffuseTexture);
+
+			library.textureIndices.push_back(inserted.first->second);
+		}
+
+		return library;
+	}
+
+	void parseLibrary(const uint8_t* data, size_t size, const std::string& directory, std::vector<Material>& materials)
+	{
+		Material* current = nullptr;
+
+		forEachLine(data, size, [&](const std::vector<std::string>& tokens)
+		{
+			if (tokens[0] == "newmtl" && tokens.size() >= 2)
+			{
+				materials.emplace_back();
+				current = &materials.back();
+				current->name = tokens[1];
+			}
+			else if (current && tokens[0] == "Kd" && tokens.size() >= 4)
+			{
+				for (int i = 0; i < 3; i++) current->diffuse[i] = std::strtof(tokens[i + 1].c_str(), nullptr);
+			}
+			else if (current && tokens[0] == "map_Kd" && tokens.size() >= 2)
+			{
+				// Options such as -bm or -s come first, the file name last
+				current->diffuseTexture = resolvePath(directory, tokens.back());
+			}
+			return true;
+		});
+	}
+
+	uint32_t append(MaterialLibrary& library, const MaterialLibrary& other)
+	{
+		uint32_t base = static_cast<uint32_t>(library.materials.size());
+
+		std::map<std::string, uint32_t> textureIndices;
+		for (size_t i = 0; i < library.texturePaths.size(); i++) textureIndices.emplace(library.texturePaths[i], static_cast<uint32_t>(i));
+
+		for (size_t i = 0; i < other.materials.size(); i++)
+		{
+			library.materials.push_back(other.materials[i]);
+
+			if (other.textureIndices[i] == NO_TEXTURE)
+			{
+				library.textureIndices.push_back(NO_TEXTURE);
+				continue;
+			}
+
+			const std::string& path = other.texturePaths[other.textureIndices[i]];
+			auto inserted = textureIndices.emplace(path, static_cast<uint32_t>(library.texturePaths.size()));
+			if (inserted.second) library.texturePaths.push_back(path);
+
+			library.textureIndices.push_back(inserted.first->second);
+		}
+
+		return base;
+	}
+
+	std::vector<GpuMaterial> buildGpuMaterials(const MaterialLibrary& library)
+	{
+		std::vector<GpuMaterial> gpuMaterials(library.materials.size());
+
+		for (size_t i = 0; i < library.materials.size(); i++)
+		{
+			gpuMaterials[i].baseColor = glm::vec4(library.materials[i].diffuse, 1.0f);
+			gpuMaterials[i].textureIndex = library.textureIndices[i];
+		}
+
+		return gpuMaterials;
+	}
+
+	void sortByMaterial(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods)
+	{
+		uint32_t materialCount = 0;
+		for (const Vertex& vertex : vertices) materialCount = std::max(materialCount, vertex.material + 1);
+		if (materialCount <= 1) return;
+
+		std::vector<uint32_t> sorted;
+		std::vector<uint32_t> start(materialCount + 1);
+
+		for (const MeshLod& lod : lods)
+		{
+			const uint32_t* first = indices.data() + lod.firstIndex;
+
+			// Counting sort on triangles
+			std::fill(start.begin(), start.end(), 0);
+			for (uint32_t i = 0; i < lod.indexCount; i += 3) start[vertices[first[i]].material + 1] += 3;
+			for (uint32_t m = 0; m < materialCount; m++) start[m + 1] += start[m];
+
+			sorted.resize(lod.indexCount);
+			for (uint32_t i = 0; i < lod.indexCount; i += 3)
+			{
+				uint32_t& cursor = start[vertices[first[i]].material];
+				std::copy(first + i, first + i + 3, sorted.begin() + cursor);
+				cursor += 3;
+			}
+
+			std::copy(sorted.begin(), sorted.end(), indices.begin() + lod.firstIndex);
+		}
+	}
+
+	void findRanges(const Vertex* vertices, const uint32_t* indices, uint32_t firstIndex, uint32_t indexCount,
+		std::vector<MaterialRange>& ranges)
+	{
+		uint32_t end = firstIndex + indexCount;
+
+		for (uint32_t i = firstIndex; i < end;)
+		{
+			uint32_t material = vertices[indices[i]].material;
+			uint32_t rangeEnd = i + 3;
+			while (rangeEnd < end && vertices[indices[rangeEnd]].material == material) rangeEnd += 3;
+
+			ranges.push_back({ i, rangeEnd - i, material });
+			i = rangeEnd;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "ApplicationData.h"
+
+// One newmtl block of an MTL library
+struct Material
+{
+	std::string name;
+	glm::vec3 diffuse = glm::vec3(1.0f); // Kd
+	std::string diffuseTexture;          // map_Kd, relative to the working directory; empty when untextured
+};
+
+// Materials of a model: index 0 is the default for faces without a known usemtl, then the libraries' in file order.
+// Textures are shared between materials that name the same file.
+struct MaterialLibrary
+{
+	std::vector<Material> materials;
+	std::vector<std::string> texturePaths;
+	std::vector<uint32_t> textureIndices; // Per material, Materials::NO_TEXTURE when untextured
+
+	std::vector<std::string> names() const;
+};
+
+// Indices of one material within a level of detail
+struct MaterialRange
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t material;
+};
+
+namespace Materials
+{
+	const uint32_t NO_TEXTURE = 0xFFFFFFFFu;
+
+	// Reads every mtllib named in the OBJ header, up to its first face; the default material samples defaultTexture.
+	// Libraries that fail to open are reported and skipped, their materials fall back to the default.
+	MaterialLibrary load(const std::string& objPath, const uint8_t* objData, size_t objSize, const std::string& defaultTexture);
+
+	// Parses newmtl, Kd and map_Kd; texture paths are resolved against directory
+	void parseLibrary(const uint8_t* data, size_t size, const std::string& directory, std::vector<Material>& materials);
+
+	// Appends other's materials behind library's, sharing the textures both name. Returns where other's material 0 landed.
+	uint32_t append(MaterialLibrary& library, const MaterialLibrary& other);
+
+	// Storage buffer contents, one per material
+	std::vector<GpuMaterial> buildGpuMaterials(const MaterialLibrary& library);
+
+	// Groups every level's triangles by the material of their first vertex, the one flat shading reads.
+	// Stable, so each material keeps the vertex cache order it had.
+	void sortByMaterial(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods);
+
+	// Appends the runs of equal material in indices[firstIndex, firstIndex + indexCount)
+	void findRanges(const Vertex* vertices, const uint32_t* indices, uint32_t firstIndex, uint32_t indexCount,
+		std::vector<MaterialRange>& ranges);
+}
@@ -0,0 +1,475 @@
+#include "MemoryAllocator.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <random>
+#include <cstring>
+
+// Size of the blocks each memory type is carved from
+const VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+// Free ranges smaller than this are counted as wasted in the stats
+const VkDeviceSize MIN_USEFUL_RANGE = 256;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void MemoryAllocator::init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits)
+{
+	mDevice = device;
+	mMemoryProperties = memoryProperties;
+	mGranularity = std::max<VkDeviceSize>(limits.bufferImageGranularity, 1);
+	mMaxAllocationCount = limits.maxMemoryAllocationCount;
+	mBlockSize = DEFAULT_BLOCK_SIZE;
+	mBlocks.assign(memoryProperties.memoryTypeCount, {});
+}
+
+void MemoryAllocator::cleanUp()
+{
+	for (auto& blocks : mBlocks)
+	{
+		for (auto& block : blocks)
+		{
+			destroyBlock(block);
+		}
+	}
+
+	mBlocks.clear();
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear)
+{
+	if (memoryType >= mBlocks.size())
+	{
+		throw std::runtime_error("Invalid memory type for allocation!");
+	}
+
+	VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+	auto& blocks = mBlocks[memoryType];
+
+	Allocation allocation{};
+	allocation.memoryType = memoryType;
+	allocation.size = requirements.size;
+
+	// Resources bigger than half a block get memory of their own
+	if (requirements.size > mBlockSize / 2)
+	{
+		allocation.block = createBlock(memoryType, requirements.size, true);
+		tryAllocate(blocks[allocation.block], requirements.size, alignment, linear, allocation.offset);
+	}
+	else
+	{
+		bool found = false;
+
+		for (uint32_t i = 0; i < blocks.size() && !found; i++)
+		{
+			if (blocks[i].memory == VK_NULL_HANDLE || blocks[i].dedicated) continue;
+
+			if (tryAllocate(blocks[i], requirements.size, alignment, linear, allocation.offset))
+			{
+				allocation.block = i;
+				found = true;
+			}
+		}
+
+		if (!found)
+		{
+			allocation.block = createBlock(memoryType, mBlockSize, false);
+
+			if (!tryAllocate(blocks[allocation.block], requirements.size, alignment, linear, allocation.offset))
+			{
+				throw std::runtime_error("Failed to sub-allocate from a fresh memory block!");
+			}
+		}
+	}
+
+	Block& block = blocks[allocation.block];
+	allocation.memory = block.memory;
+	allocation.mapped = block.mapped ? block.mapped + allocation.offset : nullptr;
+
+	return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	Block& block = mBlocks[allocation.memoryType][allocation.block];
+
+	auto it = block.ranges.find(allocation.offset);
+	if (it == block.ranges.end() || it->second.free)
+	{
+		throw std::runtime_error("Freeing an allocation that is not live!");
+	}
+
+	it->second.free = true;
+
+	// Merge with the following free range
+	auto next = std::next(it);
+	if (next != block.ranges.end() && next->second.free)
+	{
+		it->second.size += next->second.size;
+		block.ranges.erase(next);
+	}
+
+	// Merge with the preceding free range
+	if (it != block.ranges.begin())
+	{
+		auto prev = std::prev(it);
+		if (prev->second.free)
+		{
+			prev->second.size += it->second.size;
+			block.ranges.erase(it);
+		}
+	}
+
+	if (block.dedicated)
+	{
+		destroyBlock(block);
+	}
+
+	allocation = Allocation{};
+}
+
+bool MemoryAllocator::tryAllocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, bool linear, VkDeviceSize& outOffset)
+{
+	for (auto it = block.ranges.begin(); it != block.ranges.end(); ++it)
+	{
+		if (!it->second.free || it->second.size < size) continue;
+
+		VkDeviceSize rangeStart = it->first;
+		VkDeviceSize rangeEnd = rangeStart + it->second.size;
+		VkDeviceSize offset = alignUp(rangeStart, alignment);
+
+		// A linear and an optimal resource must not share a bufferImageGranularity page
+		if (it != block.ranges.begin())
+		{
+			auto prev = std::prev(it);
+			if (!prev->second.free && prev->second.linear != linear && onSamePage(prev->first + prev->second.size, offset))
+			{
+				offset = alignUp(offset, mGranularity);
+			}
+		}
+
+		if (offset + size > rangeEnd) continue;
+
+		auto next = std::next(it);
+		if (next != block.ranges.end() && !next->second.free && next->second.linear != linear && onSamePage(offset + size, next->first))
+		{
+			continue;
+		}
+
+		// Split into [padding][allocation][remainder]
+		VkDeviceSize padding = offset - rangeStart;
+		VkDeviceSize remainder = rangeEnd - (offset + size);
+
+		if (padding > 0)
+		{
+			it->second.size = padding;
+		}
+		else
+		{
+			block.ranges.erase(it);
+		}
+
+		block.ranges[offset] = Range{ size, false, linear };
+
+		if (remainder > 0)
+		{
+			block.ranges[offset + size] = Range{ remainder, true, false };
+		}
+
+		outOffset = offset;
+		return true;
+	}
+
+	return false;
+}
+
+uint32_t MemoryAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated)
+{
+	auto& blocks = mBlocks[memoryType];
+
+	// Reuse the slot of a released block so existing block indices stay valid
+	uint32_t index = static_cast<uint32_t>(blocks.size());
+	for (uint32_t i = 0; i < blocks.size(); i++)
+	{
+		if (blocks[i].memory == VK_NULL_HANDLE)
+		{
+			index = i;
+			break;
+		}
+	}
+
+	if (index == blocks.size()) blocks.emplace_back();
+
+	Block& block = blocks[index];
+	block.size = size;
+	block.dedicated = dedicated;
+	block.ranges.clear();
+	block.ranges[0] = Range{ size, true, false };
+
+	if (mDevice == VK_NULL_HANDLE)
+	{
+		block.memory = (VkDeviceMemory)(uintptr_t)(++mFakeHandleCounter);
+
+		if (isHostVisible(memoryType))
+		{
+			block.fakeStorage.resize(static_cast<size_t>(size));
+			block.mapped = block.fakeStorage.data();
+		}
+	}
+	else
+	{
+		if (mMaxAllocationCount != 0 && mDeviceAllocationCount >= mMaxAllocationCount)
+		{
+			throw std::runtime_error("Exceeded maxMemoryAllocationCount!");
+		}
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		if (vkAllocateMemory(mDevice, &allocInfo, nullptr, &block.memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate memory block!");
+		}
+
+		// Host visible blocks stay mapped for their whole lifetime
+		if (isHostVisible(memoryType))
+		{
+			void* data;
+			if (vkMapMemory(mDevice, block.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to map memory block!");
+			}
+
+			block.mapped = static_cast<uint8_t*>(data);
+		}
+	}
+
+	mDeviceAllocationCount++;
+
+	return index;
+}
+
+void MemoryAllocator::destroyBlock(Block& block)
+{
+	if (block.memory == VK_NULL_HANDLE) return;
+
+	if (mDevice != VK_NULL_HANDLE)
+	{
+		if (block.mapped) vkUnmapMemory(mDevice, block.memory);
+		vkFreeMemory(mDevice, block.memory, nullptr);
+	}
+
+	block.memory = VK_NULL_HANDLE;
+	block.mapped = nullptr;
+	block.size = 0;
+	block.ranges.clear();
+	block.fakeStorage.clear();
+	block.fakeStorage.shrink_to_fit();
+
+	mDeviceAllocationCount--;
+}
+
+bool MemoryAllocator::isHostVisible(uint32_t memoryType) const
+{
+	return (mMemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+bool MemoryAllocator::onSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const
+{
+	if (endOfFirst == 0) return false;
+	return (endOfFirst - 1) / mGranularity == startOfSecond / mGranularity;
+}
+
+void MemoryAllocator::dumpStats(std::ostream& out) const
+{
+	out << "Memory allocator: " << mDeviceAllocationCount << " device allocations";
+	if (mMaxAllocationCount != 0) out << " (limit " << mMaxAllocationCount << ")";
+	out << std::endl;
+
+	for (uint32_t type = 0; type < mBlocks.size(); type++)
+	{
+		uint32_t blockCount = 0, liveCount = 0;
+		VkDeviceSize total = 0, used = 0, freeBytes = 0, largestFree = 0, wasted = 0;
+
+		for (const auto& block : mBlocks[type])
+		{
+			if (block.memory == VK_NULL_HANDLE) continue;
+
+			blockCount++;
+			total += block.size;
+
+			for (const auto& range : block.ranges)
+			{
+				if (range.second.free)
+				{
+					freeBytes += range.second.size;
+					largestFree = std::max(largestFree, range.second.size);
+					if (range.second.size < MIN_USEFUL_RANGE) wasted += range.second.size;
+				}
+				else
+				{
+					used += range.second.size;
+					liveCount++;
+				}
+			}
+		}
+
+		if (blockCount == 0) continue;
+
+		// 0 when all free space is one contiguous range, approaching 1 as it splinters
+		double fragmentation = freeBytes ? 1.0 - static_cast<double>(largestFree) / freeBytes : 0.0;
+
+		out << "  type " << type << ": " << blockCount << " blocks, " << liveCount << " allocations, "
+			<< used << "/" << total << " bytes used, largest free " << largestFree
+			<< ", fragmentation " << fragmentation * 100.0 << "%, wasted " << wasted << " bytes" << std::endl;
+	}
+}
+
+MemoryUsage MemoryAllocator::usage() const
+{
+	MemoryUsage usage;
+	usage.deviceAllocations = mDeviceAllocationCount;
+
+	for (const auto& blocks : mBlocks)
+	{
+		for (const auto& block : blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE) continue;
+
+			usage.blockBytes += block.size;
+
+			for (const auto& range : block.ranges)
+			{
+				if (!range.second.free) usage.usedBytes += range.second.size;
+			}
+		}
+	}
+
+	return usage;
+}
+
+bool MemoryAllocator::validate() const
+{
+	for (const auto& blocks : mBlocks)
+	{
+		for (const auto& block : blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE) continue;
+
+			VkDeviceSize expected = 0;
+			const Range* prev = nullptr;
+			VkDeviceSize prevOffset = 0;
+
+			for (const auto& range : block.ranges)
+			{
+				// Ranges must tile the block with no gaps or overlaps, and free ranges must be coalesced
+				if (range.first != expected || range.second.size == 0) return false;
+				if (prev && prev->free && range.second.free) return false;
+
+				if (prev && !prev->free && !range.second.free && prev->linear != range.second.linear &&
+					onSamePage(prevOffset + prev->size, range.first))
+				{
+					return false;
+				}
+
+				expected += range.second.size;
+				prev = &range.second;
+				prevOffset = range.first;
+			}
+
+			if (expected != block.size) return false;
+		}
+	}
+
+	return true;
+}
+
+bool MemoryAllocator::runSelfTest()
+{
+	// Fake device: one device local type, one host visible coherent type
+	VkPhysicalDeviceMemoryProperties properties{};
+	properties.memoryTypeCount = 2;
+	properties.memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	properties.memoryTypes[1].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	properties.memoryHeapCount = 1;
+	properties.memoryHeaps[0].size = 1024ull * 1024 * 1024;
+
+	VkPhysicalDeviceLimits limits{};
+	limits.bufferImageGranularity = 1024;
+	limits.maxMemoryAllocationCount = 4096;
+
+	MemoryAllocator allocator;
+	allocator.init(VK_NULL_HANDLE, properties, limits);
+	allocator.mBlockSize = 1024 * 1024;
+
+	std::mt19937 rng(1234);
+	std::vector<std::pair<Allocation, uint8_t>> live;
+	bool ok = true;
+
+	for (int step = 0; step < 20000 && ok; step++)
+	{
+		if (live.empty() || rng() % 3 != 0)
+		{
+			VkMemoryRequirements requirements{};
+			requirements.size = 1 + rng() % (rng() % 8 == 0 ? 700000 : 20000);
+			requirements.alignment = VkDeviceSize(1) << (rng() % 9);
+
+			uint32_t type = rng() % 2;
+			Allocation allocation = allocator.allocate(requirements, type, rng() % 2 == 0);
+
+			ok = ok && allocation.offset % requirements.alignment == 0;
+
+			// Host visible memory is filled so overlaps show up as corrupted patterns
+			uint8_t pattern = static_cast<uint8_t>(step);
+			if (allocation.mapped) std::memset(allocation.mapped, pattern, static_cast<size_t>(allocation.size));
+
+			live.emplace_back(allocation, pattern);
+		}
+		else
+		{
+			size_t index = rng() % live.size();
+			Allocation& allocation = live[index].first;
+
+			if (allocation.mapped)
+			{
+				const uint8_t* bytes = static_cast<const uint8_t*>(allocation.mapped);
+				for (VkDeviceSize i = 0; i < allocation.size && ok; i++)
+				{
+					ok = bytes[i] == live[index].second;
+				}
+			}
+
+			allocator.free(allocation);
+			live[index] = live.back();
+			live.pop_back();
+		}
+
+		if (step % 1000 == 0) ok = ok && allocator.validate();
+	}
+
+	allocator.dumpStats(std::cerr);
+
+	for (auto& entry : live) allocator.free(entry.first);
+
+	// Everything freed: each remaining block must be a single free range
+	for (const auto& blocks : allocator.mBlocks)
+	{
+		for (const auto& block : blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE) continue;
+			ok = ok && block.ranges.size() == 1 && block.ranges.begin()->second.free;
+		}
+	}
+
+	ok = ok && allocator.validate();
+	allocator.cleanUp();
+
+	std::cerr << "Memory allocator self test " << (ok ? "passed" : "FAILED") << std::endl;
+	return ok;
+}
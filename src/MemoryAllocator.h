@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <cstdint>
+
+// A sub-range of a larger VkDeviceMemory block
+struct Allocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr; // Non-null for host visible memory, already offset
+	uint32_t memoryType = 0;
+	uint32_t block = 0;
+};
+
+// Totals over every memory type
+struct MemoryUsage
+{
+	VkDeviceSize blockBytes = 0; // Device memory held in blocks
+	VkDeviceSize usedBytes = 0;	 // Bytes handed out to live allocations
+	uint32_t deviceAllocations = 0;
+};
+
+// Block-based device memory sub-allocator.
+// Large blocks are allocated per memory type and carved up with a first-fit free list,
+// honouring resource alignment and bufferImageGranularity between linear and optimal resources.
+// Passing VK_NULL_HANDLE as the device runs the allocator against fake memory (no Vulkan calls).
+class MemoryAllocator
+{
+public:
+	MemoryAllocator() = default;
+
+	void init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits);
+	void cleanUp();
+
+	// linear: buffers and linear-tiled images, !linear: optimal-tiled images
+	Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear);
+	void free(Allocation& allocation);
+
+	void dumpStats(std::ostream& out) const;
+	MemoryUsage usage() const;
+
+	// CPU-only check of the allocation logic against fake memory properties
+	static bool runSelfTest();
+private:
+	struct Range
+	{
+		VkDeviceSize size;
+		bool free;
+		bool linear;
+	};
+
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint8_t* mapped = nullptr;
+		bool dedicated = false;
+		std::map<VkDeviceSize, Range> ranges; // Keyed by offset, covers the whole block
+		std::vector<uint8_t> fakeStorage;
+	};
+
+	bool tryAllocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, bool linear, VkDeviceSize& outOffset);
+	uint32_t createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+	void destroyBlock(Block& block);
+	bool isHostVisible(uint32_t memoryType) const;
+	bool onSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const;
+	bool validate() const;
+private:
+	VkDevice mDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties mMemoryProperties{};
+	VkDeviceSize mGranularity = 1;
+	VkDeviceSize mBlockSize = 0;
+	uint32_t mMaxAllocationCount = 0;
+	uint32_t mDeviceAllocationCount = 0;
+	uint32_t mFakeHandleCounter = 0;
+	std::vector<std::vector<Block>> mBlocks; // Indexed by memory type
+};
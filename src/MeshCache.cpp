@@ -0,0 +1,134 @@
+#include "MeshCache.h"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+const char MESH_CACHE_MAGIC[8] = { 'V', 'K', 'S', 'M', 'E', 'S', 'H', '\0' };
+const uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+static uint64_t alignOffset(uint64_t value)
+{
+	return (value + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+bool MeshCache::open(const std::string& path, uint64_t sourceHash, uint64_t sourceSize)
+{
+	close();
+
+	if (!mFile.open(path)) return false;
+
+	if (mFile.size() < sizeof(MeshCacheHeader))
+	{
+		close();
+		return false;
+	}
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(mFile.data());
+
+	bool valid = std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0 &&
+		header->version == MESH_CACHE_VERSION &&
+		header->vertexStride == sizeof(Vertex) &&
+		header->sourceHash == sourceHash &&
+		header->sourceSize == sourceSize &&
+		header->vertexOffset % MESH_CACHE_ALIGNMENT == 0 &&
+		header->indexOffset % MESH_CACHE_ALIGNMENT == 0 &&
+		header->lodOffset % MESH_CACHE_ALIGNMENT == 0 &&
+		header->lodCount > 0 &&
+		header->vertexOffset + header->vertexCount * sizeof(Vertex) <= mFile.size() &&
+		header->indexOffset + header->indexCount * sizeof(uint32_t) <= mFile.size() &&
+		header->lodOffset + header->lodCount * sizeof(MeshLod) <= mFile.size();
+
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+
+	mHeader = header;
+	return true;
+}
+
+MeshView MeshCache::view() const
+{
+	MeshView mesh{};
+
+	if (mHeader)
+	{
+		mesh.vertices = reinterpret_cast<const Vertex*>(mFile.data() + mHeader->vertexOffset);
+		mesh.vertexCount = static_cast<size_t>(mHeader->vertexCount);
+		mesh.indices = reinterpret_cast<const uint32_t*>(mFile.data() + mHeader->indexOffset);
+		mesh.indexCount = static_cast<size_t>(mHeader->indexCount);
+		mesh.lods = reinterpret_cast<const MeshLod*>(mFile.data() + mHeader->lodOffset);
+		mesh.lodCount = static_cast<size_t>(mHeader->lodCount);
+	}
+
+	return mesh;
+}
+
+bool MeshCache::write(const std::string& path, uint64_t sourceHash, uint64_t sourceSize,
+	const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods)
+{
+	MeshCacheHeader header{};
+	std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.vertexStride = sizeof(Vertex);
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.vertexCount = vertices.size();
+	header.indexCount = indices.size();
+	header.vertexOffset = alignOffset(sizeof(MeshCacheHeader));
+	header.indexOffset = alignOffset(header.vertexOffset + vertices.size() * sizeof(Vertex));
+	header.lodCount = lods.size();
+	header.lodOffset = alignOffset(header.indexOffset + indices.size() * sizeof(uint32_t));
+
+	// Write next to the target and rename, so a crash never leaves a torn cache behind
+	std::string tempPath = path + ".tmp";
+
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+
+		const char padding[MESH_CACHE_ALIGNMENT] = {};
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(padding, header.vertexOffset - sizeof(header));
+		file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+		file.write(padding, header.indexOffset - (header.vertexOffset + vertices.size() * sizeof(Vertex)));
+		file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+		file.write(padding, header.lodOffset - (header.indexOffset + indices.size() * sizeof(uint32_t)));
+		file.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(MeshLod));
+
+		if (!file.good()) return false;
+	}
+
+#ifdef _WIN32
+	std::remove(path.c_str());
+#endif
+
+	return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+uint64_t MeshCache::hashData(const uint8_t* data, size_t size)
+{
+	// FNV-1a style mixing, eight bytes at a time
+	uint64_t hash = 14695981039346656037ull;
+	size_t i = 0;
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, data + i, sizeof(word));
+		hash ^= word;
+		hash *= 1099511628211ull;
+		hash ^= hash >> 32;
+	}
+
+	for (; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash ^ size;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "ApplicationData.h"
+#include "MappedFile.h"
+
+// Bump whenever the cache layout or the mesh processing in loadModel changes
+const uint32_t MESH_CACHE_VERSION = 3;
+
+// On-disk header, followed by 64 byte aligned vertex, index and level of detail blobs
+struct MeshCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t vertexStride;
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t lodCount;
+	uint64_t lodOffset;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 80, "Mesh cache header must stay 80 bytes");
+
+// Binary mesh cache that is memory mapped and used in place
+class MeshCache
+{
+public:
+	MeshCache() = default;
+
+	// Maps the cache and checks it was built from the given source; false on any mismatch
+	bool open(const std::string& path, uint64_t sourceHash, uint64_t sourceSize);
+	void close() { mFile.close(); mHeader = nullptr; }
+
+	MeshView view() const;
+
+	static bool write(const std::string& path, uint64_t sourceHash, uint64_t sourceSize,
+		const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods);
+
+	static uint64_t hashData(const uint8_t* data, size_t size);
+private:
+	MappedFile mFile;
+	const MeshCacheHeader* mHeader = nullptr;
+};
@@ -0,0 +1,338 @@
+#include "MeshOptimizer.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+
+// LRU cache size modelled by the vertex cache optimizer
+const int FORSYTH_CACHE_SIZE = 32;
+
+namespace
+{
+	struct VertexKey
+	{
+		const Vertex* vertex;
+
+		bool operator==(const VertexKey& other) const
+		{
+			return std::memcmp(vertex, other.vertex, sizeof(Vertex)) == 0;
+		}
+	};
+
+	struct VertexKeyHash
+	{
+		size_t operator()(const VertexKey& key) const
+		{
+			// FNV-1a over the raw vertex bytes
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(key.vertex);
+			uint64_t hash = 14695981039346656037ull;
+
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	float vertexScore(int cachePosition, uint32_t remainingValence)
+	{
+		if (remainingValence == 0) return -1.0f;
+
+		float score = 0.0f;
+
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a fixed score so strips are not favoured over fans
+			if (cachePosition < 3) score = 0.75f;
+			else score = std::pow(1.0f - (cachePosition - 3) / float(FORSYTH_CACHE_SIZE - 3), 1.5f);
+		}
+
+		// Boost vertices with few triangles left so they get finished off
+		score += 2.0f * std::pow(float(remainingValence), -0.5f);
+
+		return score;
+	}
+}
+
+namespace MeshOptimizer
+{
+	void weldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		std::vector<Vertex> unique;
+		unique.reserve(vertices.size());
+
+		std::vector<uint32_t> remap(vertices.size());
+		std::unordered_map<VertexKey, uint32_t, VertexKeyHash> lookup;
+		lookup.reserve(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			auto result = lookup.emplace(VertexKey{ &vertices[i] }, static_cast<uint32_t>(unique.size()));
+
+			if (result.second) unique.push_back(vertices[i]);
+
+			remap[i] = result.first->second;
+		}
+
+		for (auto& index : indices)
+		{
+			index = remap[index];
+		}
+
+		vertices.swap(unique);
+	}
+
+	void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) return;
+
+		// Triangles adjacent to each vertex, live ones first
+		std::vector<uint32_t> valence(vertexCount, 0);
+		for (uint32_t index : indices) valence[index]++;
+
+		std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+		std::vector<uint32_t> adjacency(indices.size());
+		std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) vertexScores[v] = vertexScore(-1, valence[v]);
+
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+
+		std::vector<uint32_t> cache, newCache;
+		cache.reserve(FORSYTH_CACHE_SIZE + 3);
+		newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+		size_t scanPosition = 0;
+		int64_t bestTriangle = -1;
+
+		while (output.size() < indices.size())
+		{
+			// Nothing useful in the cache: continue with the next triangle in input order
+			if (bestTriangle < 0)
+			{
+				while (emitted[scanPosition]) scanPosition++;
+				bestTriangle = static_cast<int64_t>(scanPosition);
+			}
+
+			const uint32_t* triangle = &indices[bestTriangle * 3];
+			emitted[bestTriangle] = true;
+
+			newCache.clear();
+
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = triangle[k];
+				output.push_back(v);
+				newCache.push_back(v);
+
+				// Remove the triangle from the vertex's live adjacency
+				uint32_t* begin = &adjacency[adjacencyOffset[v]];
+				uint32_t* end = begin + valence[v];
+				uint32_t* it = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+				std::swap(*it, *(end - 1));
+				valence[v]--;
+			}
+
+			for (uint32_t v : cache)
+			{
+				if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache.push_back(v);
+			}
+
+			// Vertices falling out of the cache lose their cache bonus
+			for (size_t i = FORSYTH_CACHE_SIZE; i < newCache.size(); i++)
+			{
+				cachePosition[newCache[i]] = -1;
+				vertexScores[newCache[i]] = vertexScore(-1, valence[newCache[i]]);
+			}
+
+			if (newCache.size() > FORSYTH_CACHE_SIZE) newCache.resize(FORSYTH_CACHE_SIZE);
+			cache.swap(newCache);
+
+			for (size_t i = 0; i < cache.size(); i++)
+			{
+				cachePosition[cache[i]] = static_cast<int>(i);
+				vertexScores[cache[i]] = vertexScore(static_cast<int>(i), valence[cache[i]]);
+			}
+
+			// Rescore live triangles touching the cache and pick the best one
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+
+			for (uint32_t v : cache)
+			{
+				for (uint32_t i = 0; i < valence[v]; i++)
+				{
+					uint32_t t = adjacency[adjacencyOffset[v] + i];
+					float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+					if (score > bestScore)
+					{
+						bestScore = score;
+						bestTriangle = t;
+					}
+				}
+			}
+		}
+
+		indices.swap(output);
+	}
+
+	void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+	{
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) return;
+
+		const uint32_t cacheSize = 16;
+		VertexCacheStats original = analyzeVertexCache(indices, vertices.size(), cacheSize);
+
+		// Split at hard boundaries: triangles where the simulated cache misses all three vertices
+		std::vector<uint32_t> clusterStarts;
+		std::vector<uint32_t> timestamps(vertices.size(), 0);
+		uint32_t time = cacheSize + 1;
+
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			int misses = 0;
+
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = indices[t * 3 + k];
+				if (time - timestamps[v] > cacheSize)
+				{
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+
+			if (t == 0 || misses == 3) clusterStarts.push_back(static_cast<uint32_t>(t));
+		}
+
+		if (clusterStarts.size() < 2) return;
+
+		// Sort key: how far each cluster faces away from the mesh centre
+		glm::vec3 meshCentroid(0.0f);
+		for (const auto& vertex : vertices) meshCentroid += vertex.pos;
+		meshCentroid /= static_cast<float>(vertices.size());
+
+		struct Cluster
+		{
+			uint32_t first, count;
+			float key;
+		};
+
+		std::vector<Cluster> clusters(clusterStarts.size());
+
+		for (size_t c = 0; c < clusterStarts.size(); c++)
+		{
+			uint32_t first = clusterStarts[c];
+			uint32_t last = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : static_cast<uint32_t>(triangleCount);
+
+			glm::vec3 centroid(0.0f), normal(0.0f);
+			float area = 0.0f;
+
+			for (uint32_t t = first; t < last; t++)
+			{
+				const glm::vec3& p0 = vertices[indices[t * 3]].pos;
+				const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+				const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+
+				glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+				float faceArea = glm::length(faceNormal);
+
+				centroid += (p0 + p1 + p2) * (faceArea / 3.0f);
+				normal += faceNormal;
+				area += faceArea;
+			}
+
+			if (area > 0.0f) centroid /= area;
+
+			float normalLength = glm::length(normal);
+			float key = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+
+			clusters[c] = { first, last - first, key };
+		}
+
+		// Outward facing clusters first: they occlude the ones behind them
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+
+		for (const auto& cluster : clusters)
+		{
+			output.insert(output.end(), indices.begin() + cluster.first * 3, indices.begin() + (cluster.first + cluster.count) * 3);
+		}
+
+		VertexCacheStats sorted = analyzeVertexCache(output, vertices.size(), cacheSize);
+
+		if (sorted.acmr <= original.acmr * threshold)
+		{
+			indices.swap(output);
+		}
+	}
+
+	void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const uint32_t unused = ~0u;
+		std::vector<uint32_t> remap(vertices.size(), unused);
+		std::vector<Vertex> reordered;
+		reordered.reserve(vertices.size());
+
+		for (auto& index : indices)
+		{
+			if (remap[index] == unused)
+			{
+				remap[index] = static_cast<uint32_t>(reordered.size());
+				reordered.push_back(vertices[index]);
+			}
+
+			index = remap[index];
+		}
+
+		vertices.swap(reordered);
+	}
+
+	VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+	{
+		VertexCacheStats stats;
+		if (indices.empty() || vertexCount == 0) return stats;
+
+		std::vector<uint32_t> timestamps(vertexCount, 0);
+		std::vector<bool> referenced(vertexCount, false);
+		uint32_t time = cacheSize + 1;
+		size_t misses = 0, uniqueVertices = 0;
+
+		for (uint32_t index : indices)
+		{
+			if (time - timestamps[index] > cacheSize)
+			{
+				timestamps[index] = time++;
+				misses++;
+			}
+
+			if (!referenced[index])
+			{
+				referenced[index] = true;
+				uniqueVertices++;
+			}
+		}
+
+		stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+		stats.atvr = static_cast<float>(misses) / uniqueVertices;
+
+		return stats;
+	}
+}
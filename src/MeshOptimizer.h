@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ApplicationData.h"
+
+// Post-transform vertex cache efficiency of an index buffer
+struct VertexCacheStats
+{
+	float acmr = 0.0f; // Average cache miss ratio: transformed vertices per triangle (0.5 ~ ideal, 3.0 worst)
+	float atvr = 0.0f; // Average transform to vertex ratio: transformed vertices per unique vertex (1.0 ideal)
+};
+
+namespace MeshOptimizer
+{
+	// Merge bitwise identical vertices and rewrite the index buffer to share them
+	void weldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Reorder triangles for the post-transform cache (Forsyth's linear-speed algorithm)
+	void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+	// Reorder cache-friendly clusters front-to-back from the outside in, unless ACMR grows beyond threshold
+	void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+
+	// Reorder vertices in first-use order so vertex fetch walks memory linearly
+	void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Simulate a FIFO post-transform cache of the given size
+	VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16);
+}
@@ -0,0 +1,48 @@
+#include "MeshRegistry.h"
+
+#include <limits>
+#include <stdexcept>
+
+uint32_t MeshRegistry::add(const MeshView& mesh)
+{
+	// Offsets are 32-bit in draw commands, signed for the base vertex
+	if (mVertexCount + mesh.vertexCount > static_cast<size_t>(std::numeric_limits<int32_t>::max())
+		|| mIndexCount + mesh.indexCount > std::numeric_limits<uint32_t>::max())
+	{
+		throw std::runtime_error("Failed to register mesh, the shared buffers are full!");
+	}
+
+	MeshAllocation allocation;
+	allocation.vertexOffset = static_cast<int32_t>(mVertexCount);
+	allocation.vertexCount = static_cast<uint32_t>(mesh.vertexCount);
+	allocation.firstIndex = mIndexCount;
+	allocation.indexCount = static_cast<uint32_t>(mesh.indexCount);
+	allocation.firstLod = static_cast<uint32_t>(mLods.size());
+	allocation.lodCount = static_cast<uint32_t>(mesh.lodCount);
+
+	uint32_t id = static_cast<uint32_t>(mMeshes.size());
+
+	for (size_t i = 0; i < mesh.lodCount; i++)
+	{
+		MeshLod lod = mesh.lods[i];
+		lod.firstIndex += allocation.firstIndex;
+
+		mLods.push_back(lod);
+		mLodMeshes.push_back(id);
+	}
+
+	mMeshes.push_back(allocation);
+	mVertexCount += allocation.vertexCount;
+	mIndexCount += allocation.indexCount;
+
+	return id;
+}
+
+void MeshRegistry::clear()
+{
+	mMeshes.clear();
+	mLods.clear();
+	mLodMeshes.clear();
+	mVertexCount = 0;
+	mIndexCount = 0;
+}
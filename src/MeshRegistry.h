@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ApplicationData.h"
+
+// Where one mesh lives in the shared buffers. Its index values stay relative to the mesh, draws add vertexOffset.
+struct MeshAllocation
+{
+	int32_t vertexOffset; // Base vertex
+	uint32_t vertexCount;
+	uint32_t firstIndex;
+	uint32_t indexCount;  // Every level of detail
+	uint32_t firstLod;    // Into MeshRegistry::lods()
+	uint32_t lodCount;
+};
+
+// Sub-allocates meshes into one vertex range and one index range, so every mesh draws from the same pair of buffers
+// through base vertex and first index offsets. Meshes are only appended and the whole set is uploaded at once.
+class MeshRegistry
+{
+public:
+	// Returns the mesh id, ids count up from 0 in registration order
+	uint32_t add(const MeshView& mesh);
+	void clear();
+
+	uint32_t meshCount() const { return static_cast<uint32_t>(mMeshes.size()); }
+	const MeshAllocation& mesh(uint32_t id) const { return mMeshes[id]; }
+
+	// Levels of every mesh, mesh by mesh, with first indices into the shared index buffer
+	const std::vector<MeshLod>& lods() const { return mLods; }
+	// Mesh a level of lods() belongs to
+	uint32_t lodMesh(uint32_t lod) const { return mLodMeshes[lod]; }
+
+	// Sizes of the shared buffers, in vertices and indices
+	uint32_t vertexCount() const { return mVertexCount; }
+	uint32_t indexCount() const { return mIndexCount; }
+private:
+	std::vector<MeshAllocation> mMeshes;
+	std::vector<MeshLod> mLods;
+	std::vector<uint32_t> mLodMeshes;
+	uint32_t mVertexCount = 0;
+	uint32_t mIndexCount = 0;
+};
@@ -0,0 +1,411 @@
+#include "MeshSimplifier.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+
+// A level that keeps more than this share of the previous one's triangles is not worth its memory
+const float LOD_MIN_REDUCTION = 0.85f;
+// Collapse passes per simplify() call before giving up on reaching the target
+const uint32_t SIMPLIFY_MAX_PASSES = 64;
+
+namespace
+{
+	// Symmetric 4x4 matrix of summed, area weighted plane equations
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double weight = 0;
+
+		void addPlane(const glm::vec3& normal, float distance, double planeWeight)
+		{
+			double x = normal.x, y = normal.y, z = normal.z, d = distance;
+
+			a00 += planeWeight * x * x; a01 += planeWeight * x * y; a02 += planeWeight * x * z;
+			a11 += planeWeight * y * y; a12 += planeWeight * y * z; a22 += planeWeight * z * z;
+			b0 += planeWeight * x * d; b1 += planeWeight * y * d; b2 += planeWeight * z * d;
+			c += planeWeight * d * d;
+			weight += planeWeight;
+		}
+
+		void add(const Quadric& other)
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02;
+			a11 += other.a11; a12 += other.a12; a22 += other.a22;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+		}
+
+		// Weighted sum of squared distances of p to the planes
+		double evaluate(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+
+			double result = a00 * x * x + a11 * y * y + a22 * z * z
+				+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+
+			return std::max(result, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t source;
+		uint32_t target;
+		double cost; // Mean squared distance
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const glm::vec3& position) const
+		{
+			uint32_t bits[3];
+			std::memcpy(bits, &position, sizeof(bits));
+			return static_cast<size_t>((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u));
+		}
+	};
+
+	struct PositionKeyEqual
+	{
+		bool operator()(const glm::vec3& a, const glm::vec3& b) const
+		{
+			return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+		}
+	};
+
+	inline uint64_t edgeKey(uint32_t a, uint32_t b)
+	{
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	}
+
+	inline glm::vec3 triangleNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+	{
+		return glm::cross(p1 - p0, p2 - p0);
+	}
+}
+
+namespace MeshSimplifier
+{
+	float simplify(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, size_t targetIndexCount, float targetError)
+	{
+		size_t vertexCount = vertices.size();
+
+		// Attribute seams split a position into several vertices; collapses work on positions so seams move together
+		std::vector<uint32_t> positionOf(vertexCount);
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> firstVertex;
+		{
+			std::unordered_map<glm::vec3, uint32_t, PositionKeyHash, PositionKeyEqual> lookup;
+			lookup.reserve(vertexCount);
+
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				auto inserted = lookup.emplace(vertices[i].pos, static_cast<uint32_t>(positions.size()));
+				if (inserted.second)
+				{
+					positions.push_back(vertices[i].pos);
+					firstVertex.push_back(static_cast<uint32_t>(i));
+				}
+
+				positionOf[i] = inserted.first->second;
+			}
+		}
+
+		size_t positionCount = positions.size();
+
+		std::vector<Quadric> quadrics(positionCount);
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const glm::vec3& p0 = vertices[indices[i]].pos;
+			glm::vec3 normal = triangleNormal(p0, vertices[indices[i + 1]].pos, vertices[indices[i + 2]].pos);
+
+			float length = glm::length(normal);
+			if (length <= 0.0f) continue;
+
+			normal /= length;
+			float distance = -glm::dot(normal, p0);
+			double area = 0.5 * length;
+
+			for (int corner = 0; corner < 3; corner++)
+			{
+				quadrics[positionOf[indices[i + corner]]].addPlane(normal, distance, area);
+			}
+		}
+
+		// Edges used by a single triangle are open borders, collapsing their ends would tear the outline
+		std::vector<bool> locked(positionCount, false);
+		{
+			std::unordered_map<uint64_t, uint32_t> edgeUse;
+			edgeUse.reserve(indices.size());
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				for (int e = 0; e < 3; e++)
+				{
+					edgeUse[edgeKey(positionOf[indices[i + e]], positionOf[indices[i + (e + 1) % 3]])]++;
+				}
+			}
+
+			for (const auto& edge : edgeUse)
+			{
+				if (edge.second != 1) continue;
+				locked[static_cast<uint32_t>(edge.first >> 32)] = true;
+				locked[static_cast<uint32_t>(edge.first & 0xffffffffu)] = true;
+			}
+		}
+
+		double errorLimit = static_cast<double>(targetError) * targetError;
+		double resultError = 0.0;
+
+		std::vector<uint32_t> triangleOffsets;
+		std::vector<uint32_t> positionTriangles;
+		std::vector<Collapse> collapses;
+		std::vector<uint8_t> touched(positionCount);
+		std::vector<int64_t> collapseTarget(positionCount, -1);
+		std::vector<uint32_t> vertexRemap(vertexCount);
+
+		for (uint32_t pass = 0; pass < SIMPLIFY_MAX_PASSES && indices.size() > targetIndexCount; pass++)
+		{
+			size_t triangleCount = indices.size() / 3;
+
+			// Triangles around every position
+			triangleOffsets.assign(positionCount + 1, 0);
+			for (uint32_t index : indices) triangleOffsets[positionOf[index] + 1]++;
+			for (size_t i = 0; i < positionCount; i++) triangleOffsets[i + 1] += triangleOffsets[i];
+
+			positionTriangles.resize(indices.size());
+			{
+				std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); i++)
+				{
+					positionTriangles[cursor[positionOf[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			// Cheapest direction of every edge; the merged quadric is evaluated at the vertex that stays
+			collapses.clear();
+			for (size_t t = 0; t < triangleCount; t++)
+			{
+				for (int e = 0; e < 3; e++)
+				{
+					uint32_t a = positionOf[indices[t * 3 + e]];
+					uint32_t b = positionOf[indices[t * 3 + (e + 1) % 3]];
+					if (a >= b) continue; // Interior edges show up once per side
+
+					Quadric merged = quadrics[a];
+					merged.add(quadrics[b]);
+					double scale = merged.weight > 0.0 ? 1.0 / merged.weight : 0.0;
+
+					double costAB = locked[a] ? HUGE_VAL : merged.evaluate(positions[b]) * scale;
+					double costBA = locked[b] ? HUGE_VAL : merged.evaluate(positions[a]) * scale;
+
+					if (costAB == HUGE_VAL && costBA == HUGE_VAL) continue;
+
+					if (costAB <= costBA) collapses.push_back({ a, b, costAB });
+					else collapses.push_back({ b, a, costBA });
+				}
+			}
+
+			if (collapses.empty()) break;
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+			// Every collapse removes about two triangles
+			size_t collapseBudget = std::max<size_t>(1, (triangleCount - targetIndexCount / 3) / 2);
+			size_t applied = 0;
+
+			std::fill(touched.begin(), touched.end(), 0);
+
+			for (const Collapse& collapse : collapses)
+			{
+				if (collapse.cost > errorLimit || applied >= collapseBudget) break;
+				if (touched[collapse.source] || touched[collapse.target]) continue;
+
+				// Reject collapses that would fold a remaining triangle over
+				bool flips = false;
+				for (uint32_t i = triangleOffsets[collapse.source]; i < triangleOffsets[collapse.source + 1] && !flips; i++)
+				{
+					const uint32_t* triangle = &indices[positionTriangles[i] * 3];
+
+					uint32_t p[3] = { positionOf[triangle[0]], positionOf[triangle[1]], positionOf[triangle[2]] };
+					if (p[0] == collapse.target || p[1] == collapse.target || p[2] == collapse.target) continue;
+
+					glm::vec3 before = triangleNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+
+					glm::vec3 moved[3];
+					for (int c = 0; c < 3; c++) moved[c] = p[c] == collapse.source ? positions[collapse.target] : positions[p[c]];
+					glm::vec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+
+					flips = glm::dot(before, after) <= 0.0f;
+				}
+
+				if (flips) continue;
+
+				// The triangles around the source change, so nothing in them may move again this pass
+				for (uint32_t i = triangleOffsets[collapse.source]; i < triangleOffsets[collapse.source + 1]; i++)
+				{
+					const uint32_t* triangle = &indices[positionTriangles[i] * 3];
+					for (int c = 0; c < 3; c++) touched[positionOf[triangle[c]]] = 1;
+				}
+				touched[collapse.target] = 1;
+
+				collapseTarget[collapse.source] = collapse.target;
+				quadrics[collapse.target].add(quadrics[collapse.source]);
+				resultError = std::max(resultError, collapse.cost);
+				applied++;
+			}
+
+			if (applied == 0) break;
+
+			// Each vertex of a collapsed position moves to a vertex of the target it shares a triangle with,
+			// which keeps its seam side; a vertex with no such neighbour takes the target's first vertex
+			for (size_t i = 0; i < vertexCount; i++) vertexRemap[i] = static_cast<uint32_t>(i);
+
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				uint32_t vertex = indices[i];
+				int64_t target = collapseTarget[positionOf[vertex]];
+				if (target < 0 || vertexRemap[vertex] != vertex) continue;
+
+				vertexRemap[vertex] = firstVertex[static_cast<size_t>(target)];
+
+				for (uint32_t j = triangleOffsets[positionOf[vertex]]; j < triangleOffsets[positionOf[vertex] + 1]; j++)
+				{
+					const uint32_t* triangle = &indices[positionTriangles[j] * 3];
+					if (triangle[0] != vertex && triangle[1] != vertex && triangle[2] != vertex) continue;
+
+					for (int c = 0; c < 3; c++)
+					{
+						if (positionOf[triangle[c]] == static_cast<uint32_t>(target)) vertexRemap[vertex] = triangle[c];
+					}
+				}
+			}
+
+			// Rewrite in place, dropping triangles that lost an edge
+			size_t written = 0;
+			for (size_t t = 0; t < triangleCount; t++)
+			{
+				uint32_t v0 = vertexRemap[indices[t * 3]];
+				uint32_t v1 = vertexRemap[indices[t * 3 + 1]];
+				uint32_t v2 = vertexRemap[indices[t * 3 + 2]];
+
+				uint32_t p0 = positionOf[v0], p1 = positionOf[v1], p2 = positionOf[v2];
+				if (p0 == p1 || p1 == p2 || p0 == p2) continue;
+
+				indices[written++] = v0;
+				indices[written++] = v1;
+				indices[written++] = v2;
+			}
+
+			indices.resize(written);
+
+			for (int64_t& target : collapseTarget) target = -1;
+		}
+
+		return static_cast<float>(std::sqrt(resultError));
+	}
+
+	std::vector<MeshLod> buildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t lodCount)
+	{
+		std::vector<MeshLod> lods;
+		lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f, 0 });
+
+		// Bounded by the mesh size, so a flat mesh does not collapse into nothing
+		MeshLod previous = lods[0];
+		std::vector<uint32_t> level(indices.begin(), indices.end());
+
+		glm::vec3 minimum(0.0f), maximum(0.0f);
+		if (!vertices.empty())
+		{
+			minimum = maximum = vertices[0].pos;
+			for (const Vertex& vertex : vertices)
+			{
+				minimum = glm::min(minimum, vertex.pos);
+				maximum = glm::max(maximum, vertex.pos);
+			}
+		}
+
+		float maxError = glm::length(maximum - minimum) * 0.05f;
+
+		for (uint32_t lod = 1; lod <= lodCount; lod++)
+		{
+			size_t target = (level.size() / 3 / 2) * 3;
+			float error = simplify(vertices, level, target, maxError);
+
+			if (level.empty() || level.size() > previous.indexCount * LOD_MIN_REDUCTION) break;
+
+			MeshOptimizer::optimizeVertexCache(level, vertices.size());
+
+			// Errors of consecutive levels add up, each one was measured against the level before
+			MeshLod current{ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(level.size()), previous.error + error, 0 };
+			indices.insert(indices.end(), level.begin(), level.end());
+
+			lods.push_back(current);
+			previous = current;
+		}
+
+		return lods;
+	}
+
+	bool runBenchmark(const std::string& path)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+
+		try
+		{
+			ThreadPool pool;
+			ObjLoader::loadFile(path, pool, vertices, indices);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+
+		MeshOptimizer::weldVertices(vertices, indices);
+		MeshOptimizer::optimizeVertexCache(indices, vertices.size());
+
+		size_t baseTriangles = indices.size() / 3;
+		std::cout << path << ": " << baseTriangles << " triangles, " << vertices.size() << " vertices" << std::endl;
+
+		std::vector<uint32_t> level = indices;
+		size_t chainTriangles = baseTriangles;
+		double totalMs = 0.0;
+		size_t totalInput = 0;
+
+		for (uint32_t lod = 1; lod <= DEFAULT_LOD_COUNT; lod++)
+		{
+			size_t inputTriangles = level.size() / 3;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			float error = simplify(vertices, level, (inputTriangles / 2) * 3, HUGE_VALF);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			totalMs += ms;
+			totalInput += inputTriangles;
+			chainTriangles += level.size() / 3;
+
+			std::cout << "  LOD " << lod << ": " << level.size() / 3 << " triangles (" << 100.0 * level.size() / 3 / baseTriangles
+				<< "% of LOD 0), error " << error << ", " << ms << " ms, " << inputTriangles / (ms / 1000.0) << " input triangles/s" << std::endl;
+
+			if (level.empty()) break;
+		}
+
+		std::cout << "  chain: " << chainTriangles << " triangles stored (" << 100.0 * chainTriangles / baseTriangles << "% of LOD 0), "
+			<< totalInput / (totalMs / 1000.0) << " triangles/s overall" << std::endl;
+
+		return true;
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "ApplicationData.h"
+
+// Quadric error metric simplification (Garland/Heckbert) by collapsing edges onto existing vertices,
+// so every level of detail indexes the same vertex buffer
+namespace MeshSimplifier
+{
+	// Levels after LOD 0 in a chain, each with about half the triangles of the one before
+	const uint32_t DEFAULT_LOD_COUNT = 4;
+
+	// Collapses edges in order of quadric error until indices has at most targetIndexCount entries or the next collapse
+	// would move the surface further than targetError in model units. Open borders are locked so no holes appear.
+	// Returns the error of the result, the RMS distance of the collapsed vertices from their original planes.
+	float simplify(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, size_t targetIndexCount, float targetError);
+
+	// indices holds LOD 0 on input; every coarser level is appended behind it, vertex cache optimized.
+	// Stops early when a level cannot get meaningfully smaller. Returns one range per level, LOD 0 first.
+	std::vector<MeshLod> buildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t lodCount = DEFAULT_LOD_COUNT);
+
+	// Loads and welds the OBJ, then reports simplification speed (triangles/s) per level and the triangle savings
+	bool runBenchmark(const std::string& path);
+}
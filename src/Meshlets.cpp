@@ -0,0 +1,149 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Below this spread the normals are too close to a half sphere for the cone to ever reject anything
+const float MIN_CONE_DOT = 0.1f;
+
+namespace
+{
+	void computeBounds(const Vertex* vertices, const uint32_t* indices, const Meshlet& meshlet, MeshletSet& set, uint32_t index)
+	{
+		const uint32_t* first = indices + meshlet.firstIndex;
+
+		glm::vec3 min = vertices[first[0]].pos;
+		glm::vec3 max = min;
+		for (uint32_t i = 1; i < meshlet.indexCount; i++)
+		{
+			min = glm::min(min, vertices[first[i]].pos);
+			max = glm::max(max, vertices[first[i]].pos);
+		}
+
+		glm::vec3 center = (min + max) * 0.5f;
+		float radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.indexCount; i++)
+			radius = std::max(radius, glm::length(vertices[first[i]].pos - center));
+
+		set.spheres.set(index, center, radius);
+
+		// Face normals, not vertex normals: culling is about the rasterized winding
+		glm::vec3 normals[Meshlets::MAX_TRIANGLES];
+		uint32_t normalCount = 0;
+		glm::vec3 axis(0.0f);
+
+		for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+		{
+			const glm::vec3& a = vertices[first[i]].pos;
+			glm::vec3 normal = glm::cross(vertices[first[i + 1]].pos - a, vertices[first[i + 2]].pos - a);
+			float length = glm::length(normal);
+			if (length == 0.0f) continue;
+
+			normals[normalCount] = normal / length;
+			axis += normals[normalCount++];
+		}
+
+		float axisLength = glm::length(axis);
+		if (normalCount == 0 || axisLength == 0.0f)
+		{
+			set.cones[index] = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+			return;
+		}
+
+		axis /= axisLength;
+
+		float minDot = 1.0f;
+		for (uint32_t i = 0; i < normalCount; i++)
+			minDot = std::min(minDot, glm::dot(axis, normals[i]));
+
+		// Sine of the cone's half angle, the test needs the view direction within 90 degrees minus that of the axis
+		float cutoff = minDot < MIN_CONE_DOT ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+		set.cones[index] = glm::vec4(axis, cutoff);
+	}
+}
+
+namespace Meshlets
+{
+	MeshletSet build(const Vertex* vertices, const uint32_t* indices, uint32_t firstIndex, uint32_t indexCount)
+	{
+		MeshletSet set;
+
+		uint32_t endIndex = firstIndex + indexCount;
+		uint32_t maxVertex = 0;
+		for (uint32_t i = firstIndex; i < endIndex; i++)
+			maxVertex = std::max(maxVertex, indices[i]);
+
+		// Meshlet that last referenced each vertex, + 1 so zero means none
+		std::vector<uint32_t> owner(static_cast<size_t>(maxVertex) + 1, 0);
+
+		Meshlet current{ firstIndex, 0, 0 };
+		for (uint32_t i = firstIndex; i + 2 < endIndex; i += 3)
+		{
+			uint32_t stamp = static_cast<uint32_t>(set.meshlets.size()) + 1;
+			// Upper bound, a degenerate triangle may repeat a vertex
+			uint32_t newVertices = (owner[indices[i]] != stamp) + (owner[indices[i + 1]] != stamp) + (owner[indices[i + 2]] != stamp);
+
+			if (current.vertexCount + newVertices > MAX_VERTICES || current.indexCount / 3 == MAX_TRIANGLES)
+			{
+				set.meshlets.push_back(current);
+				current = { i, 0, 0 };
+				stamp++;
+			}
+
+			// Counted as they are stamped so a triangle repeating a vertex counts it once
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t& vertexOwner = owner[indices[i + corner]];
+				if (vertexOwner != stamp) current.vertexCount++;
+				vertexOwner = stamp;
+			}
+
+			current.indexCount += 3;
+		}
+
+		if (current.indexCount > 0) set.meshlets.push_back(current);
+
+		uint32_t meshletCount = static_cast<uint32_t>(set.meshlets.size());
+		set.spheres.resize(meshletCount);
+		set.cones.resize(meshletCount);
+
+		for (uint32_t i = 0; i < meshletCount; i++)
+			computeBounds(vertices, indices, set.meshlets[i], set, i);
+
+		return set;
+	}
+
+	MeshletCullStats cull(const MeshletSet& set, const Frustum& modelFrustum, const glm::vec3& modelCamera,
+		std::vector<uint32_t>& visible, std::vector<IndexRange>& runs)
+	{
+		MeshletCullStats stats;
+		stats.tested = set.meshlets.size();
+
+		visible.resize(set.spheres.count);
+		uint32_t visibleCount = FrustumCulling::cull(modelFrustum, set.spheres, 0, set.spheres.count,
+			FrustumCulling::bestKernel(), visible.data());
+		stats.frustumCulled = stats.tested - visibleCount;
+
+		for (uint32_t i = 0; i < visibleCount; i++)
+		{
+			uint32_t index = visible[i];
+			const glm::vec4& cone = set.cones[index];
+
+			glm::vec3 toCenter = glm::vec3(set.spheres.x[index], set.spheres.y[index], set.spheres.z[index]) - modelCamera;
+			if (glm::dot(toCenter, glm::vec3(cone)) >= cone.w * glm::length(toCenter) + set.spheres.radius[index])
+			{
+				stats.backfaceCulled++;
+				continue;
+			}
+
+			// Meshlets are consecutive in the index buffer, so neighbours merge into one draw
+			const Meshlet& meshlet = set.meshlets[index];
+			if (!runs.empty() && runs.back().firstIndex + runs.back().indexCount == meshlet.firstIndex)
+				runs.back().indexCount += meshlet.indexCount;
+			else
+				runs.push_back({ meshlet.firstIndex, meshlet.indexCount });
+		}
+
+		return stats;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "ApplicationData.h"
+#include "FrustumCulling.h"
+
+// A cluster of consecutive triangles in the index buffer
+struct Meshlet
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t vertexCount; // Unique vertices referenced
+};
+
+// Range of the index buffer drawn with one call
+struct IndexRange
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// Clusters tested by Meshlets::cull() and how they were rejected
+struct MeshletCullStats
+{
+	uint64_t tested = 0;
+	uint64_t frustumCulled = 0;
+	uint64_t backfaceCulled = 0;
+
+	void add(const MeshletCullStats& other)
+	{
+		tested += other.tested;
+		frustumCulled += other.frustumCulled;
+		backfaceCulled += other.backfaceCulled;
+	}
+};
+
+// Meshlets of one index range with model space bounds.
+// Cones follow meshoptimizer's convention: a cluster faces away when
+// dot(center - camera, axis) >= cutoff * length(center - camera) + radius.
+struct MeshletSet
+{
+	std::vector<Meshlet> meshlets;
+	SphereBounds spheres;
+	std::vector<glm::vec4> cones; // xyz axis, w cutoff (1 disables the test)
+};
+
+namespace Meshlets
+{
+	// Limits that also fit a mesh shader's output
+	const uint32_t MAX_VERTICES = 64;
+	const uint32_t MAX_TRIANGLES = 124;
+
+	// Splits indices[firstIndex, firstIndex + indexCount) into meshlets in triangle order, so a vertex cache
+	// optimized index buffer gives compact clusters and every meshlet stays a contiguous index range
+	MeshletSet build(const Vertex* vertices, const uint32_t* indices, uint32_t firstIndex, uint32_t indexCount);
+
+	// Rejects meshlets outside modelFrustum or facing away from modelCamera, both in the mesh's model space.
+	// Visible meshlets are appended to runs, neighbours merged into one range. visible is scratch.
+	MeshletCullStats cull(const MeshletSet& set, const Frustum& modelFrustum, const glm::vec3& modelCamera,
+		std::vector<uint32_t>& visible, std::vector<IndexRange>& runs);
+}
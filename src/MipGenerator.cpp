@@ -0,0 +1,425 @@
+#include "MipGenerator.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+// Must match Downsample.comp
+const uint32_t DOWNSAMPLE_LEVELS_PER_DISPATCH = 6;
+const uint32_t DOWNSAMPLE_TILE_SIZE = 64;
+
+struct DownsampleParams
+{
+	int32_t baseWidth;
+	int32_t baseHeight;
+	uint32_t levelCount;
+	uint32_t srgb;
+};
+
+void MipGenerator::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& computeShaderPath, PipelineCache& pipelineCache,
+	bool extendedUsage)
+{
+	mPhysicalDevice = physicalDevice;
+	mDevice = device;
+	mExtendedUsage = extendedUsage;
+
+	if (!createComputePipeline(computeShaderPath, pipelineCache))
+	{
+		std::cerr << "Compute mip generation unavailable: could not load " << computeShaderPath << std::endl;
+	}
+}
+
+void MipGenerator::cleanUp()
+{
+	for (auto view : mImageViews) vkDestroyImageView(mDevice, view, nullptr);
+	for (auto pool : mDescriptorPools) vkDestroyDescriptorPool(mDevice, pool, nullptr);
+
+	mImageViews.clear();
+	mDescriptorPools.clear();
+
+	if (mPipeline != VK_NULL_HANDLE) vkDestroyPipeline(mDevice, mPipeline, nullptr);
+	if (mPipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+	if (mDescriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
+
+	mPipeline = VK_NULL_HANDLE;
+	mPipelineLayout = VK_NULL_HANDLE;
+	mDescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+MipGenerator::Method MipGenerator::chooseMethod(VkFormat format) const
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, format, &properties);
+
+	VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	if ((properties.optimalTilingFeatures & blitFeatures) == blitFeatures) return Method::Blit;
+
+	VkFormat viewFormat = storageFormat(format);
+
+	// An image whose own format cannot be stored to may only carry storage usage with extended usage
+	if (mPipeline != VK_NULL_HANDLE && viewFormat != VK_FORMAT_UNDEFINED && (viewFormat == format || mExtendedUsage))
+	{
+		vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, viewFormat, &properties);
+
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) return Method::Compute;
+	}
+
+	return Method::None;
+}
+
+VkImageUsageFlags MipGenerator::imageUsage(Method method) const
+{
+	switch (method)
+	{
+	case Method::Blit: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	case Method::Compute: return VK_IMAGE_USAGE_STORAGE_BIT;
+	default: return 0;
+	}
+}
+
+VkImageCreateFlags MipGenerator::imageFlags(Method method) const
+{
+	if (method != Method::Compute) return 0;
+
+	// The storage views use the UNORM twin of sRGB formats, which do not support storage themselves
+	return VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | (mExtendedUsage ? VK_IMAGE_CREATE_EXTENDED_USAGE_BIT_KHR : 0);
+}
+
+VkImageUsageFlags MipGenerator::viewUsage(Method method) const
+{
+	// Storage usage is only valid on the UNORM views, the sRGB view is for sampling
+	return method == Method::Compute && mExtendedUsage ? VK_IMAGE_USAGE_SAMPLED_BIT : 0;
+}
+
+VkImageLayout MipGenerator::inputLayout(Method method) const
+{
+	switch (method)
+	{
+	case Method::Blit: return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	case Method::Compute: return VK_IMAGE_LAYOUT_GENERAL;
+	default: return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+}
+
+VkPipelineStageFlags MipGenerator::inputStage(Method method) const
+{
+	switch (method)
+	{
+	case Method::Blit: return VK_PIPELINE_STAGE_TRANSFER_BIT;
+	case Method::Compute: return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	default: return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+}
+
+VkAccessFlags MipGenerator::inputAccess(Method method) const
+{
+	switch (method)
+	{
+	case Method::Blit: return VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	case Method::Compute: return VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	default: return VK_ACCESS_SHADER_READ_BIT;
+	}
+}
+
+void MipGenerator::generate(VkCommandBuffer commandBuffer, Method method, VkImage image, VkFormat format,
+	uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	if (method == Method::Blit) generateBlit(commandBuffer, image, width, height, mipLevels);
+	else if (method == Method::Compute) generateCompute(commandBuffer, image, format, width, height, mipLevels);
+}
+
+uint32_t MipGenerator::mipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1) levels++;
+
+	return levels;
+}
+
+void MipGenerator::generateBlit(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	int32_t mipWidth = static_cast<int32_t>(width);
+	int32_t mipHeight = static_cast<int32_t>(height);
+
+	for (uint32_t level = 1; level < mipLevels; level++)
+	{
+		// Previous level becomes the blit source
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkImageBlit blit{};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+
+		mipWidth = std::max(mipWidth / 2, 1);
+		mipHeight = std::max(mipHeight / 2, 1);
+
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	// The last level was only ever written
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void MipGenerator::generateCompute(VkCommandBuffer commandBuffer, VkImage image, VkFormat format,
+	uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	VkFormat viewFormat = storageFormat(format);
+
+	// One storage view per level
+	std::vector<VkImageView> levelViews(mipLevels);
+
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = viewFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(mDevice, &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create mip storage view!");
+		}
+
+		mImageViews.push_back(levelViews[level]);
+	}
+
+	uint32_t dispatchCount = (mipLevels - 1 + DOWNSAMPLE_LEVELS_PER_DISPATCH - 1) / DOWNSAMPLE_LEVELS_PER_DISPATCH;
+	std::vector<VkDescriptorSet> descriptorSets(dispatchCount);
+
+	if (dispatchCount > 0)
+	{
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSize.descriptorCount = (DOWNSAMPLE_LEVELS_PER_DISPATCH + 1) * dispatchCount;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = dispatchCount;
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create mip descriptor pool!");
+		}
+
+		mDescriptorPools.push_back(pool);
+
+		std::vector<VkDescriptorSetLayout> layouts(dispatchCount, mDescriptorSetLayout);
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = dispatchCount;
+		allocInfo.pSetLayouts = layouts.data();
+
+		if (vkAllocateDescriptorSets(mDevice, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate mip descriptor sets!");
+		}
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	for (uint32_t dispatch = 0; dispatch < dispatchCount; dispatch++)
+	{
+		uint32_t baseLevel = dispatch * DOWNSAMPLE_LEVELS_PER_DISPATCH;
+		uint32_t levelCount = std::min(DOWNSAMPLE_LEVELS_PER_DISPATCH, mipLevels - 1 - baseLevel);
+
+		// Unused slots repeat the last written level; the shader never touches them
+		VkDescriptorImageInfo imageInfos[DOWNSAMPLE_LEVELS_PER_DISPATCH + 1];
+
+		for (uint32_t i = 0; i <= DOWNSAMPLE_LEVELS_PER_DISPATCH; i++)
+		{
+			imageInfos[i].sampler = VK_NULL_HANDLE;
+			imageInfos[i].imageView = levelViews[baseLevel + std::min(i, levelCount)];
+			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSets[dispatch];
+		write.dstBinding = 0;
+		write.dstArrayElement = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		write.descriptorCount = DOWNSAMPLE_LEVELS_PER_DISPATCH + 1;
+		write.pImageInfo = imageInfos;
+
+		vkUpdateDescriptorSets(mDevice, 1, &write, 0, nullptr);
+
+		// The previous dispatch wrote this dispatch's base level
+		if (dispatch > 0)
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		DownsampleParams params{};
+		params.baseWidth = static_cast<int32_t>(std::max(width >> baseLevel, 1u));
+		params.baseHeight = static_cast<int32_t>(std::max(height >> baseLevel, 1u));
+		params.levelCount = levelCount;
+		params.srgb = viewFormat != format ? 1 : 0;
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipelineLayout, 0, 1, &descriptorSets[dispatch], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+
+		vkCmdDispatch(commandBuffer, (params.baseWidth + DOWNSAMPLE_TILE_SIZE - 1) / DOWNSAMPLE_TILE_SIZE,
+			(params.baseHeight + DOWNSAMPLE_TILE_SIZE - 1) / DOWNSAMPLE_TILE_SIZE, 1);
+	}
+
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+bool MipGenerator::createComputePipeline(const std::string& computeShaderPath, PipelineCache& pipelineCache)
+{
+	std::ifstream file(computeShaderPath, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) return false;
+
+	std::vector<char> code(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(code.data(), code.size());
+
+	VkShaderModuleCreateInfo moduleInfo{};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = code.size();
+	moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(mDevice, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) return false;
+
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	binding.descriptorCount = DOWNSAMPLE_LEVELS_PER_DISPATCH + 1;
+	binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+
+	if (vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mDescriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create mip descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DownsampleParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &mDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr, &mPipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create mip pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = mPipelineLayout;
+
+	VkResult result = pipelineCache.createComputePipeline(pipelineInfo, mPipeline, "downsample");
+	vkDestroyShaderModule(mDevice, shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		mPipeline = VK_NULL_HANDLE;
+		return false;
+	}
+
+	return true;
+}
+
+VkFormat MipGenerator::storageFormat(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	default:
+		return VK_FORMAT_UNDEFINED;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "PipelineCache.h"
+
+// Builds texture mip chains on the GPU.
+// Blits when the format can be linearly filtered, otherwise a compute downsampler
+// that box-filters through RGBA8 UNORM storage views (with sRGB handled in the shader).
+class MipGenerator
+{
+public:
+	enum class Method
+	{
+		None,
+		Blit,
+		Compute
+	};
+
+	MipGenerator() = default;
+
+	// The compute path is only available if the SPIR-V at computeShaderPath loads. sRGB formats have no storage
+	// support, so computing their chains also needs extendedUsage (VK_KHR_maintenance2 enabled on the device).
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& computeShaderPath, PipelineCache& pipelineCache,
+		bool extendedUsage);
+	void cleanUp();
+
+	Method chooseMethod(VkFormat format) const;
+
+	// What the image must be created with for the method
+	VkImageUsageFlags imageUsage(Method method) const;
+	VkImageCreateFlags imageFlags(Method method) const;
+	// Usage to restrict the sampled view to through VkImageViewUsageCreateInfoKHR, 0 to inherit the image's
+	VkImageUsageFlags viewUsage(Method method) const;
+
+	// Layout, stage and access every level must be in, with level 0 filled, before generate()
+	VkImageLayout inputLayout(Method method) const;
+	VkPipelineStageFlags inputStage(Method method) const;
+	VkAccessFlags inputAccess(Method method) const;
+
+	// Records the chain; every level ends in SHADER_READ_ONLY_OPTIMAL for fragment shader reads.
+	// Compute resources are kept until cleanUp(), so the commands may still be in flight.
+	void generate(VkCommandBuffer commandBuffer, Method method, VkImage image, VkFormat format,
+		uint32_t width, uint32_t height, uint32_t mipLevels);
+
+	static uint32_t mipLevelCount(uint32_t width, uint32_t height);
+private:
+	void generateBlit(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels);
+	void generateCompute(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels);
+	bool createComputePipeline(const std::string& computeShaderPath, PipelineCache& pipelineCache);
+
+	// Storage-compatible view format of a texture format, UNDEFINED if the shader cannot handle it
+	static VkFormat storageFormat(VkFormat format);
+private:
+	VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
+	VkDevice mDevice = VK_NULL_HANDLE;
+	bool mExtendedUsage = false;
+
+	VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline mPipeline = VK_NULL_HANDLE;
+
+	std::vector<VkDescriptorPool> mDescriptorPools;
+	std::vector<VkImageView> mImageViews;
+};
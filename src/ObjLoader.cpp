@@ -0,0 +1,659 @@
+#include "ObjLoader.h"
+#include "MappedFile.h"
+
+// Only used as the reference in runBenchmark
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <cmath>
+
+// Every worker gets several chunks so dense and sparse regions of the file even out
+const size_t OBJ_MIN_CHUNK_SIZE = 256 * 1024;
+const uint32_t OBJ_CHUNKS_PER_THREAD = 4;
+const int32_t OBJ_MISSING_INDEX = INT32_MIN;
+
+namespace
+{
+	enum : uint8_t
+	{
+		RELATIVE_POSITION = 1,
+		RELATIVE_TEXCOORD = 2,
+		RELATIVE_NORMAL = 4
+	};
+
+	// Face corner as written: 0-based absolute, chunk-relative (negative OBJ indices) or missing
+	struct ObjCorner
+	{
+		int32_t position;
+		int32_t texCoord;
+		int32_t normal;
+		uint8_t relativeMask;
+	};
+
+	struct ObjChunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> texCoords;
+		std::vector<glm::vec3> normals;
+		std::vector<ObjCorner> corners; // Already fanned into a triangle list
+		// usemtl records: the corner they take effect at and the material they select
+		std::vector<std::pair<size_t, uint32_t>> materialStarts;
+		const std::vector<std::string>* materialNames = nullptr;
+		uint32_t firstMaterial = 0; // Active when the chunk starts
+
+		// Totals over the preceding chunks
+		size_t positionBase = 0;
+		size_t texCoordBase = 0;
+		size_t normalBase = 0;
+		size_t cornerBase = 0;
+
+		size_t lineCount = 0;
+		size_t errorLine = 0; // 1-based within the chunk, 0 if the chunk parsed cleanly
+		const char* error = nullptr;
+	};
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline bool isTokenEnd(const char* p, const char* end)
+	{
+		return p == end || isSpace(*p);
+	}
+
+	inline const char* skipSpaces(const char* p, const char* end)
+	{
+		while (p < end && isSpace(*p)) p++;
+		return p;
+	}
+
+	// Decimal float parser without the locale and stream overhead of strtod/istream
+	bool parseFloat(const char*& p, const char* end, float& value)
+	{
+		static const double powers[] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		const char* s = p;
+		bool negative = false;
+
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			negative = *s == '-';
+			s++;
+		}
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int significantDigits = 0;
+		bool anyDigits = false;
+
+		for (; s < end && isDigit(*s); s++)
+		{
+			anyDigits = true;
+
+			if (significantDigits < 19)
+			{
+				mantissa = mantissa * 10 + (*s - '0');
+				if (mantissa != 0) significantDigits++;
+			}
+			else
+			{
+				exponent++;
+			}
+		}
+
+		if (s < end && *s == '.')
+		{
+			for (s++; s < end && isDigit(*s); s++)
+			{
+				anyDigits = true;
+
+				if (significantDigits < 19)
+				{
+					mantissa = mantissa * 10 + (*s - '0');
+					if (mantissa != 0) significantDigits++;
+					exponent--;
+				}
+			}
+		}
+
+		if (!anyDigits) return false;
+
+		if (s < end && (*s == 'e' || *s == 'E'))
+		{
+			const char* e = s + 1;
+			bool negativeExponent = false;
+
+			if (e < end && (*e == '-' || *e == '+'))
+			{
+				negativeExponent = *e == '-';
+				e++;
+			}
+
+			if (e < end && isDigit(*e))
+			{
+				int written = 0;
+
+				for (; e < end && isDigit(*e); e++)
+				{
+					if (written < 10000) written = written * 10 + (*e - '0');
+				}
+
+				exponent += negativeExponent ? -written : written;
+				s = e;
+			}
+		}
+
+		double result = static_cast<double>(mantissa);
+
+		if (exponent < 0) result = exponent >= -22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+		else if (exponent > 0) result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+
+		value = static_cast<float>(negative ? -result : result);
+		p = s;
+
+		return isTokenEnd(p, end);
+	}
+
+	bool parseIndex(const char*& p, const char* end, int32_t& value)
+	{
+		const char* s = p;
+		bool negative = false;
+
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			negative = *s == '-';
+			s++;
+		}
+
+		if (s == end || !isDigit(*s)) return false;
+
+		int64_t result = 0;
+
+		for (; s < end && isDigit(*s); s++)
+		{
+			result = result * 10 + (*s - '0');
+			if (result > INT32_MAX) return false;
+		}
+
+		value = static_cast<int32_t>(negative ? -result : result);
+		p = s;
+
+		return true;
+	}
+
+	// OBJ indices are 1-based; negative ones count back from the last element defined so far
+	bool resolveLocalIndex(int32_t value, size_t localCount, uint8_t relativeBit, int32_t& index, uint8_t& relativeMask)
+	{
+		if (value > 0)
+		{
+			index = value - 1;
+		}
+		else if (value < 0)
+		{
+			index = static_cast<int32_t>(localCount) + value;
+			relativeMask |= relativeBit;
+		}
+		else
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	template<int N>
+	bool parseVector(const char* p, const char* end, int required, float* values)
+	{
+		for (int i = 0; i < N; i++)
+		{
+			p = skipSpaces(p, end);
+
+			if (p == end)
+			{
+				// Optional trailing components default to zero
+				if (i < required) return false;
+				values[i] = 0.0f;
+				continue;
+			}
+
+			if (!parseFloat(p, end, values[i])) return false;
+		}
+
+		return true;
+	}
+
+	bool parseFace(ObjChunk& chunk, const char* p, const char* end, std::vector<ObjCorner>& polygon)
+	{
+		polygon.clear();
+
+		for (p = skipSpaces(p, end); p < end; p = skipSpaces(p, end))
+		{
+			ObjCorner corner{ OBJ_MISSING_INDEX, OBJ_MISSING_INDEX, OBJ_MISSING_INDEX, 0 };
+			int32_t value;
+
+			if (!parseIndex(p, end, value) ||
+				!resolveLocalIndex(value, chunk.positions.size(), RELATIVE_POSITION, corner.position, corner.relativeMask))
+			{
+				return false;
+			}
+
+			// v, v/vt, v//vn or v/vt/vn
+			if (p < end && *p == '/')
+			{
+				p++;
+
+				if (p < end && *p != '/')
+				{
+					if (!parseIndex(p, end, value) ||
+						!resolveLocalIndex(value, chunk.texCoords.size(), RELATIVE_TEXCOORD, corner.texCoord, corner.relativeMask))
+					{
+						return false;
+					}
+				}
+
+				if (p < end && *p == '/')
+				{
+					p++;
+
+					if (!parseIndex(p, end, value) ||
+						!resolveLocalIndex(value, chunk.normals.size(), RELATIVE_NORMAL, corner.normal, corner.relativeMask))
+					{
+						return false;
+					}
+				}
+			}
+
+			if (!isTokenEnd(p, end)) return false;
+
+			polygon.push_back(corner);
+		}
+
+		if (polygon.size() < 3) return false;
+
+		// Fan triangulation, which matches the polygon for the convex faces exporters write
+		for (size_t i = 1; i + 1 < polygon.size(); i++)
+		{
+			chunk.corners.push_back(polygon[0]);
+			chunk.corners.push_back(polygon[i]);
+			chunk.corners.push_back(polygon[i + 1]);
+		}
+
+		return true;
+	}
+
+	bool parseLine(ObjChunk& chunk, const char* p, const char* end, std::vector<ObjCorner>& polygon)
+	{
+		if (end > p && end[-1] == '\r') end--;
+
+		p = skipSpaces(p, end);
+		if (p == end) return true;
+
+		float values[3];
+
+		if (p[0] == 'v' && p + 1 < end)
+		{
+			if (isSpace(p[1]))
+			{
+				chunk.error = "vertex position";
+				if (!parseVector<3>(p + 1, end, 3, values)) return false;
+				chunk.positions.emplace_back(values[0], values[1], values[2]);
+			}
+			else if (p[1] == 't' && isTokenEnd(p + 2, end))
+			{
+				chunk.error = "texture coordinate";
+				if (!parseVector<2>(p + 2, end, 1, values)) return false;
+				chunk.texCoords.emplace_back(values[0], values[1]);
+			}
+			else if (p[1] == 'n' && isTokenEnd(p + 2, end))
+			{
+				chunk.error = "vertex normal";
+				if (!parseVector<3>(p + 2, end, 3, values)) return false;
+				chunk.normals.emplace_back(values[0], values[1], values[2]);
+			}
+		}
+		else if (p[0] == 'f' && p + 1 < end && isSpace(p[1]))
+		{
+			chunk.error = "face";
+			if (!parseFace(chunk, p + 1, end, polygon)) return false;
+		}
+
+		else if (end - p > 6 && std::memcmp(p, "usemtl", 6) == 0 && isSpace(p[6]))
+		{
+			// Unknown names select the default material, like faces before any usemtl
+			const char* nameEnd = end;
+			while (nameEnd > p && isSpace(nameEnd[-1])) nameEnd--;
+			std::string name(skipSpaces(p + 6, nameEnd), nameEnd);
+
+			const std::vector<std::string>& names = *chunk.materialNames;
+			auto found = std::find(names.begin(), names.end(), name);
+			uint32_t material = found != names.end() ? static_cast<uint32_t>(found - names.begin()) : 0;
+
+			chunk.materialStarts.emplace_back(chunk.corners.size(), material);
+		}
+
+		// Groups, smoothing groups, material libraries and comments do not affect the vertex stream
+		chunk.error = nullptr;
+		return true;
+	}
+
+	void parseChunk(ObjChunk& chunk)
+	{
+		std::vector<ObjCorner> polygon;
+		const char* p = chunk.begin;
+
+		while (p < chunk.end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+			if (lineEnd == nullptr) lineEnd = chunk.end;
+
+			chunk.lineCount++;
+
+			if (!parseLine(chunk, p, lineEnd, polygon))
+			{
+				chunk.errorLine = chunk.lineCount;
+				return;
+			}
+
+			p = lineEnd < chunk.end ? lineEnd + 1 : chunk.end;
+		}
+	}
+
+	bool resolveGlobalIndex(int32_t index, bool relative, size_t base, size_t count, size_t& resolved)
+	{
+		int64_t absolute = relative ? static_cast<int64_t>(base) + index : index;
+		if (absolute < 0 || absolute >= static_cast<int64_t>(count)) return false;
+
+		resolved = static_cast<size_t>(absolute);
+		return true;
+	}
+}
+
+namespace ObjLoader
+{
+	void load(const uint8_t* data, size_t size, ThreadPool& pool, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		const std::vector<std::string>& materialNames)
+	{
+		const char* text = reinterpret_cast<const char*>(data);
+		const char* textEnd = text + size;
+
+		size_t chunkSize = std::max(OBJ_MIN_CHUNK_SIZE, size / (pool.getThreadCount() * OBJ_CHUNKS_PER_THREAD) + 1);
+
+		// Split on line boundaries so every record is parsed by exactly one chunk
+		std::vector<ObjChunk> chunks;
+
+		for (const char* begin = text; begin < textEnd;)
+		{
+			const char* split = begin + std::min(chunkSize, static_cast<size_t>(textEnd - begin));
+
+			if (split < textEnd)
+			{
+				const char* newline = static_cast<const char*>(std::memchr(split, '\n', textEnd - split));
+				split = newline ? newline + 1 : textEnd;
+			}
+
+			chunks.emplace_back();
+			chunks.back().begin = begin;
+			chunks.back().end = split;
+			chunks.back().materialNames = &materialNames;
+
+			begin = split;
+		}
+
+		pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&chunks](uint32_t i) { parseChunk(chunks[i]); });
+
+		size_t lineBase = 0;
+
+		for (const auto& chunk : chunks)
+		{
+			if (chunk.errorLine != 0)
+			{
+				throw std::runtime_error("Failed to parse OBJ " + std::string(chunk.error) + " on line " + std::to_string(lineBase + chunk.errorLine) + "!");
+			}
+
+			lineBase += chunk.lineCount;
+		}
+
+		// Chunk results are concatenated in file order, so the output does not depend on the thread count
+		size_t positionCount = 0, texCoordCount = 0, normalCount = 0, cornerCount = 0;
+		uint32_t material = 0;
+
+		for (auto& chunk : chunks)
+		{
+			chunk.positionBase = positionCount;
+			chunk.texCoordBase = texCoordCount;
+			chunk.normalBase = normalCount;
+			chunk.cornerBase = cornerCount;
+			chunk.firstMaterial = material;
+
+			if (!chunk.materialStarts.empty()) material = chunk.materialStarts.back().second;
+
+			positionCount += chunk.positions.size();
+			texCoordCount += chunk.texCoords.size();
+			normalCount += chunk.normals.size();
+			cornerCount += chunk.corners.size();
+		}
+
+		if (cornerCount > UINT32_MAX)
+		{
+			throw std::runtime_error("Failed to load OBJ: too many face corners for 32 bit indices!");
+		}
+
+		std::vector<glm::vec3> positions(positionCount);
+		std::vector<glm::vec2> texCoords(texCoordCount);
+		std::vector<glm::vec3> normals(normalCount);
+
+		pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i)
+		{
+			ObjChunk& chunk = chunks[i];
+
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + chunk.texCoordBase);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase);
+		});
+
+		vertices.resize(cornerCount);
+		indices.resize(cornerCount);
+
+		pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i)
+		{
+			ObjChunk& chunk = chunks[i];
+			chunk.error = nullptr;
+
+			uint32_t material = chunk.firstMaterial;
+			size_t nextMaterialStart = 0;
+
+			for (size_t c = 0; c < chunk.corners.size(); c++)
+			{
+				const ObjCorner& corner = chunk.corners[c];
+				Vertex& vertex = vertices[chunk.cornerBase + c];
+				size_t index;
+
+				while (nextMaterialStart < chunk.materialStarts.size() && chunk.materialStarts[nextMaterialStart].first <= c)
+				{
+					material = chunk.materialStarts[nextMaterialStart++].second;
+				}
+
+				if (!resolveGlobalIndex(corner.position, corner.relativeMask & RELATIVE_POSITION, chunk.positionBase, positionCount, index))
+				{
+					chunk.error = "position index";
+					return;
+				}
+
+				vertex.pos = positions[index];
+				vertex.normal = glm::vec3(0.0f);
+				vertex.texCoord = glm::vec2(0.0f);
+				vertex.material = material;
+
+				if (corner.normal != OBJ_MISSING_INDEX)
+				{
+					if (!resolveGlobalIndex(corner.normal, corner.relativeMask & RELATIVE_NORMAL, chunk.normalBase, normalCount, index))
+					{
+						chunk.error = "normal index";
+						return;
+					}
+
+					vertex.normal = normals[index];
+				}
+
+				if (corner.texCoord != OBJ_MISSING_INDEX)
+				{
+					if (!resolveGlobalIndex(corner.texCoord, corner.relativeMask & RELATIVE_TEXCOORD, chunk.texCoordBase, texCoordCount, index))
+					{
+						chunk.error = "texture coordinate index";
+						return;
+					}
+
+					// OBJ puts v = 0 at the bottom of the image, Vulkan samples row 0 at the top
+					vertex.texCoord = glm::vec2(texCoords[index].x, 1.0f - texCoords[index].y);
+				}
+
+				indices[chunk.cornerBase + c] = static_cast<uint32_t>(chunk.cornerBase + c);
+			}
+		});
+
+		for (const auto& chunk : chunks)
+		{
+			if (chunk.error)
+			{
+				throw std::runtime_error("Failed to resolve OBJ " + std::string(chunk.error) + ", it is out of range!");
+			}
+		}
+	}
+
+	void loadFile(const std::string& path, ThreadPool& pool, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		const std::vector<std::string>& materialNames)
+	{
+		MappedFile file;
+		if (!file.open(path))
+		{
+			throw std::runtime_error("Failed to open " + path + "!");
+		}
+
+		load(file.data(), file.size(), pool, vertices, indices, materialNames);
+	}
+
+	bool runBenchmark(const std::string& path)
+	{
+		MappedFile file;
+		if (!file.open(path))
+		{
+			std::cerr << "Failed to open " << path << std::endl;
+			return false;
+		}
+
+		double megabytes = file.size() / (1024.0 * 1024.0);
+		std::cout << path << ": " << megabytes << " MB" << std::endl;
+
+		// Reference: the tinyobj path loadModel used before, flattened the same way
+		std::vector<Vertex> reference;
+
+		auto tinyStart = std::chrono::high_resolution_clock::now();
+		{
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+			std::string war, err;
+
+			if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &war, &err, path.c_str()))
+			{
+				std::cerr << war << err << std::endl;
+				return false;
+			}
+
+			for (const auto& shape : shapes)
+			{
+				for (const auto& index : shape.mesh.indices)
+				{
+					Vertex vertex{};
+					vertex.pos = { attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1], attrib.vertices[3 * index.vertex_index + 2] };
+
+					if (index.normal_index >= 0)
+					{
+						vertex.normal = { attrib.normals[3 * index.normal_index + 0], attrib.normals[3 * index.normal_index + 1], attrib.normals[3 * index.normal_index + 2] };
+					}
+
+					if (index.texcoord_index >= 0)
+					{
+						vertex.texCoord = { attrib.texcoords[2 * index.texcoord_index + 0], 1.0f - attrib.texcoords[2 * index.texcoord_index + 1] };
+					}
+
+					reference.push_back(vertex);
+				}
+			}
+		}
+		auto tinyEnd = std::chrono::high_resolution_clock::now();
+
+		double tinySeconds = std::chrono::duration<double>(tinyEnd - tinyStart).count();
+		std::cout << "  tinyobj:     " << megabytes / tinySeconds << " MB/s (" << tinySeconds * 1000.0 << " ms)" << std::endl;
+
+		bool matches = true;
+		const uint32_t threadCounts[] = { 1, 2, 4, 8 };
+
+		for (uint32_t threadCount : threadCounts)
+		{
+			ThreadPool pool(threadCount);
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			try
+			{
+				load(file.data(), file.size(), pool, vertices, indices);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << e.what() << std::endl;
+				return false;
+			}
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			double seconds = std::chrono::duration<double>(end - start).count();
+			std::cout << "  ObjLoader x" << threadCount << ": " << megabytes / seconds << " MB/s (" << seconds * 1000.0
+				<< " ms, " << tinySeconds / seconds << "x)" << std::endl;
+
+			// Both parsers round decimal text to float independently, so allow a few ulps of difference
+			float maxError = 0.0f;
+			bool sameCount = vertices.size() == reference.size();
+
+			for (size_t i = 0; sameCount && i < vertices.size(); i++)
+			{
+				const float* a = reinterpret_cast<const float*>(&vertices[i]);
+				const float* b = reinterpret_cast<const float*>(&reference[i]);
+
+				for (size_t k = 0; k < sizeof(Vertex) / sizeof(float); k++)
+				{
+					maxError = std::max(maxError, std::fabs(a[k] - b[k]) / std::max(1.0f, std::fabs(b[k])));
+				}
+			}
+
+			if (!sameCount || maxError > 1e-5f)
+			{
+				std::cout << "  mismatch: " << vertices.size() << " vs " << reference.size() << " corners, max relative error " << maxError << std::endl;
+				matches = false;
+			}
+		}
+
+		return matches;
+	}
+}
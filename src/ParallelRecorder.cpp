@@ -0,0 +1,114 @@
+#include "ParallelRecorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+
+void ParallelRecorder::init(VkDevice device, uint32_t queueFamily, uint32_t frameCount, uint32_t jobCount)
+{
+	mDevice = device;
+	mJobCount = std::max(1u, jobCount);
+	mFrames.resize(frameCount);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Reset as a whole every frame
+
+	for (auto& frame : mFrames)
+	{
+		frame.pools.resize(mJobCount);
+		frame.commandBuffers.resize(mJobCount);
+
+		for (uint32_t i = 0; i < mJobCount; i++)
+		{
+			if (vkCreateCommandPool(mDevice, &poolInfo, nullptr, &frame.pools[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create secondary command pool!");
+			}
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = frame.pools[i];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers(mDevice, &allocInfo, &frame.commandBuffers[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate secondary command buffer!");
+			}
+		}
+	}
+}
+
+void ParallelRecorder::cleanUp()
+{
+	// Destroying a pool frees its command buffers
+	for (auto& frame : mFrames)
+	{
+		for (auto pool : frame.pools) vkDestroyCommandPool(mDevice, pool, nullptr);
+	}
+
+	mFrames.clear();
+}
+
+const std::vector<VkCommandBuffer>& ParallelRecorder::record(ThreadPool& pool, uint32_t frame, uint32_t drawCount,
+	const VkCommandBufferInheritanceInfo& inheritance, const RecordRange& recordRange)
+{
+	FrameData& data = mFrames[frame];
+
+	// Fewer draws than jobs leaves no job empty
+	uint32_t jobCount = std::max(1u, std::min(mJobCount, drawCount));
+	data.recorded.assign(data.commandBuffers.begin(), data.commandBuffers.begin() + jobCount);
+
+	// Exceptions must not escape a worker thread, failures are reported once every job is done
+	std::atomic<bool> failed(false);
+	std::mutex errorMutex;
+	std::exception_ptr error;
+
+	pool.parallelFor(jobCount, [&](uint32_t job)
+	{
+		try
+		{
+			if (!recordJob(data, job, jobCount, drawCount, inheritance, recordRange)) failed = true;
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error) error = std::current_exception();
+			failed = true;
+		}
+	});
+
+	// The first exception a job threw wins over the generic failure
+	if (error) std::rethrow_exception(error);
+
+	if (failed)
+	{
+		throw std::runtime_error("Failed to record secondary command buffers!");
+	}
+
+	return data.recorded;
+}
+
+bool ParallelRecorder::recordJob(FrameData& data, uint32_t job, uint32_t jobCount, uint32_t drawCount,
+	const VkCommandBufferInheritanceInfo& inheritance, const RecordRange& recordRange)
+{
+	vkResetCommandPool(mDevice, data.pools[job], 0);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritance;
+
+	VkCommandBuffer commandBuffer = data.commandBuffers[job];
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) return false;
+
+	uint32_t firstDraw = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * job / jobCount);
+	uint32_t endDraw = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * (job + 1) / jobCount);
+	recordRange(commandBuffer, firstDraw, endDraw);
+
+	return vkEndCommandBuffer(commandBuffer) == VK_SUCCESS;
+}
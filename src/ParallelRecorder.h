@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+#include "ThreadPool.h"
+
+// Records a render pass's draws into secondary command buffers across a thread pool.
+// Every job slot owns one transient command pool per frame in flight, so no pool is ever touched by two
+// threads at once and a frame's pools are reset in one call once its fence has been waited on.
+class ParallelRecorder
+{
+public:
+	ParallelRecorder() = default;
+
+	ParallelRecorder(const ParallelRecorder&) = delete;
+	ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+	// jobCount is the most secondary command buffers a frame is split into
+	void init(VkDevice device, uint32_t queueFamily, uint32_t frameCount, uint32_t jobCount);
+	void cleanUp();
+
+	// Splits [0, drawCount) into contiguous ranges, one per job, and records each with recordRange on the pool.
+	// The frame's previous command buffers must have finished executing. Returns the buffers to execute, in draw order.
+	// An exception thrown by recordRange is rethrown here once every job is done.
+	using RecordRange = std::function<void(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t endDraw)>;
+	const std::vector<VkCommandBuffer>& record(ThreadPool& pool, uint32_t frame, uint32_t drawCount,
+		const VkCommandBufferInheritanceInfo& inheritance, const RecordRange& recordRange);
+
+	uint32_t jobCount() const { return mJobCount; }
+private:
+	struct FrameData
+	{
+		std::vector<VkCommandPool> pools;
+		std::vector<VkCommandBuffer> commandBuffers;
+		std::vector<VkCommandBuffer> recorded;
+	};
+
+	// Records one job's range, false when Vulkan fails; exceptions from recordRange pass through
+	bool recordJob(FrameData& data, uint32_t job, uint32_t jobCount, uint32_t drawCount,
+		const VkCommandBufferInheritanceInfo& inheritance, const RecordRange& recordRange);
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	uint32_t mJobCount = 0;
+	std::vector<FrameData> mFrames;
+};
@@ -0,0 +1,212 @@
+#include "PipelineCache.h"
+
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+#include "MeshCache.h"
+
+const char PIPELINE_CACHE_MAGIC[8] = { 'V', 'K', 'S', 'P', 'I', 'P', 'E', '\0' };
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+// Size of VkPipelineCacheHeaderVersionOne at the start of the driver's blob
+const size_t VULKAN_CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path, bool creationFeedback)
+{
+	mDevice = device;
+	mPath = path;
+	mCreationFeedback = creationFeedback;
+
+	vkGetPhysicalDeviceProperties(physicalDevice, &mProperties);
+
+	std::vector<uint8_t> data;
+	mLoaded = load(data);
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(mDevice, &createInfo, nullptr, &mCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create pipeline cache!");
+	}
+
+	if (mLoaded)
+	{
+		std::cerr << "Pipeline cache: loaded " << data.size() / 1024 << " KiB from " << mPath << std::endl;
+	}
+	else
+	{
+		std::cerr << "Pipeline cache: starting empty, no usable cache at " << mPath << std::endl;
+	}
+}
+
+void PipelineCache::cleanUp()
+{
+	if (mCache == VK_NULL_HANDLE) return;
+
+	if (!save())
+	{
+		std::cerr << "Failed to write pipeline cache to " << mPath << std::endl;
+	}
+
+	vkDestroyPipelineCache(mDevice, mCache, nullptr);
+	mCache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::load(std::vector<uint8_t>& data)
+{
+	std::ifstream file(mPath, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) return false;
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize < sizeof(PipelineCacheFileHeader) + VULKAN_CACHE_HEADER_SIZE) return false;
+
+	PipelineCacheFileHeader header;
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	// A cache from another GPU or driver version is useless at best, so start over
+	bool valid = std::memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC)) == 0 &&
+		header.version == PIPELINE_CACHE_VERSION &&
+		header.vendorID == mProperties.vendorID &&
+		header.deviceID == mProperties.deviceID &&
+		header.driverVersion == mProperties.driverVersion &&
+		std::memcmp(header.pipelineCacheUUID, mProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+		header.dataSize == fileSize - sizeof(header);
+
+	if (!valid) return false;
+
+	data.resize(static_cast<size_t>(header.dataSize));
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+
+	if (!file.good() || MeshCache::hashData(data.data(), data.size()) != header.dataHash)
+	{
+		data.clear();
+		return false;
+	}
+
+	// The blob starts with its own header, which must agree with ours
+	uint32_t blobHeader[4];
+	std::memcpy(blobHeader, data.data(), sizeof(blobHeader));
+
+	valid = blobHeader[0] >= VULKAN_CACHE_HEADER_SIZE &&
+		blobHeader[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		blobHeader[2] == mProperties.vendorID &&
+		blobHeader[3] == mProperties.deviceID &&
+		std::memcmp(data.data() + 16, mProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+	if (!valid) data.clear();
+	return valid;
+}
+
+bool PipelineCache::save()
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(mDevice, mCache, &dataSize, nullptr) != VK_SUCCESS) return false;
+
+	std::vector<uint8_t> data(dataSize);
+	if (vkGetPipelineCacheData(mDevice, mCache, &dataSize, data.data()) != VK_SUCCESS) return false;
+	data.resize(dataSize);
+
+	PipelineCacheFileHeader header{};
+	std::memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC));
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendorID = mProperties.vendorID;
+	header.deviceID = mProperties.deviceID;
+	header.driverVersion = mProperties.driverVersion;
+	std::memcpy(header.pipelineCacheUUID, mProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.dataHash = MeshCache::hashData(data.data(), data.size());
+
+	// Write next to the target and rename, so a crash never leaves a torn cache behind
+	std::string tempPath = mPath + ".tmp";
+
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+		if (!file.good()) return false;
+	}
+
+#ifdef _WIN32
+	std::remove(mPath.c_str());
+#endif
+
+	if (std::rename(tempPath.c_str(), mPath.c_str()) != 0) return false;
+
+	std::cerr << "Pipeline cache: wrote " << data.size() / 1024 << " KiB to " << mPath << std::endl;
+	return true;
+}
+
+VkResult PipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline, const char* name)
+{
+	VkPipelineCreationFeedbackEXT feedback{};
+
+	VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+	feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+	feedbackInfo.pNext = createInfo.pNext;
+	feedbackInfo.pPipelineCreationFeedback = &feedback;
+
+	VkGraphicsPipelineCreateInfo info = createInfo;
+	if (mCreationFeedback) info.pNext = &feedbackInfo;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(mDevice, mCache, 1, &info, nullptr, &pipeline);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (result == VK_SUCCESS) record(name, milliseconds, feedback);
+	return result;
+}
+
+VkResult PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline, const char* name)
+{
+	VkPipelineCreationFeedbackEXT feedback{};
+
+	VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+	feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+	feedbackInfo.pNext = createInfo.pNext;
+	feedbackInfo.pPipelineCreationFeedback = &feedback;
+
+	VkComputePipelineCreateInfo info = createInfo;
+	if (mCreationFeedback) info.pNext = &feedbackInfo;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateComputePipelines(mDevice, mCache, 1, &info, nullptr, &pipeline);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (result == VK_SUCCESS) record(name, milliseconds, feedback);
+	return result;
+}
+
+void PipelineCache::record(const char* name, double milliseconds, const VkPipelineCreationFeedbackEXT& feedback)
+{
+	bool reported = (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) != 0;
+	bool hit = reported ? (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) != 0 : mLoaded;
+
+	if (hit)
+	{
+		mHitCount++;
+		mHitTime += milliseconds;
+	}
+	else
+	{
+		mMissCount++;
+		mMissTime += milliseconds;
+	}
+
+	std::cerr << "Pipeline " << name << ": " << milliseconds << " ms, cache " << (hit ? "hit" : "miss")
+		<< (reported ? "" : " (assumed)") << std::endl;
+}
+
+void PipelineCache::dumpStats(std::ostream& out) const
+{
+	out << "Pipeline cache: " << mHitCount << " hits in " << mHitTime << " ms, "
+		<< mMissCount << " misses in " << mMissTime << " ms" << std::endl;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+// On-disk header in front of the driver's cache blob
+struct PipelineCacheFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+static_assert(sizeof(PipelineCacheFileHeader) == 56, "Pipeline cache header must stay 56 bytes");
+
+// VkPipelineCache that is seeded from disk and written back on shutdown.
+// Every pipeline created through it is timed and counted as a cache hit or miss.
+class PipelineCache
+{
+public:
+	PipelineCache() = default;
+
+	// The file is only used if this exact device and driver wrote it.
+	// With creation feedback (VK_EXT_pipeline_creation_feedback) hits are reported by the driver,
+	// otherwise every pipeline counts as a hit when the cache was loaded and a miss when it started empty.
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path, bool creationFeedback);
+
+	// Writes the cache back and destroys it
+	void cleanUp();
+
+	// Atomically replaces the file with the current cache contents
+	bool save();
+
+	VkPipelineCache handle() const { return mCache; }
+
+	VkResult createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline, const char* name);
+	VkResult createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline, const char* name);
+
+	void dumpStats(std::ostream& out) const;
+private:
+	bool load(std::vector<uint8_t>& data);
+	void record(const char* name, double milliseconds, const VkPipelineCreationFeedbackEXT& feedback);
+private:
+	VkDevice mDevice = VK_NULL_HANDLE;
+	VkPipelineCache mCache = VK_NULL_HANDLE;
+	std::string mPath;
+
+	VkPhysicalDeviceProperties mProperties{};
+	bool mCreationFeedback = false;
+	bool mLoaded = false;
+
+	uint32_t mHitCount = 0;
+	uint32_t mMissCount = 0;
+	double mHitTime = 0.0;
+	double mMissTime = 0.0;
+};
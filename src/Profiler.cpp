@@ -0,0 +1,313 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+// Per frame slot; scopes past this are dropped and counted
+const uint32_t MAX_GPU_SCOPES = 32;
+// Bounds trace memory on long runs, later events are dropped
+const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+const VkQueryPipelineStatisticFlags PIPELINE_STATISTICS_FLAGS =
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+// Results come back in flag bit order, matching PipelineStatistics
+const uint32_t PIPELINE_STATISTICS_COUNT = 5;
+
+static_assert(sizeof(PipelineStatistics) == PIPELINE_STATISTICS_COUNT * sizeof(uint64_t), "PipelineStatistics must match the query layout");
+
+void Profiler::enable(const std::string& tracePath)
+{
+	mEnabled = true;
+	mTracePath = tracePath;
+	mStart = std::chrono::high_resolution_clock::now();
+}
+
+void Profiler::initGpu(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameCount, bool pipelineStatistics)
+{
+	if (!mEnabled) return;
+
+	mDevice = device;
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+	if (validBits == 0)
+	{
+		std::cerr << "Profiler: queue family " << queueFamily << " has no timestamps, GPU scopes disabled" << std::endl;
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	mTimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+	mTimestampPeriodUs = properties.limits.timestampPeriod / 1000.0;
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = frameCount * MAX_GPU_SCOPES * 2;
+
+	if (vkCreateQueryPool(mDevice, &poolInfo, nullptr, &mTimestampPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timestamp query pool!");
+	}
+
+	if (pipelineStatistics)
+	{
+		poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		poolInfo.queryCount = frameCount * MAX_GPU_SCOPES;
+		poolInfo.pipelineStatistics = PIPELINE_STATISTICS_FLAGS;
+
+		if (vkCreateQueryPool(mDevice, &poolInfo, nullptr, &mStatisticsPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create pipeline statistics query pool!");
+		}
+	}
+
+	mSlots.resize(frameCount);
+	mGpuEnabled = true;
+}
+
+void Profiler::cleanUp()
+{
+	if (!mEnabled) return;
+
+	if (mDroppedScopes > 0)
+	{
+		std::cerr << "Profiler: dropped " << mDroppedScopes << " GPU scopes over the per-frame limit" << std::endl;
+	}
+
+	// Without a path the profiler only collects frame times
+	if (!mTracePath.empty())
+	{
+		if (writeChromeTrace(mTracePath))
+		{
+			std::cerr << "Profiler: wrote " << mCpuEvents.size() << " CPU and " << mGpuEvents.size() << " GPU events to " << mTracePath << std::endl;
+		}
+		else
+		{
+			std::cerr << "Failed to write trace to " << mTracePath << std::endl;
+		}
+	}
+
+	if (mTimestampPool != VK_NULL_HANDLE) vkDestroyQueryPool(mDevice, mTimestampPool, nullptr);
+	if (mStatisticsPool != VK_NULL_HANDLE) vkDestroyQueryPool(mDevice, mStatisticsPool, nullptr);
+
+	mTimestampPool = VK_NULL_HANDLE;
+	mStatisticsPool = VK_NULL_HANDLE;
+	mGpuEnabled = false;
+	mEnabled = false;
+}
+
+double Profiler::sinceStartUs(std::chrono::high_resolution_clock::time_point time) const
+{
+	return std::chrono::duration<double, std::micro>(time - mStart).count();
+}
+
+uint32_t Profiler::threadIndex()
+{
+	size_t id = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+	for (const auto& thread : mThreads)
+	{
+		if (thread.first == id) return thread.second;
+	}
+
+	mThreads.emplace_back(id, static_cast<uint32_t>(mThreads.size() + 1));
+	return mThreads.back().second;
+}
+
+void Profiler::recordCpuScope(const char* name, std::chrono::high_resolution_clock::time_point start,
+	std::chrono::high_resolution_clock::time_point end)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (mCpuEvents.size() >= MAX_TRACE_EVENTS) return;
+
+	double startUs = sinceStartUs(start);
+	mCpuEvents.push_back({ name, startUs, sinceStartUs(end) - startUs, threadIndex() });
+}
+
+void Profiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if (!mGpuEnabled) return;
+
+	mCurrentSlot = frame;
+	FrameSlot& slot = mSlots[frame];
+
+	// The fence of this slot's last submission was waited on, its queries are available
+	resolve(slot, frame);
+
+	slot.scopes.clear();
+	slot.statisticsCount = 0;
+	slot.cpuStartUs = sinceStartUs(std::chrono::high_resolution_clock::now());
+
+	vkCmdResetQueryPool(commandBuffer, mTimestampPool, frame * MAX_GPU_SCOPES * 2, MAX_GPU_SCOPES * 2);
+	if (mStatisticsPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, mStatisticsPool, frame * MAX_GPU_SCOPES, MAX_GPU_SCOPES);
+	}
+}
+
+void Profiler::beginGpuScope(VkCommandBuffer commandBuffer, const char* name, bool statistics)
+{
+	if (!mGpuEnabled) return;
+
+	FrameSlot& slot = mSlots[mCurrentSlot];
+	mScopeOpen = slot.scopes.size() < MAX_GPU_SCOPES;
+
+	if (!mScopeOpen)
+	{
+		mDroppedScopes++;
+		return;
+	}
+
+	statistics = statistics && mStatisticsPool != VK_NULL_HANDLE;
+
+	uint32_t query = mCurrentSlot * MAX_GPU_SCOPES + static_cast<uint32_t>(slot.scopes.size());
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mTimestampPool, query * 2);
+
+	if (statistics)
+	{
+		vkCmdBeginQuery(commandBuffer, mStatisticsPool, mCurrentSlot * MAX_GPU_SCOPES + slot.statisticsCount, 0);
+	}
+
+	slot.scopes.push_back({ name, statistics });
+}
+
+void Profiler::endGpuScope(VkCommandBuffer commandBuffer)
+{
+	// A dropped scope's begin wrote nothing, so its end doesn't either
+	if (!mGpuEnabled || !mScopeOpen) return;
+	mScopeOpen = false;
+
+	FrameSlot& slot = mSlots[mCurrentSlot];
+
+	const GpuScope& scope = slot.scopes.back();
+	uint32_t query = mCurrentSlot * MAX_GPU_SCOPES + static_cast<uint32_t>(slot.scopes.size() - 1);
+
+	if (scope.statistics)
+	{
+		vkCmdEndQuery(commandBuffer, mStatisticsPool, mCurrentSlot * MAX_GPU_SCOPES + slot.statisticsCount);
+		slot.statisticsCount++;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mTimestampPool, query * 2 + 1);
+}
+
+VkQueryPipelineStatisticFlags Profiler::pipelineStatisticsFlags() const
+{
+	return mStatisticsPool != VK_NULL_HANDLE ? PIPELINE_STATISTICS_FLAGS : 0;
+}
+
+void Profiler::collect()
+{
+	if (!mGpuEnabled) return;
+
+	// Oldest first: the slot after the current one was submitted longest ago
+	for (uint32_t i = 1; i <= mSlots.size(); i++)
+	{
+		uint32_t frame = (mCurrentSlot + i) % static_cast<uint32_t>(mSlots.size());
+
+		resolve(mSlots[frame], frame);
+		mSlots[frame].scopes.clear();
+		mSlots[frame].statisticsCount = 0;
+	}
+}
+
+void Profiler::resolve(FrameSlot& slot, uint32_t frame)
+{
+	uint32_t scopeCount = static_cast<uint32_t>(slot.scopes.size());
+	if (scopeCount == 0) return;
+
+	std::vector<uint64_t> timestamps(scopeCount * 2);
+	VkResult result = vkGetQueryPoolResults(mDevice, mTimestampPool, frame * MAX_GPU_SCOPES * 2, scopeCount * 2,
+		timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+	// Never wait: a frame that isn't available is skipped
+	if (result != VK_SUCCESS) return;
+
+	std::vector<PipelineStatistics> statistics(slot.statisticsCount);
+	if (slot.statisticsCount > 0)
+	{
+		result = vkGetQueryPoolResults(mDevice, mStatisticsPool, frame * MAX_GPU_SCOPES, slot.statisticsCount,
+			statistics.size() * sizeof(PipelineStatistics), statistics.data(), sizeof(PipelineStatistics), VK_QUERY_RESULT_64_BIT);
+
+		if (result != VK_SUCCESS) statistics.assign(slot.statisticsCount, PipelineStatistics());
+	}
+
+	double frameStartUs = (timestamps[0] & mTimestampMask) * mTimestampPeriodUs;
+	double frameEndUs = frameStartUs;
+
+	// The frame was recorded before it could start on the GPU
+	mGpuOffsetUs = std::max(mGpuOffsetUs, slot.cpuStartUs - frameStartUs);
+
+	uint32_t statisticsIndex = 0;
+	for (uint32_t i = 0; i < scopeCount; i++)
+	{
+		double startUs = (timestamps[i * 2] & mTimestampMask) * mTimestampPeriodUs;
+		double endUs = (timestamps[i * 2 + 1] & mTimestampMask) * mTimestampPeriodUs;
+		frameEndUs = std::max(frameEndUs, endUs);
+
+		GpuEvent event{ slot.scopes[i].name, startUs, endUs - startUs, slot.scopes[i].statistics, PipelineStatistics() };
+		if (event.hasStatistics) event.statistics = statistics[statisticsIndex++];
+
+		if (mGpuEvents.size() < MAX_TRACE_EVENTS) mGpuEvents.push_back(event);
+	}
+
+	mGpuFrameTimes.push_back((frameEndUs - frameStartUs) / 1000.0);
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) return false;
+
+	file.setf(std::ios::fixed);
+	file.precision(3);
+
+	// pid 1 is the CPU with one track per thread, pid 2 the graphics queue
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+	for (const auto& event : mCpuEvents)
+	{
+		file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+			<< ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}";
+	}
+
+	for (const auto& event : mGpuEvents)
+	{
+		file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":2,\"tid\":1"
+			<< ",\"ts\":" << event.startUs + mGpuOffsetUs << ",\"dur\":" << event.durationUs;
+
+		if (event.hasStatistics)
+		{
+			const PipelineStatistics& statistics = event.statistics;
+			file << ",\"args\":{\"inputAssemblyPrimitives\":" << statistics.inputAssemblyPrimitives
+				<< ",\"vertexInvocations\":" << statistics.vertexInvocations
+				<< ",\"clippingInvocations\":" << statistics.clippingInvocations
+				<< ",\"clippingPrimitives\":" << statistics.clippingPrimitives
+				<< ",\"fragmentInvocations\":" << statistics.fragmentInvocations << "}";
+		}
+
+		file << "}";
+	}
+
+	file << "\n]}\n";
+	return file.good();
+}
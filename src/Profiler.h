@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Pipeline statistics gathered for a GPU scope, zero when the device lacks pipelineStatisticsQuery
+struct PipelineStatistics
+{
+	uint64_t inputAssemblyPrimitives = 0;
+	uint64_t vertexInvocations = 0;
+	uint64_t clippingInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	uint64_t fragmentInvocations = 0;
+};
+
+// CPU scopes and GPU timestamp/pipeline statistics scopes, exported as a Chrome trace (chrome://tracing, Perfetto).
+// Each frame in flight owns a slice of the query pools. A slice is read back when its frame comes around again,
+// after its fence was waited on, so results arrive one frame-in-flight count late and never stall the CPU.
+// Everything is a single branch on a bool until enable() is called.
+class Profiler
+{
+public:
+	Profiler() = default;
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// Starts recording CPU scopes; the trace is written to tracePath by cleanUp() unless it is empty
+	void enable(const std::string& tracePath);
+	bool isEnabled() const { return mEnabled; }
+
+	// GPU scopes stay disabled if the queue family has no timestamp support
+	void initGpu(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameCount, bool pipelineStatistics);
+
+	// Writes the trace and destroys the query pools
+	void cleanUp();
+
+	void recordCpuScope(const char* name, std::chrono::high_resolution_clock::time_point start,
+		std::chrono::high_resolution_clock::time_point end);
+
+	// Call after the frame's fence was waited on and before any scope is recorded into commandBuffer.
+	// Resolves the queries the frame slot wrote last time and resets them.
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+
+	// Scopes must not nest. With statistics, the scope must begin and end outside a render pass.
+	void beginGpuScope(VkCommandBuffer commandBuffer, const char* name, bool statistics = false);
+	void endGpuScope(VkCommandBuffer commandBuffer);
+
+	// What secondary command buffers executed inside a statistics scope must declare in their inheritance info
+	VkQueryPipelineStatisticFlags pipelineStatisticsFlags() const;
+
+	// Resolves every frame still in flight, only valid once the device is idle
+	void collect();
+
+	// First to last timestamp of every resolved frame, in resolve order
+	const std::vector<double>& gpuFrameTimes() const { return mGpuFrameTimes; }
+
+	bool writeChromeTrace(const std::string& path) const;
+private:
+	struct CpuEvent
+	{
+		const char* name;
+		double startUs;
+		double durationUs;
+		uint32_t thread;
+	};
+
+	struct GpuScope
+	{
+		const char* name;
+		bool statistics;
+	};
+
+	struct GpuEvent
+	{
+		const char* name;
+		double startUs;
+		double durationUs;
+		bool hasStatistics;
+		PipelineStatistics statistics;
+	};
+
+	struct FrameSlot
+	{
+		std::vector<GpuScope> scopes;
+		uint32_t statisticsCount = 0;
+		double cpuStartUs = 0.0;
+	};
+
+	double sinceStartUs(std::chrono::high_resolution_clock::time_point time) const;
+	uint32_t threadIndex();
+	void resolve(FrameSlot& slot, uint32_t frame);
+private:
+	bool mEnabled = false;
+	std::string mTracePath;
+	std::chrono::high_resolution_clock::time_point mStart;
+
+	std::mutex mMutex;
+	std::vector<CpuEvent> mCpuEvents;
+	std::vector<std::pair<size_t, uint32_t>> mThreads;
+
+	// GPU
+	bool mGpuEnabled = false;
+	VkDevice mDevice = VK_NULL_HANDLE;
+	VkQueryPool mTimestampPool = VK_NULL_HANDLE;
+	VkQueryPool mStatisticsPool = VK_NULL_HANDLE;
+	double mTimestampPeriodUs = 0.0;
+	uint64_t mTimestampMask = 0;
+
+	std::vector<FrameSlot> mSlots;
+	uint32_t mCurrentSlot = 0;
+	bool mScopeOpen = false;
+
+	std::vector<GpuEvent> mGpuEvents;
+	std::vector<double> mGpuFrameTimes;
+	// Lower bound of CPU time minus GPU time, from the fact that no frame starts on the GPU before it was recorded
+	double mGpuOffsetUs = -1e300;
+	uint32_t mDroppedScopes = 0;
+};
+
+// Times the enclosing block when the profiler is enabled
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, const char* name)
+		: mProfiler(profiler), mName(name)
+	{
+		if (mProfiler.isEnabled()) mStart = std::chrono::high_resolution_clock::now();
+	}
+
+	~ProfileScope()
+	{
+		if (mProfiler.isEnabled()) mProfiler.recordCpuScope(mName, mStart, std::chrono::high_resolution_clock::now());
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+	Profiler& mProfiler;
+	const char* mName;
+	std::chrono::high_resolution_clock::time_point mStart;
+};
@@ -0,0 +1,350 @@
+#include "RenderQueue.h"
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+
+const uint32_t QUEUE_BENCHMARK_ITERATIONS = 20;
+
+namespace
+{
+	uint64_t field(uint32_t value, uint32_t bits, uint32_t shift)
+	{
+		return (static_cast<uint64_t>(value) & ((1ull << bits) - 1)) << shift;
+	}
+
+	// Non-dispatchable handles are pointers on 64-bit targets and integers elsewhere
+	template<typename Handle>
+	Handle fakeHandle(uint64_t value)
+	{
+		Handle handle;
+		std::memcpy(&handle, &value, sizeof(handle));
+		return handle;
+	}
+}
+
+uint64_t RenderQueue::makeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depthBucket, uint32_t mesh)
+{
+	const uint32_t depthShift = MESH_BITS;
+	const uint32_t materialShift = depthShift + DEPTH_BITS;
+	const uint32_t pipelineShift = materialShift + MATERIAL_BITS;
+	const uint32_t passShift = pipelineShift + PIPELINE_BITS;
+	static_assert(PASS_BITS + PIPELINE_BITS + MATERIAL_BITS + DEPTH_BITS + MESH_BITS == 64, "Sort key fields must fill 64 bits");
+
+	return field(pass, PASS_BITS, passShift) | field(pipeline, PIPELINE_BITS, pipelineShift) | field(material, MATERIAL_BITS, materialShift)
+		| field(depthBucket, DEPTH_BITS, depthShift) | field(mesh, MESH_BITS, 0);
+}
+
+uint32_t RenderQueue::depthBucket(float depth, float nearPlane, float farPlane)
+{
+	const float maxBucket = static_cast<float>((1u << DEPTH_BITS) - 1);
+
+	float t = (depth - nearPlane) / std::max(farPlane - nearPlane, 1e-6f);
+	return static_cast<uint32_t>(std::min(std::max(t, 0.0f), 1.0f) * maxBucket + 0.5f);
+}
+
+void RenderQueue::clear()
+{
+	mPackets.clear();
+	mEntries.clear();
+	mSortMs = 0.0;
+	mBinds = 0;
+	mBindsElided = 0;
+	mDraws = 0;
+}
+
+void RenderQueue::push(uint64_t key, const DrawPacket& packet)
+{
+	mEntries.push_back({ key, static_cast<uint32_t>(mPackets.size()) });
+	mPackets.push_back(packet);
+}
+
+void RenderQueue::sort()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	size_t count = mEntries.size();
+	mScratch.resize(count);
+
+	// Every byte's histogram in one read
+	uint32_t histograms[8][256] = {};
+	for (const SortEntry& entry : mEntries)
+	{
+		for (uint32_t byte = 0; byte < 8; byte++) histograms[byte][(entry.key >> (byte * 8)) & 0xFF]++;
+	}
+
+	SortEntry* source = mEntries.data();
+	SortEntry* destination = mScratch.data();
+
+	for (uint32_t byte = 0; byte < 8 && count > 1; byte++)
+	{
+		uint32_t* histogram = histograms[byte];
+		uint32_t shift = byte * 8;
+
+		// Fields narrower than their range leave whole bytes equal in every key, those passes would only copy
+		if (histogram[(source[0].key >> shift) & 0xFF] == count) continue;
+
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < 256; digit++)
+		{
+			uint32_t digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++) destination[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+
+		std::swap(source, destination);
+	}
+
+	if (source != mEntries.data()) mEntries.swap(mScratch);
+
+	mSortMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void RenderQueue::writeCommands(VkDrawIndexedIndirectCommand* commands) const
+{
+	for (size_t i = 0; i < mEntries.size(); i++) commands[i] = mPackets[mEntries[i].packet].command;
+}
+
+void RenderQueue::submit(VkCommandBuffer commandBuffer, uint32_t first, uint32_t end, VkBuffer indirectBuffer, VkDeviceSize indirectOffset)
+{
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	BoundState bound;
+	uint64_t binds = 0;
+	uint64_t bindsElided = 0;
+	uint64_t draws = 0;
+
+	auto count = [&](bool needed)
+	{
+		if (needed) binds++;
+		else bindsElided++;
+		return needed;
+	};
+
+	for (uint32_t i = first; i < end;)
+	{
+		const DrawPacket& packet = mPackets[mEntries[i].packet];
+
+		if (count(bound.bindPipeline(packet)))
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+		}
+
+		if (count(bound.bindDescriptorSet(packet)))
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipelineLayout, 0, 1, &packet.descriptorSet,
+				3, packet.dynamicOffsets);
+		}
+
+		if (count(bound.bindVertexBuffers(packet)))
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, packet.vertexBindingCount, packet.vertexBuffers, packet.vertexOffsets);
+		}
+
+		if (count(bound.bindIndexBuffer(packet)))
+		{
+			vkCmdBindIndexBuffer(commandBuffer, packet.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		}
+
+		// Following packets with nothing to bind ride along in the same indirect call
+		uint32_t runEnd = i + 1;
+		if (indirectBuffer != VK_NULL_HANDLE)
+		{
+			while (runEnd < end && bound.matches(mPackets[mEntries[runEnd].packet])) runEnd++;
+		}
+
+		if (runEnd - i > 1)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, indirectOffset + VkDeviceSize(i) * stride, runEnd - i, stride);
+			bindsElided += 4 * (runEnd - i - 1);
+		}
+		else
+		{
+			const VkDrawIndexedIndirectCommand& command = packet.command;
+			vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+		}
+
+		draws++;
+		i = runEnd;
+	}
+
+	mBinds += binds;
+	mBindsElided += bindsElided;
+	mDraws += draws;
+}
+
+RenderQueueStats RenderQueue::frameStats() const
+{
+	RenderQueueStats stats;
+	stats.frames = 1;
+	stats.packets = mEntries.size();
+	stats.binds = mBinds;
+	stats.bindsElided = mBindsElided;
+	stats.draws = mDraws;
+	stats.sortMs = mSortMs;
+	return stats;
+}
+
+bool RenderQueue::BoundState::matches(const DrawPacket& packet) const
+{
+	return packet.pipeline == pipeline && packet.pipelineLayout == pipelineLayout && packet.descriptorSet == descriptorSet
+		&& std::equal(packet.dynamicOffsets, packet.dynamicOffsets + 3, dynamicOffsets)
+		&& packet.vertexBindingCount <= vertexBindingCount
+		&& std::equal(packet.vertexBuffers, packet.vertexBuffers + packet.vertexBindingCount, vertexBuffers)
+		&& std::equal(packet.vertexOffsets, packet.vertexOffsets + packet.vertexBindingCount, vertexOffsets)
+		&& packet.indexBuffer == indexBuffer;
+}
+
+bool RenderQueue::BoundState::bindPipeline(const DrawPacket& packet)
+{
+	if (packet.pipeline == pipeline) return false;
+
+	pipeline = packet.pipeline;
+	return true;
+}
+
+bool RenderQueue::BoundState::bindDescriptorSet(const DrawPacket& packet)
+{
+	if (packet.pipelineLayout == pipelineLayout && packet.descriptorSet == descriptorSet
+		&& std::equal(packet.dynamicOffsets, packet.dynamicOffsets + 3, dynamicOffsets)) return false;
+
+	pipelineLayout = packet.pipelineLayout;
+	descriptorSet = packet.descriptorSet;
+	std::copy(packet.dynamicOffsets, packet.dynamicOffsets + 3, dynamicOffsets);
+	return true;
+}
+
+bool RenderQueue::BoundState::bindVertexBuffers(const DrawPacket& packet)
+{
+	// Bindings past what the pipeline reads may stay bound to anything
+	if (packet.vertexBindingCount <= vertexBindingCount
+		&& std::equal(packet.vertexBuffers, packet.vertexBuffers + packet.vertexBindingCount, vertexBuffers)
+		&& std::equal(packet.vertexOffsets, packet.vertexOffsets + packet.vertexBindingCount, vertexOffsets)) return false;
+
+	std::copy(packet.vertexBuffers, packet.vertexBuffers + packet.vertexBindingCount, vertexBuffers);
+	std::copy(packet.vertexOffsets, packet.vertexOffsets + packet.vertexBindingCount, vertexOffsets);
+	vertexBindingCount = packet.vertexBindingCount;
+	return true;
+}
+
+bool RenderQueue::BoundState::bindIndexBuffer(const DrawPacket& packet)
+{
+	if (packet.indexBuffer == indexBuffer) return false;
+
+	indexBuffer = packet.indexBuffer;
+	return true;
+}
+
+RenderQueueStats RenderQueue::countBinds(const std::vector<DrawPacket>& packets, const std::vector<SortEntry>& order)
+{
+	RenderQueueStats stats;
+	BoundState bound;
+
+	for (const SortEntry& entry : order)
+	{
+		const DrawPacket& packet = packets[entry.packet];
+
+		if (!bound.matches(packet)) stats.draws++;
+
+		bool needed[] = { bound.bindPipeline(packet), bound.bindDescriptorSet(packet), bound.bindVertexBuffers(packet),
+			bound.bindIndexBuffer(packet) };
+
+		for (bool bind : needed)
+		{
+			if (bind) stats.binds++;
+			else stats.bindsElided++;
+		}
+	}
+
+	return stats;
+}
+
+bool RenderQueue::runBenchmark(uint32_t packetCount)
+{
+	packetCount = std::max(1u, packetCount);
+
+	// A scene of 1024 meshes in their own buffers, 4 pipelines and 64 material sets, drawn in a depth and a shading pass
+	const uint32_t meshCount = 1024;
+	const uint32_t pipelineCount = 4;
+	const uint32_t materialCount = 64;
+
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<uint32_t> mesh(0, meshCount - 1);
+	std::uniform_int_distribution<uint32_t> pipeline(0, pipelineCount - 1);
+	std::uniform_int_distribution<uint32_t> material(0, materialCount - 1);
+	std::uniform_real_distribution<float> depth(0.1f, 1000.0f);
+
+	RenderQueue queue;
+	for (uint32_t i = 0; i < packetCount; i++)
+	{
+		uint32_t pass = i % 2;
+		uint32_t packetMesh = mesh(random);
+		uint32_t packetPipeline = pass == 0 ? 0 : pipeline(random) + 1;
+		uint32_t packetMaterial = pass == 0 ? 0 : material(random);
+
+		DrawPacket packet{};
+		packet.pipeline = fakeHandle<VkPipeline>(packetPipeline + 1);
+		packet.pipelineLayout = fakeHandle<VkPipelineLayout>(1);
+		packet.descriptorSet = fakeHandle<VkDescriptorSet>(packetMaterial + 1);
+		packet.vertexBuffers[0] = packet.vertexBuffers[1] = fakeHandle<VkBuffer>(packetMesh + 1);
+		packet.vertexBindingCount = pass == 0 ? 1 : 2;
+		packet.indexBuffer = fakeHandle<VkBuffer>(meshCount + packetMesh + 1);
+
+		queue.push(makeKey(pass, packetPipeline, packetMaterial, depthBucket(depth(random), 0.1f, 1000.0f), packetMesh), packet);
+	}
+
+	std::vector<SortEntry> unsorted = queue.mEntries;
+
+	std::cout << packetCount << " packets" << std::endl;
+
+	double radixMs = 0.0;
+	for (uint32_t i = 0; i < QUEUE_BENCHMARK_ITERATIONS; i++)
+	{
+		queue.mEntries = unsorted;
+		queue.mSortMs = 0.0;
+		queue.sort();
+		radixMs += queue.mSortMs;
+	}
+
+	std::vector<SortEntry> reference;
+	double referenceMs = 0.0;
+	for (uint32_t i = 0; i < QUEUE_BENCHMARK_ITERATIONS; i++)
+	{
+		reference = unsorted;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::stable_sort(reference.begin(), reference.end(), [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+		referenceMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	bool matches = std::equal(reference.begin(), reference.end(), queue.mEntries.begin(),
+		[](const SortEntry& a, const SortEntry& b) { return a.key == b.key && a.packet == b.packet; });
+
+	std::cout << "  radix sort: " << radixMs / QUEUE_BENCHMARK_ITERATIONS << " ms" << (matches ? "" : ", MISMATCH") << std::endl;
+	std::cout << "  std::stable_sort: " << referenceMs / QUEUE_BENCHMARK_ITERATIONS << " ms" << std::endl;
+
+	auto reportBinds = [](const char* name, const RenderQueueStats& stats)
+	{
+		std::cout << "  " << name << ": " << stats.binds << " binds, " << stats.bindsElided << " elided, "
+			<< stats.draws << " draw calls with multi-draw indirect" << std::endl;
+	};
+
+	reportBinds("submission order", countBinds(queue.mPackets, unsorted));
+	reportBinds("sorted", countBinds(queue.mPackets, queue.mEntries));
+
+	// The same scene with every mesh sub-allocated from one vertex and one index buffer
+	std::vector<DrawPacket> sharedPackets = queue.mPackets;
+	for (DrawPacket& packet : sharedPackets)
+	{
+		packet.vertexBuffers[0] = packet.vertexBuffers[1] = fakeHandle<VkBuffer>(1);
+		packet.indexBuffer = fakeHandle<VkBuffer>(2);
+	}
+
+	reportBinds("sorted, shared buffers", countBinds(sharedPackets, queue.mEntries));
+
+	return matches;
+}
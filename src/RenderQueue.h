@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+// Everything one indexed draw binds and issues. State is compared by value, so packets that share handles and
+// offsets bind them once.
+struct DrawPacket
+{
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSet descriptorSet;
+	uint32_t dynamicOffsets[3]; // UBO, light and instance bindings, in binding order
+	VkBuffer vertexBuffers[2];
+	VkDeviceSize vertexOffsets[2];
+	uint32_t vertexBindingCount; // 1 for position-only pipelines
+	VkBuffer indexBuffer;
+	VkDrawIndexedIndirectCommand command;
+};
+
+// Binds emitted and skipped while submitting, summed over however many frames were added
+struct RenderQueueStats
+{
+	uint64_t frames = 0;
+	uint64_t packets = 0;
+	uint64_t binds = 0;       // Pipeline, descriptor set, vertex buffer and index buffer binds recorded
+	uint64_t bindsElided = 0; // Binds skipped because the command buffer already had that state
+	uint64_t draws = 0;       // Draw calls recorded, a multi-draw indirect call counting once
+	double sortMs = 0.0;
+
+	void add(const RenderQueueStats& other)
+	{
+		frames += other.frames;
+		packets += other.packets;
+		binds += other.binds;
+		bindsElided += other.bindsElided;
+		draws += other.draws;
+		sortMs += other.sortMs;
+	}
+};
+
+// A frame's draws, each with a 64-bit sort key. Sorting by key puts packets that share state next to each other,
+// and submission only binds what changed since the previous packet.
+//
+// Key layout, most significant first:
+//   pass (4 bits) | pipeline (8 bits) | material (16 bits) | depth bucket (16 bits) | mesh (20 bits)
+class RenderQueue
+{
+public:
+	static const uint32_t PASS_BITS = 4;
+	static const uint32_t PIPELINE_BITS = 8;
+	static const uint32_t MATERIAL_BITS = 16;
+	static const uint32_t DEPTH_BITS = 16;
+	static const uint32_t MESH_BITS = 20;
+
+	// Fields are masked to their width
+	static uint64_t makeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depthBucket, uint32_t mesh);
+
+	// View depth between nearPlane and farPlane to a bucket, nearer first. Linear, clamped at both ends.
+	static uint32_t depthBucket(float depth, float nearPlane, float farPlane);
+
+	RenderQueue() = default;
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	// Empties the queue and the last frame's bind counts, keeping the storage
+	void clear();
+	void push(uint64_t key, const DrawPacket& packet);
+
+	// Stable LSD radix sort on the keys, a byte per pass, skipping bytes all keys share
+	void sort();
+
+	uint32_t size() const { return static_cast<uint32_t>(mEntries.size()); }
+
+	// Draw commands of every packet in sorted order, size() of them
+	void writeCommands(VkDrawIndexedIndirectCommand* commands) const;
+
+	// Records sorted packets [first, end) starting from nothing bound, as a secondary command buffer does.
+	// Given the buffer writeCommands filled at indirectOffset, consecutive packets that share all state go out as one
+	// multi-draw indirect call, which needs the multiDrawIndirect and drawIndirectFirstInstance features.
+	// Dynamic viewport and scissor are left to the caller. Safe to call from several threads on disjoint ranges.
+	void submit(VkCommandBuffer commandBuffer, uint32_t first, uint32_t end, VkBuffer indirectBuffer = VK_NULL_HANDLE,
+		VkDeviceSize indirectOffset = 0);
+
+	// Packets, sort time and binds of everything submitted since clear(), as one frame
+	RenderQueueStats frameStats() const;
+
+	// Sort time of radix and std::stable_sort over packetCount random packets, and the binds and draw calls each order
+	// needs with dedicated and with shared mesh buffers
+	static bool runBenchmark(uint32_t packetCount);
+private:
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	// What a command buffer has bound; each call returns true when the packet needs a bind and records it
+	struct BoundState
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		uint32_t dynamicOffsets[3] = {};
+		VkBuffer vertexBuffers[2] = {};
+		VkDeviceSize vertexOffsets[2] = {};
+		uint32_t vertexBindingCount = 0;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+
+		// Nothing to bind for the packet
+		bool matches(const DrawPacket& packet) const;
+
+		bool bindPipeline(const DrawPacket& packet);
+		bool bindDescriptorSet(const DrawPacket& packet);
+		bool bindVertexBuffers(const DrawPacket& packet);
+		bool bindIndexBuffer(const DrawPacket& packet);
+	};
+
+	// Binds and multi-draw indirect calls that submitting packets in order would record, without a command buffer
+	static RenderQueueStats countBinds(const std::vector<DrawPacket>& packets, const std::vector<SortEntry>& order);
+private:
+	std::vector<DrawPacket> mPackets;
+	std::vector<SortEntry> mEntries;
+	std::vector<SortEntry> mScratch;
+	double mSortMs = 0.0;
+
+	std::atomic<uint64_t> mBinds{ 0 };
+	std::atomic<uint64_t> mBindsElided{ 0 };
+	std::atomic<uint64_t> mDraws{ 0 };
+};
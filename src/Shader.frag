@@ -1,7 +1,26 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+// Every material texture; the array is partially bound, only indices a material names are valid
+layout(binding = 1) uniform sampler2D textures[];
+#else
+// The texture of the material being drawn, a descriptor set per texture
 layout(binding = 1) uniform sampler2D texSampler;
+#endif
+
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
+struct Material {
+    vec4 baseColor;
+    uint textureIndex;
+};
+
+layout(std430, binding = 4) readonly buffer MaterialBuffer {
+    Material materials[];
+};
+
 layout(binding = 2) uniform LightBuffer {
     vec3 pos;
     vec3 playerPos;
@@ -10,6 +29,7 @@ layout(binding = 2) uniform LightBuffer {
 layout(location = 0) in vec3 fragNormal;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragPos;
+layout(location = 3) flat in uint fragMaterial;
 
 layout(location = 0) out vec4 outColor;
 
@@ -28,5 +48,15 @@ void main() {
     float specularS = 0.5;
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 128);
     vec3 specular = specularS * spec * LightColor;
-    outColor = vec4((diffuse + ambient + specular), 1.0);
+
+    // Sampled outside any branch, neighbouring fragments of another material still need derivatives
+    Material material = materials[fragMaterial];
+    bool textured = material.textureIndex != NO_TEXTURE;
+#ifdef BINDLESS
+    vec3 texel = texture(textures[nonuniformEXT(textured ? material.textureIndex : 0u)], fragTexCoord).rgb;
+#else
+    vec3 texel = texture(texSampler, fragTexCoord).rgb;
+#endif
+    vec3 albedo = material.baseColor.rgb * (textured ? texel : vec3(1.0));
+    outColor = vec4(albedo * (diffuse + ambient + specular), 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,864 @@
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// ETC1 intensity modifier tables, each entry is the small and the large offset
+const int ETC_MODIFIERS[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+// BC7 4 bit index interpolation weights out of 64
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+// Least squares passes after the initial principal axis fit
+const int ENDPOINT_REFINE_PASSES = 2;
+
+static float srgbToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static uint8_t toByte(float value)
+{
+	return static_cast<uint8_t>(std::min(std::max(value * 255.0f + 0.5f, 0.0f), 255.0f));
+}
+
+static int clampInt(int value, int low, int high)
+{
+	return std::min(std::max(value, low), high);
+}
+
+static int roundToInt(float value)
+{
+	return static_cast<int>(std::floor(value + 0.5f));
+}
+
+// Gathers a 4x4 block as floats in row-major order, clamping at the image edge
+static void fetchBlock(const TextureImage& image, uint32_t blockX, uint32_t blockY, float block[16][4])
+{
+	for (uint32_t y = 0; y < 4; y++)
+	{
+		uint32_t sy = std::min(blockY * 4 + y, image.height - 1);
+
+		for (uint32_t x = 0; x < 4; x++)
+		{
+			uint32_t sx = std::min(blockX * 4 + x, image.width - 1);
+			const uint8_t* pixel = &image.pixels[(static_cast<size_t>(sy) * image.width + sx) * 4];
+
+			for (int c = 0; c < 4; c++) block[y * 4 + x][c] = pixel[c];
+		}
+	}
+}
+
+// Mean and dominant direction of the points over the first `channels` channels (power iteration)
+static void principalAxis(const float points[16][4], int channels, float mean[4], float axis[4])
+{
+	for (int c = 0; c < 4; c++) mean[c] = 0.0f;
+
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < channels; c++) mean[c] += points[i][c] / 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++)
+			{
+				covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+			}
+		}
+	}
+
+	for (int c = 0; c < 4; c++) axis[c] = c < channels ? 1.0f : 0.0f;
+
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		float length = 0.0f;
+
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++) next[a] += covariance[a][b] * axis[b];
+			length += next[a] * next[a];
+		}
+
+		// Flat block, any axis will do
+		if (length < 1e-12f) break;
+
+		length = std::sqrt(length);
+		for (int c = 0; c < channels; c++) axis[c] = next[c] / length;
+	}
+}
+
+// Endpoints at the extremes of the points projected on the principal axis
+static void fitEndpoints(const float points[16][4], int channels, float endpoint0[4], float endpoint1[4])
+{
+	float mean[4], axis[4];
+	principalAxis(points, channels, mean, axis);
+
+	float minT = 0.0f, maxT = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++) t += (points[i][c] - mean[c]) * axis[c];
+
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		endpoint0[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+		endpoint1[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+	}
+}
+
+// Endpoints minimizing the squared error for fixed interpolation weights (weight is the share of endpoint1)
+static bool refineEndpoints(const float points[16][4], const float weights[16], int channels, float endpoint0[4], float endpoint1[4])
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float rhs0[4] = {}, rhs1[4] = {};
+
+	for (int i = 0; i < 16; i++)
+	{
+		float w1 = weights[i];
+		float w0 = 1.0f - w1;
+
+		aa += w0 * w0;
+		ab += w0 * w1;
+		bb += w1 * w1;
+
+		for (int c = 0; c < channels; c++)
+		{
+			rhs0[c] += w0 * points[i][c];
+			rhs1[c] += w1 * points[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f) return false;
+
+	for (int c = 0; c < channels; c++)
+	{
+		endpoint0[c] = std::min(std::max((bb * rhs0[c] - ab * rhs1[c]) / determinant, 0.0f), 255.0f);
+		endpoint1[c] = std::min(std::max((aa * rhs1[c] - ab * rhs0[c]) / determinant, 0.0f), 255.0f);
+	}
+
+	return true;
+}
+
+// BC1
+
+static uint16_t packRgb565(const float color[4])
+{
+	int r = clampInt(roundToInt(color[0] * 31.0f / 255.0f), 0, 31);
+	int g = clampInt(roundToInt(color[1] * 63.0f / 255.0f), 0, 63);
+	int b = clampInt(roundToInt(color[2] * 31.0f / 255.0f), 0, 31);
+
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackRgb565(uint16_t value, int color[3])
+{
+	int r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static void bc1Palette(uint16_t color0, uint16_t color1, int palette[4][3])
+{
+	unpackRgb565(color0, palette[0]);
+	unpackRgb565(color1, palette[1]);
+
+	for (int c = 0; c < 3; c++)
+	{
+		// Four colors when color0 > color1, otherwise three and black
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+struct Bc1Candidate
+{
+	uint16_t color0;
+	uint16_t color1;
+	uint8_t indices[16];
+	float error;
+};
+
+static Bc1Candidate evaluateBc1(const float points[16][4], const float endpoint0[4], const float endpoint1[4])
+{
+	Bc1Candidate candidate{};
+	candidate.color0 = packRgb565(endpoint1);
+	candidate.color1 = packRgb565(endpoint0);
+
+	if (candidate.color0 < candidate.color1) std::swap(candidate.color0, candidate.color1);
+
+	int palette[4][3];
+	bc1Palette(candidate.color0, candidate.color1, palette);
+
+	for (int i = 0; i < 16; i++)
+	{
+		float bestError = 1e30f;
+
+		for (uint8_t index = 0; index < 4; index++)
+		{
+			float error = 0.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				float d = points[i][c] - palette[index][c];
+				error += d * d;
+			}
+
+			if (error < bestError)
+			{
+				bestError = error;
+				candidate.indices[i] = index;
+			}
+		}
+
+		candidate.error += bestError;
+	}
+
+	return candidate;
+}
+
+static void encodeBc1Block(const float points[16][4], uint8_t* out)
+{
+	float endpoint0[4], endpoint1[4];
+	fitEndpoints(points, 3, endpoint0, endpoint1);
+
+	Bc1Candidate best = evaluateBc1(points, endpoint0, endpoint1);
+
+	for (int pass = 0; pass < ENDPOINT_REFINE_PASSES && best.color0 > best.color1; pass++)
+	{
+		// Share of color1 for each palette entry in four color mode
+		const float shares[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+		float weights[16];
+		for (int i = 0; i < 16; i++) weights[i] = shares[best.indices[i]];
+
+		if (!refineEndpoints(points, weights, 3, endpoint1, endpoint0)) break;
+
+		Bc1Candidate candidate = evaluateBc1(points, endpoint0, endpoint1);
+		if (candidate.error >= best.error) break;
+
+		best = candidate;
+	}
+
+	out[0] = static_cast<uint8_t>(best.color0 & 0xFF);
+	out[1] = static_cast<uint8_t>(best.color0 >> 8);
+	out[2] = static_cast<uint8_t>(best.color1 & 0xFF);
+	out[3] = static_cast<uint8_t>(best.color1 >> 8);
+
+	for (int y = 0; y < 4; y++)
+	{
+		out[4 + y] = static_cast<uint8_t>(best.indices[y * 4] | (best.indices[y * 4 + 1] << 2) |
+			(best.indices[y * 4 + 2] << 4) | (best.indices[y * 4 + 3] << 6));
+	}
+}
+
+static void decodeBc1Block(const uint8_t* in, uint8_t pixels[16][4])
+{
+	uint16_t color0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+	uint16_t color1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+
+	int palette[4][3];
+	bc1Palette(color0, color1, palette);
+
+	for (int i = 0; i < 16; i++)
+	{
+		int index = (in[4 + i / 4] >> ((i % 4) * 2)) & 3;
+
+		for (int c = 0; c < 3; c++) pixels[i][c] = static_cast<uint8_t>(palette[index][c]);
+		pixels[i][3] = 255;
+	}
+}
+
+// BC7 mode 6: one subset, 7.7.7.7 endpoints with a unique p-bit each and 4 bit indices
+
+struct Bc7Candidate
+{
+	int endpoints[2][4]; // 7 bit values
+	int pbits[2];
+	uint8_t indices[16];
+	float error;
+};
+
+static void bc7Palette(const int endpoints[2][4], const int pbits[2], int palette[16][4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		int value0 = (endpoints[0][c] << 1) | pbits[0];
+		int value1 = (endpoints[1][c] << 1) | pbits[1];
+
+		for (int i = 0; i < 16; i++)
+		{
+			palette[i][c] = ((64 - BC7_WEIGHTS[i]) * value0 + BC7_WEIGHTS[i] * value1 + 32) >> 6;
+		}
+	}
+}
+
+static Bc7Candidate evaluateBc7(const float points[16][4], const float endpoint0[4], const float endpoint1[4])
+{
+	Bc7Candidate best{};
+	best.error = 1e30f;
+
+	// The p-bit shifts every channel of an endpoint, so try all four combinations
+	for (int pbitCombination = 0; pbitCombination < 4; pbitCombination++)
+	{
+		Bc7Candidate candidate{};
+		candidate.pbits[0] = pbitCombination & 1;
+		candidate.pbits[1] = pbitCombination >> 1;
+
+		for (int c = 0; c < 4; c++)
+		{
+			candidate.endpoints[0][c] = clampInt(roundToInt((endpoint0[c] - candidate.pbits[0]) / 2.0f), 0, 127);
+			candidate.endpoints[1][c] = clampInt(roundToInt((endpoint1[c] - candidate.pbits[1]) / 2.0f), 0, 127);
+		}
+
+		int palette[16][4];
+		bc7Palette(candidate.endpoints, candidate.pbits, palette);
+
+		for (int i = 0; i < 16 && candidate.error < best.error; i++)
+		{
+			float bestError = 1e30f;
+
+			for (uint8_t index = 0; index < 16; index++)
+			{
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					float d = points[i][c] - palette[index][c];
+					error += d * d;
+				}
+
+				if (error < bestError)
+				{
+					bestError = error;
+					candidate.indices[i] = index;
+				}
+			}
+
+			candidate.error += bestError;
+		}
+
+		if (candidate.error < best.error) best = candidate;
+	}
+
+	return best;
+}
+
+// Little endian bit stream over a 16 byte block
+class BlockBits
+{
+public:
+	explicit BlockBits(uint8_t* data) : mData(data) {}
+
+	void write(uint32_t value, int count)
+	{
+		for (int i = 0; i < count; i++, mPosition++)
+		{
+			mData[mPosition >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (mPosition & 7));
+		}
+	}
+
+	uint32_t read(int count)
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < count; i++, mPosition++)
+		{
+			value |= static_cast<uint32_t>((mData[mPosition >> 3] >> (mPosition & 7)) & 1) << i;
+		}
+		return value;
+	}
+private:
+	uint8_t* mData;
+	int mPosition = 0;
+};
+
+static void encodeBc7Block(const float points[16][4], uint8_t* out)
+{
+	float endpoint0[4], endpoint1[4];
+	fitEndpoints(points, 4, endpoint0, endpoint1);
+
+	Bc7Candidate best = evaluateBc7(points, endpoint0, endpoint1);
+
+	for (int pass = 0; pass < ENDPOINT_REFINE_PASSES && best.error > 0.0f; pass++)
+	{
+		float weights[16];
+		for (int i = 0; i < 16; i++) weights[i] = BC7_WEIGHTS[best.indices[i]] / 64.0f;
+
+		if (!refineEndpoints(points, weights, 4, endpoint0, endpoint1)) break;
+
+		Bc7Candidate candidate = evaluateBc7(points, endpoint0, endpoint1);
+		if (candidate.error >= best.error) break;
+
+		best = candidate;
+	}
+
+	// The anchor index is stored without its top bit, so pixel 0 must use the first half of the palette
+	if (best.indices[0] & 8)
+	{
+		for (int c = 0; c < 4; c++) std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+		std::swap(best.pbits[0], best.pbits[1]);
+
+		for (int i = 0; i < 16; i++) best.indices[i] = static_cast<uint8_t>(15 - best.indices[i]);
+	}
+
+	std::memset(out, 0, 16);
+	BlockBits bits(out);
+
+	bits.write(1 << 6, 7);
+
+	for (int c = 0; c < 4; c++)
+	{
+		bits.write(best.endpoints[0][c], 7);
+		bits.write(best.endpoints[1][c], 7);
+	}
+
+	bits.write(best.pbits[0], 1);
+	bits.write(best.pbits[1], 1);
+
+	for (int i = 0; i < 16; i++) bits.write(best.indices[i], i == 0 ? 3 : 4);
+}
+
+static void decodeBc7Block(const uint8_t* in, uint8_t pixels[16][4])
+{
+	uint8_t block[16];
+	std::memcpy(block, in, sizeof(block));
+	BlockBits bits(block);
+
+	// Only mode 6 is ever written by the encoder
+	if (bits.read(7) != (1 << 6))
+	{
+		for (int i = 0; i < 16; i++) std::memset(pixels[i], 0, 4);
+		return;
+	}
+
+	int endpoints[2][4], pbits[2];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = bits.read(7);
+		endpoints[1][c] = bits.read(7);
+	}
+
+	pbits[0] = bits.read(1);
+	pbits[1] = bits.read(1);
+
+	int palette[16][4];
+	bc7Palette(endpoints, pbits, palette);
+
+	for (int i = 0; i < 16; i++)
+	{
+		uint32_t index = bits.read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++) pixels[i][c] = static_cast<uint8_t>(palette[index][c]);
+	}
+}
+
+// ETC1 blocks, which ETC2 RGB8 decoders read unchanged
+
+struct EtcSubblock
+{
+	int table;
+	uint8_t indices[16]; // Only the subblock's pixels are set
+	float error;
+};
+
+// Pixels of half a block: left/right columns, or top/bottom rows when flipped
+static bool inSubblock(int pixel, bool flip, int subblock)
+{
+	int x = pixel % 4, y = pixel / 4;
+	return (flip ? y >= 2 : x >= 2) == (subblock == 1);
+}
+
+static EtcSubblock evaluateEtcSubblock(const float points[16][4], bool flip, int subblock, const int base[3])
+{
+	EtcSubblock best{};
+	best.error = 1e30f;
+
+	for (int table = 0; table < 8; table++)
+	{
+		const int modifiers[4] = { ETC_MODIFIERS[table][0], ETC_MODIFIERS[table][1], -ETC_MODIFIERS[table][0], -ETC_MODIFIERS[table][1] };
+
+		EtcSubblock candidate{};
+		candidate.table = table;
+
+		for (int i = 0; i < 16 && candidate.error < best.error; i++)
+		{
+			if (!inSubblock(i, flip, subblock)) continue;
+
+			float bestError = 1e30f;
+			for (uint8_t index = 0; index < 4; index++)
+			{
+				float error = 0.0f;
+				for (int c = 0; c < 3; c++)
+				{
+					float d = points[i][c] - clampInt(base[c] + modifiers[index], 0, 255);
+					error += d * d;
+				}
+
+				if (error < bestError)
+				{
+					bestError = error;
+					candidate.indices[i] = index;
+				}
+			}
+
+			candidate.error += bestError;
+		}
+
+		if (candidate.error < best.error) best = candidate;
+	}
+
+	return best;
+}
+
+static void subblockAverage(const float points[16][4], bool flip, int subblock, float average[3])
+{
+	for (int c = 0; c < 3; c++) average[c] = 0.0f;
+
+	for (int i = 0; i < 16; i++)
+	{
+		if (!inSubblock(i, flip, subblock)) continue;
+		for (int c = 0; c < 3; c++) average[c] += points[i][c] / 8.0f;
+	}
+}
+
+static void encodeEtcBlock(const float points[16][4], uint8_t* out)
+{
+	uint64_t bestWord = 0;
+	float bestError = 1e30f;
+
+	for (int flip = 0; flip < 2; flip++)
+	{
+		float averages[2][3];
+		subblockAverage(points, flip != 0, 0, averages[0]);
+		subblockAverage(points, flip != 0, 1, averages[1]);
+
+		// Individual mode: two 4 bit base colors
+		{
+			int quantized[2][3], bases[2][3];
+			for (int s = 0; s < 2; s++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					quantized[s][c] = clampInt(roundToInt(averages[s][c] * 15.0f / 255.0f), 0, 15);
+					bases[s][c] = quantized[s][c] * 17;
+				}
+			}
+
+			EtcSubblock first = evaluateEtcSubblock(points, flip != 0, 0, bases[0]);
+			EtcSubblock second = evaluateEtcSubblock(points, flip != 0, 1, bases[1]);
+
+			if (first.error + second.error < bestError)
+			{
+				bestError = first.error + second.error;
+				bestWord = (static_cast<uint64_t>(quantized[0][0]) << 60) | (static_cast<uint64_t>(quantized[1][0]) << 56) |
+					(static_cast<uint64_t>(quantized[0][1]) << 52) | (static_cast<uint64_t>(quantized[1][1]) << 48) |
+					(static_cast<uint64_t>(quantized[0][2]) << 44) | (static_cast<uint64_t>(quantized[1][2]) << 40) |
+					(static_cast<uint64_t>(first.table) << 37) | (static_cast<uint64_t>(second.table) << 34) |
+					(static_cast<uint64_t>(flip) << 32);
+
+				for (int i = 0; i < 16; i++)
+				{
+					uint32_t index = inSubblock(i, flip != 0, 0) ? first.indices[i] : second.indices[i];
+					int bit = (i % 4) * 4 + i / 4;
+
+					bestWord |= static_cast<uint64_t>(index >> 1) << (16 + bit);
+					bestWord |= static_cast<uint64_t>(index & 1) << bit;
+				}
+			}
+		}
+
+		// Differential mode: a 5 bit base color and a 3 bit signed delta to the second
+		{
+			int quantized[2][3], deltas[3], bases[2][3];
+			for (int c = 0; c < 3; c++)
+			{
+				quantized[0][c] = clampInt(roundToInt(averages[0][c] * 31.0f / 255.0f), 0, 31);
+				int second = clampInt(roundToInt(averages[1][c] * 31.0f / 255.0f), 0, 31);
+
+				deltas[c] = clampInt(second - quantized[0][c], -4, 3);
+				quantized[1][c] = quantized[0][c] + deltas[c];
+
+				for (int s = 0; s < 2; s++) bases[s][c] = (quantized[s][c] << 3) | (quantized[s][c] >> 2);
+			}
+
+			EtcSubblock first = evaluateEtcSubblock(points, flip != 0, 0, bases[0]);
+			EtcSubblock second = evaluateEtcSubblock(points, flip != 0, 1, bases[1]);
+
+			if (first.error + second.error < bestError)
+			{
+				bestError = first.error + second.error;
+				bestWord = (static_cast<uint64_t>(quantized[0][0]) << 59) | (static_cast<uint64_t>(deltas[0] & 7) << 56) |
+					(static_cast<uint64_t>(quantized[0][1]) << 51) | (static_cast<uint64_t>(deltas[1] & 7) << 48) |
+					(static_cast<uint64_t>(quantized[0][2]) << 43) | (static_cast<uint64_t>(deltas[2] & 7) << 40) |
+					(static_cast<uint64_t>(first.table) << 37) | (static_cast<uint64_t>(second.table) << 34) |
+					(static_cast<uint64_t>(1) << 33) | (static_cast<uint64_t>(flip) << 32);
+
+				for (int i = 0; i < 16; i++)
+				{
+					uint32_t index = inSubblock(i, flip != 0, 0) ? first.indices[i] : second.indices[i];
+					int bit = (i % 4) * 4 + i / 4;
+
+					bestWord |= static_cast<uint64_t>(index >> 1) << (16 + bit);
+					bestWord |= static_cast<uint64_t>(index & 1) << bit;
+				}
+			}
+		}
+	}
+
+	// Blocks are stored big endian
+	for (int i = 0; i < 8; i++) out[i] = static_cast<uint8_t>(bestWord >> (56 - i * 8));
+}
+
+static void decodeEtcBlock(const uint8_t* in, uint8_t pixels[16][4])
+{
+	uint64_t word = 0;
+	for (int i = 0; i < 8; i++) word = (word << 8) | in[i];
+
+	bool differential = (word >> 33) & 1;
+	bool flip = (word >> 32) & 1;
+	int tables[2] = { static_cast<int>((word >> 37) & 7), static_cast<int>((word >> 34) & 7) };
+
+	int bases[2][3];
+	for (int c = 0; c < 3; c++)
+	{
+		int shift = 59 - c * 8;
+
+		if (differential)
+		{
+			int base = static_cast<int>((word >> shift) & 31);
+			int delta = static_cast<int>((word >> (shift - 3)) & 7);
+			if (delta >= 4) delta -= 8;
+
+			// Out of range sums select the ETC2-only modes, which the encoder never writes
+			int second = clampInt(base + delta, 0, 31);
+
+			bases[0][c] = (base << 3) | (base >> 2);
+			bases[1][c] = (second << 3) | (second >> 2);
+		}
+		else
+		{
+			bases[0][c] = static_cast<int>((word >> (shift + 1)) & 15) * 17;
+			bases[1][c] = static_cast<int>((word >> (shift - 3)) & 15) * 17;
+		}
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		int subblock = inSubblock(i, flip, 1) ? 1 : 0;
+		int bit = (i % 4) * 4 + i / 4;
+		int index = static_cast<int>((((word >> (16 + bit)) & 1) << 1) | ((word >> bit) & 1));
+
+		const int modifiers[4] = { ETC_MODIFIERS[tables[subblock]][0], ETC_MODIFIERS[tables[subblock]][1],
+			-ETC_MODIFIERS[tables[subblock]][0], -ETC_MODIFIERS[tables[subblock]][1] };
+
+		for (int c = 0; c < 3; c++) pixels[i][c] = static_cast<uint8_t>(clampInt(bases[subblock][c] + modifiers[index], 0, 255));
+		pixels[i][3] = 255;
+	}
+}
+
+namespace TextureCompressor
+{
+	std::vector<TextureImage> buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, bool srgb)
+	{
+		float toLinear[256];
+		for (int i = 0; i < 256; i++) toLinear[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+
+		std::vector<TextureImage> levels(1);
+		levels[0].width = width;
+		levels[0].height = height;
+		levels[0].pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+
+		while (levels.back().width > 1 || levels.back().height > 1)
+		{
+			const TextureImage& source = levels.back();
+
+			TextureImage level;
+			level.width = std::max(source.width / 2, 1u);
+			level.height = std::max(source.height / 2, 1u);
+			level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+			for (uint32_t y = 0; y < level.height; y++)
+			{
+				for (uint32_t x = 0; x < level.width; x++)
+				{
+					float sum[4] = {};
+
+					for (uint32_t sy = y * 2; sy < y * 2 + 2; sy++)
+					{
+						for (uint32_t sx = x * 2; sx < x * 2 + 2; sx++)
+						{
+							const uint8_t* pixel = &source.pixels[(static_cast<size_t>(std::min(sy, source.height - 1)) * source.width +
+								std::min(sx, source.width - 1)) * 4];
+
+							for (int c = 0; c < 3; c++) sum[c] += toLinear[pixel[c]];
+							sum[3] += pixel[3] / 255.0f;
+						}
+					}
+
+					uint8_t* out = &level.pixels[(static_cast<size_t>(y) * level.width + x) * 4];
+					for (int c = 0; c < 3; c++) out[c] = toByte(srgb ? linearToSrgb(sum[c] * 0.25f) : sum[c] * 0.25f);
+					out[3] = toByte(sum[3] * 0.25f);
+				}
+			}
+
+			levels.push_back(std::move(level));
+		}
+
+		return levels;
+	}
+
+	std::vector<uint8_t> compress(const TextureImage& image, TextureFormat format, ThreadPool& pool)
+	{
+		if (!isBlockCompressed(format)) return image.pixels;
+
+		uint32_t blocksX = (image.width + 3) / 4;
+		uint32_t blocksY = (image.height + 3) / 4;
+		uint32_t size = blockSize(format);
+
+		std::vector<uint8_t> data(levelSize(format, image.width, image.height));
+
+		pool.parallelFor(blocksY, [&](uint32_t blockY)
+		{
+			float points[16][4];
+
+			for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+			{
+				fetchBlock(image, blockX, blockY, points);
+				uint8_t* out = &data[(static_cast<size_t>(blockY) * blocksX + blockX) * size];
+
+				switch (format)
+				{
+				case TextureFormat::BC1_RGB_SRGB: encodeBc1Block(points, out); break;
+				case TextureFormat::BC7_SRGB: encodeBc7Block(points, out); break;
+				case TextureFormat::ETC2_RGB8_SRGB: encodeEtcBlock(points, out); break;
+				default: break;
+				}
+			}
+		});
+
+		return data;
+	}
+
+	TextureImage decompress(const uint8_t* data, uint32_t width, uint32_t height, TextureFormat format)
+	{
+		TextureImage image;
+		image.width = width;
+		image.height = height;
+
+		if (!isBlockCompressed(format))
+		{
+			image.pixels.assign(data, data + static_cast<size_t>(width) * height * 4);
+			return image;
+		}
+
+		image.pixels.resize(static_cast<size_t>(width) * height * 4);
+
+		uint32_t blocksX = (width + 3) / 4;
+		uint32_t blocksY = (height + 3) / 4;
+
+		for (uint32_t blockY = 0; blockY < blocksY; blockY++)
+		{
+			for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+			{
+				const uint8_t* in = data + (static_cast<size_t>(blockY) * blocksX + blockX) * blockSize(format);
+
+				uint8_t pixels[16][4];
+				switch (format)
+				{
+				case TextureFormat::BC1_RGB_SRGB: decodeBc1Block(in, pixels); break;
+				case TextureFormat::BC7_SRGB: decodeBc7Block(in, pixels); break;
+				default: decodeEtcBlock(in, pixels); break;
+				}
+
+				for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++)
+				{
+					for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++)
+					{
+						std::memcpy(&image.pixels[(static_cast<size_t>(blockY * 4 + y) * width + blockX * 4 + x) * 4], pixels[y * 4 + x], 4);
+					}
+				}
+			}
+		}
+
+		return image;
+	}
+
+	uint32_t blockSize(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::RGBA8_SRGB: return 4;
+		case TextureFormat::BC1_RGB_SRGB: return 8;
+		case TextureFormat::BC7_SRGB: return 16;
+		case TextureFormat::ETC2_RGB8_SRGB: return 8;
+		}
+
+		throw std::runtime_error("Unknown texture format!");
+	}
+
+	bool isBlockCompressed(TextureFormat format)
+	{
+		return format != TextureFormat::RGBA8_SRGB;
+	}
+
+	size_t levelSize(TextureFormat format, uint32_t width, uint32_t height)
+	{
+		if (!isBlockCompressed(format)) return static_cast<size_t>(width) * height * 4;
+
+		return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+	}
+
+	const char* formatName(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::RGBA8_SRGB: return "rgba8";
+		case TextureFormat::BC1_RGB_SRGB: return "bc1";
+		case TextureFormat::BC7_SRGB: return "bc7";
+		case TextureFormat::ETC2_RGB8_SRGB: return "etc2";
+		}
+
+		return "unknown";
+	}
+
+	double psnr(const TextureImage& reference, const TextureImage& image)
+	{
+		double squaredError = 0.0;
+		size_t pixelCount = static_cast<size_t>(reference.width) * reference.height;
+
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				double d = static_cast<double>(reference.pixels[i * 4 + c]) - image.pixels[i * 4 + c];
+				squaredError += d * d;
+			}
+		}
+
+		if (squaredError == 0.0) return 99.0;
+
+		double mse = squaredError / (pixelCount * 3.0);
+		return 10.0 * std::log10(255.0 * 255.0 / mse);
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ThreadPool.h"
+
+// Texture formats the cooker produces, valued as their VkFormat so KTX2 files can store them directly
+enum class TextureFormat : uint32_t
+{
+	RGBA8_SRGB = 43,	 // VK_FORMAT_R8G8B8A8_SRGB
+	BC1_RGB_SRGB = 132,	 // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+	BC7_SRGB = 146,		 // VK_FORMAT_BC7_SRGB_BLOCK
+	ETC2_RGB8_SRGB = 148 // VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK
+};
+
+// Tightly packed RGBA8 pixels
+struct TextureImage
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> pixels;
+};
+
+// CPU block compression for the offline texture cooker
+namespace TextureCompressor
+{
+	// Full mip chain down to 1x1, level 0 is a copy of the source.
+	// Sources are box filtered in linear space, sRGB values are converted around the filter.
+	std::vector<TextureImage> buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, bool srgb);
+
+	// Encodes one level, block rows are spread across the pool. Partial edge blocks repeat the last row and column.
+	// BC1 ignores alpha, BC7 uses mode 6 only, ETC2 is written as ETC1 compatible individual and differential blocks.
+	std::vector<uint8_t> compress(const TextureImage& image, TextureFormat format, ThreadPool& pool);
+
+	// Decodes what compress() produces back to RGBA8, used to measure quality
+	TextureImage decompress(const uint8_t* data, uint32_t width, uint32_t height, TextureFormat format);
+
+	// Bytes per 4x4 block, or per pixel for RGBA8
+	uint32_t blockSize(TextureFormat format);
+	bool isBlockCompressed(TextureFormat format);
+	size_t levelSize(TextureFormat format, uint32_t width, uint32_t height);
+
+	const char* formatName(TextureFormat format);
+
+	// Peak signal to noise ratio over RGB in dB
+	double psnr(const TextureImage& reference, const TextureImage& image);
+}
@@ -0,0 +1,84 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	mWorkers.reserve(threadCount);
+
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		mWorkers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+
+	mJobAvailable.notify_all();
+
+	for (auto& worker : mWorkers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.push(std::move(job));
+	}
+
+	mJobAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mJobsDone.wait(lock, [this]() { return mJobs.empty() && mActiveJobs == 0; });
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& job)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		enqueue([&job, i]() { job(i); });
+	}
+
+	wait();
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mJobAvailable.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+
+			if (mStopping && mJobs.empty()) return;
+
+			job = std::move(mJobs.front());
+			mJobs.pop();
+			mActiveJobs++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mActiveJobs--;
+
+			if (mJobs.empty() && mActiveJobs == 0) mJobsDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+// Fixed set of worker threads pulling jobs from a shared queue
+class ThreadPool
+{
+public:
+	// Zero picks one worker per hardware thread
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void enqueue(std::function<void()> job);
+
+	// Blocks until every queued job has finished
+	void wait();
+
+	// Runs job(i) for i in [0, count) across the workers and waits for all of them
+	void parallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(mWorkers.size()); }
+private:
+	void workerLoop();
+
+	std::vector<std::thread> mWorkers;
+	std::queue<std::function<void()>> mJobs;
+
+	std::mutex mMutex;
+	std::condition_variable mJobAvailable;
+	std::condition_variable mJobsDone;
+
+	uint32_t mActiveJobs = 0;
+	bool mStopping = false;
+};
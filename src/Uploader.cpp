@@ -0,0 +1,431 @@
+#include "Uploader.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+// Staging buffers of this size are recycled between batches, larger uploads get their own
+const VkDeviceSize STAGING_BUFFER_SIZE = 16 * 1024 * 1024;
+
+void Uploader::init(VkDevice device, MemoryAllocator& allocator, const VkPhysicalDeviceMemoryProperties& memoryProperties,
+	const VkPhysicalDeviceLimits& limits, uint32_t transferFamily, VkQueue transferQueue, uint32_t graphicsFamily, VkQueue graphicsQueue)
+{
+	mDevice = device;
+	mAllocator = &allocator;
+	mMemoryProperties = memoryProperties;
+
+	// Also a multiple of every texel and compressed block size we upload
+	mCopyAlignment = std::max<VkDeviceSize>(limits.optimalBufferCopyOffsetAlignment, 16);
+
+	mTransferFamily = transferFamily;
+	mTransferQueue = transferQueue;
+	mGraphicsFamily = graphicsFamily;
+	mGraphicsQueue = graphicsQueue;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = mGraphicsFamily;
+
+	if (vkCreateCommandPool(mDevice, &poolInfo, nullptr, &mGraphicsPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upload command pool!");
+	}
+
+	mTransferPool = mGraphicsPool;
+
+	if (hasDedicatedTransferQueue())
+	{
+		poolInfo.queueFamilyIndex = mTransferFamily;
+
+		if (vkCreateCommandPool(mDevice, &poolInfo, nullptr, &mTransferPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create transfer command pool!");
+		}
+	}
+}
+
+void Uploader::cleanUp()
+{
+	flush();
+	wait(mNextBatch - 1);
+
+	for (auto& staging : mFreeStaging)
+	{
+		vkDestroyBuffer(mDevice, staging.buffer, nullptr);
+		mAllocator->free(staging.memory);
+	}
+
+	mFreeStaging.clear();
+
+	if (mTransferPool != mGraphicsPool) vkDestroyCommandPool(mDevice, mTransferPool, nullptr);
+	vkDestroyCommandPool(mDevice, mGraphicsPool, nullptr);
+
+	mTransferPool = VK_NULL_HANDLE;
+	mGraphicsPool = VK_NULL_HANDLE;
+}
+
+void Uploader::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset = stage(data, size, stagingBuffer);
+
+	VkCommandBuffer commandBuffer = transferCommands();
+
+	VkBufferCopy copyRegion{};
+	copyRegion.srcOffset = stagingOffset;
+	copyRegion.dstOffset = offset;
+	copyRegion.size = size;
+
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.buffer = buffer;
+	barrier.offset = offset;
+	barrier.size = size;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	if (hasDedicatedTransferQueue())
+	{
+		// Release on the transfer queue, then acquire on the graphics queue with a matching barrier
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = mTransferFamily;
+		barrier.dstQueueFamilyIndex = mGraphicsFamily;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, 1, &barrier, 0, nullptr);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dstAccess;
+
+		vkCmdPipelineBarrier(graphicsCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+			0, nullptr, 1, &barrier, 0, nullptr);
+	}
+	else
+	{
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+			0, nullptr, 1, &barrier, 0, nullptr);
+	}
+
+	mOpenBatch.copies++;
+}
+
+void Uploader::uploadImage(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevels, const void* data, VkDeviceSize size,
+	const std::vector<VkBufferImageCopy>& regions, VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset = stage(data, size, stagingBuffer);
+
+	VkCommandBuffer commandBuffer = transferCommands();
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = aspect;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+
+	std::vector<VkBufferImageCopy> stagedRegions(regions);
+	for (auto& region : stagedRegions) region.bufferOffset += stagingOffset;
+
+	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(stagedRegions.size()), stagedRegions.data());
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = finalLayout;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	if (hasDedicatedTransferQueue())
+	{
+		// The layout transition is part of the ownership transfer and must match on both queues
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = mTransferFamily;
+		barrier.dstQueueFamilyIndex = mGraphicsFamily;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dstAccess;
+
+		vkCmdPipelineBarrier(graphicsCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	else
+	{
+		barrier.dstAccessMask = dstAccess;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	mOpenBatch.copies += static_cast<uint32_t>(regions.size());
+}
+
+VkCommandBuffer Uploader::graphicsCommands()
+{
+	// Without a dedicated queue everything is recorded into one graphics command buffer
+	if (!hasDedicatedTransferQueue()) return transferCommands();
+
+	if (mOpenBatch.graphicsCommands == VK_NULL_HANDLE)
+	{
+		mOpenBatch.graphicsCommands = beginCommands(mGraphicsPool);
+	}
+
+	return mOpenBatch.graphicsCommands;
+}
+
+uint64_t Uploader::flush()
+{
+	if (mOpenBatch.transferCommands == VK_NULL_HANDLE && mOpenBatch.graphicsCommands == VK_NULL_HANDLE) return 0;
+
+	mPendingBatches.push_back(std::move(mOpenBatch));
+	mOpenBatch = Batch();
+
+	Batch& batch = mPendingBatches.back();
+	batch.id = mNextBatch++;
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	if (vkCreateFence(mDevice, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upload fence!");
+	}
+
+	VkSubmitInfo transferSubmit{};
+	transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	transferSubmit.commandBufferCount = 1;
+	transferSubmit.pCommandBuffers = &batch.transferCommands;
+
+	VkSubmitInfo graphicsSubmit{};
+	graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	graphicsSubmit.commandBufferCount = 1;
+	graphicsSubmit.pCommandBuffers = &batch.graphicsCommands;
+
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	if (batch.transferCommands != VK_NULL_HANDLE) vkEndCommandBuffer(batch.transferCommands);
+	if (batch.graphicsCommands != VK_NULL_HANDLE) vkEndCommandBuffer(batch.graphicsCommands);
+
+	VkResult result = VK_SUCCESS;
+
+	if (batch.graphicsCommands == VK_NULL_HANDLE)
+	{
+		// Shared queue, or a dedicated transfer queue with nothing to acquire
+		result = vkQueueSubmit(hasDedicatedTransferQueue() ? mTransferQueue : mGraphicsQueue, 1, &transferSubmit, batch.fence);
+	}
+	else if (batch.transferCommands == VK_NULL_HANDLE)
+	{
+		result = vkQueueSubmit(mGraphicsQueue, 1, &graphicsSubmit, batch.fence);
+	}
+	else
+	{
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		if (vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &batch.ownershipSemaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upload semaphore!");
+		}
+
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &batch.ownershipSemaphore;
+
+		graphicsSubmit.waitSemaphoreCount = 1;
+		graphicsSubmit.pWaitSemaphores = &batch.ownershipSemaphore;
+		graphicsSubmit.pWaitDstStageMask = &waitStage;
+
+		result = vkQueueSubmit(mTransferQueue, 1, &transferSubmit, VK_NULL_HANDLE);
+		if (result == VK_SUCCESS) result = vkQueueSubmit(mGraphicsQueue, 1, &graphicsSubmit, batch.fence);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit upload batch!");
+	}
+
+	std::cerr << "Upload batch " << batch.id << ": " << batch.copies << " copies, " << batch.bytes / 1024 << " KiB via the "
+		<< (hasDedicatedTransferQueue() ? "transfer" : "graphics") << " queue" << std::endl;
+
+	return batch.id;
+}
+
+void Uploader::collect()
+{
+	while (!mPendingBatches.empty() && vkGetFenceStatus(mDevice, mPendingBatches.front().fence) == VK_SUCCESS)
+	{
+		retire(mPendingBatches.front());
+		mPendingBatches.pop_front();
+	}
+}
+
+void Uploader::wait(uint64_t batch)
+{
+	while (!mPendingBatches.empty() && mPendingBatches.front().id <= batch)
+	{
+		vkWaitForFences(mDevice, 1, &mPendingBatches.front().fence, VK_TRUE, UINT64_MAX);
+
+		retire(mPendingBatches.front());
+		mPendingBatches.pop_front();
+	}
+}
+
+VkCommandBuffer Uploader::transferCommands()
+{
+	if (mOpenBatch.transferCommands == VK_NULL_HANDLE)
+	{
+		mOpenBatch.transferCommands = beginCommands(mTransferPool);
+	}
+
+	return mOpenBatch.transferCommands;
+}
+
+VkCommandBuffer Uploader::beginCommands(VkCommandPool pool)
+{
+	VkCommandBuffer commandBuffer;
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = pool;
+	allocInfo.commandBufferCount = 1;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+	if (vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate upload command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+VkDeviceSize Uploader::stage(const void* data, VkDeviceSize size, VkBuffer& buffer)
+{
+	std::vector<StagingBuffer>& staging = mOpenBatch.staging;
+
+	if (!staging.empty())
+	{
+		StagingBuffer& current = staging.back();
+		VkDeviceSize offset = (current.cursor + mCopyAlignment - 1) / mCopyAlignment * mCopyAlignment;
+
+		if (offset + size <= current.size)
+		{
+			std::memcpy(static_cast<uint8_t*>(current.memory.mapped) + offset, data, static_cast<size_t>(size));
+			current.cursor = offset + size;
+			mOpenBatch.bytes += size;
+
+			buffer = current.buffer;
+			return offset;
+		}
+	}
+
+	if (size <= STAGING_BUFFER_SIZE && !mFreeStaging.empty())
+	{
+		staging.push_back(mFreeStaging.back());
+		mFreeStaging.pop_back();
+	}
+	else
+	{
+		staging.push_back(createStagingBuffer(std::max(size, STAGING_BUFFER_SIZE)));
+	}
+
+	StagingBuffer& current = staging.back();
+	std::memcpy(current.memory.mapped, data, static_cast<size_t>(size));
+	current.cursor = size;
+	mOpenBatch.bytes += size;
+
+	buffer = current.buffer;
+	return 0;
+}
+
+Uploader::StagingBuffer Uploader::createStagingBuffer(VkDeviceSize size)
+{
+	StagingBuffer staging;
+	staging.size = size;
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(mDevice, &bufferInfo, nullptr, &staging.buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create staging buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(mDevice, staging.buffer, &memRequirements);
+
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	uint32_t memoryType = UINT32_MAX;
+
+	for (uint32_t i = 0; i < mMemoryProperties.memoryTypeCount; i++)
+	{
+		if ((memRequirements.memoryTypeBits & (1u << i)) && (mMemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			memoryType = i;
+			break;
+		}
+	}
+
+	if (memoryType == UINT32_MAX)
+	{
+		throw std::runtime_error("Failed to find staging memory type!");
+	}
+
+	staging.memory = mAllocator->allocate(memRequirements, memoryType, true);
+	vkBindBufferMemory(mDevice, staging.buffer, staging.memory.memory, staging.memory.offset);
+
+	return staging;
+}
+
+void Uploader::retire(Batch& batch)
+{
+	if (batch.transferCommands != VK_NULL_HANDLE) vkFreeCommandBuffers(mDevice, mTransferPool, 1, &batch.transferCommands);
+	if (batch.graphicsCommands != VK_NULL_HANDLE) vkFreeCommandBuffers(mDevice, mGraphicsPool, 1, &batch.graphicsCommands);
+
+	if (batch.ownershipSemaphore != VK_NULL_HANDLE) vkDestroySemaphore(mDevice, batch.ownershipSemaphore, nullptr);
+	vkDestroyFence(mDevice, batch.fence, nullptr);
+
+	for (auto& staging : batch.staging)
+	{
+		if (staging.size == STAGING_BUFFER_SIZE)
+		{
+			staging.cursor = 0;
+			mFreeStaging.push_back(staging);
+		}
+		else
+		{
+			vkDestroyBuffer(mDevice, staging.buffer, nullptr);
+			mAllocator->free(staging.memory);
+		}
+	}
+
+	mCompletedBatch = std::max(mCompletedBatch, batch.id);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+#include "MemoryAllocator.h"
+
+// Batches staging copies and layout transitions into one submission per flush.
+// Copies run on a dedicated transfer queue family when the device has one; ownership is then
+// released there and acquired on the graphics queue, which waits on a semaphore instead of the CPU.
+// Completion of each batch is tracked with a fence, so flush() never stalls the caller.
+class Uploader
+{
+public:
+	Uploader() = default;
+
+	void init(VkDevice device, MemoryAllocator& allocator, const VkPhysicalDeviceMemoryProperties& memoryProperties,
+		const VkPhysicalDeviceLimits& limits, uint32_t transferFamily, VkQueue transferQueue, uint32_t graphicsFamily, VkQueue graphicsQueue);
+	void cleanUp();
+
+	// Data is copied to staging immediately; the GPU copy runs with the next flush.
+	// dstStage/dstAccess describe the first use on the graphics queue.
+	void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// regions[i].bufferOffset is relative to data. Every level in [0, mipLevels) goes from UNDEFINED
+	// to TRANSFER_DST for the copies, then to finalLayout on the graphics queue.
+	void uploadImage(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevels, const void* data, VkDeviceSize size,
+		const std::vector<VkBufferImageCopy>& regions, VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Graphics queue command buffer of the open batch, ordered after every upload recorded so far
+	VkCommandBuffer graphicsCommands();
+
+	// Submits the open batch and returns its id (0 if nothing was recorded)
+	uint64_t flush();
+
+	// Releases staging memory and command buffers of finished batches without blocking
+	void collect();
+	bool isComplete(uint64_t batch) const { return batch <= mCompletedBatch; }
+	void wait(uint64_t batch);
+
+	bool hasDedicatedTransferQueue() const { return mTransferFamily != mGraphicsFamily; }
+private:
+	struct StagingBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation memory;
+		VkDeviceSize size = 0;
+		VkDeviceSize cursor = 0;
+	};
+
+	struct Batch
+	{
+		uint64_t id = 0;
+		VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+		VkCommandBuffer graphicsCommands = VK_NULL_HANDLE;
+		VkSemaphore ownershipSemaphore = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		std::vector<StagingBuffer> staging;
+		VkDeviceSize bytes = 0;
+		uint32_t copies = 0;
+	};
+
+	VkCommandBuffer transferCommands();
+	VkCommandBuffer beginCommands(VkCommandPool pool);
+	VkDeviceSize stage(const void* data, VkDeviceSize size, VkBuffer& buffer);
+	StagingBuffer createStagingBuffer(VkDeviceSize size);
+	void retire(Batch& batch);
+private:
+	VkDevice mDevice = VK_NULL_HANDLE;
+	MemoryAllocator* mAllocator = nullptr;
+	VkPhysicalDeviceMemoryProperties mMemoryProperties{};
+	VkDeviceSize mCopyAlignment = 16;
+
+	uint32_t mTransferFamily = 0;
+	uint32_t mGraphicsFamily = 0;
+	VkQueue mTransferQueue = VK_NULL_HANDLE;
+	VkQueue mGraphicsQueue = VK_NULL_HANDLE;
+	VkCommandPool mTransferPool = VK_NULL_HANDLE;
+	VkCommandPool mGraphicsPool = VK_NULL_HANDLE;
+
+	Batch mOpenBatch;
+	std::deque<Batch> mPendingBatches;
+	std::vector<StagingBuffer> mFreeStaging; // Recycled standard sized staging buffers
+	uint64_t mNextBatch = 1;
+	uint64_t mCompletedBatch = 0;
+};
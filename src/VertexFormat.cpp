@@ -0,0 +1,434 @@
+#include "VertexFormat.h"
+#include "ObjLoader.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VERTEX_FORMAT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(VERTEX_FORMAT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define F16C_TARGET __attribute__((target("avx,f16c")))
+#else
+#define F16C_TARGET
+#endif
+
+const float UNORM16_MAX = 65535.0f;
+const float SNORM16_MAX = 32767.0f;
+const float HALF_MAX = 65504.0f;
+// Keeps the octahedral projection of a zero normal finite
+const float MIN_NORMAL_LENGTH = 1e-20f;
+const uint32_t QUANTIZE_BENCHMARK_ITERATIONS = 20;
+
+namespace
+{
+	struct QuantizeConstants
+	{
+		glm::vec3 offset;
+		glm::vec3 factor; // Source units to unorm steps
+	};
+
+	QuantizeConstants makeConstants(const VertexQuantization& quantization)
+	{
+		QuantizeConstants constants;
+		constants.offset = quantization.offset;
+		constants.factor = glm::vec3(UNORM16_MAX) / quantization.scale;
+		return constants;
+	}
+
+	// Same operations in the same order as the SSE kernel, so both paths round identically
+	uint16_t quantizeUnorm(float value, float offset, float factor)
+	{
+		float steps = std::min(std::max((value - offset) * factor, 0.0f), UNORM16_MAX);
+		return static_cast<uint16_t>(std::nearbyint(steps));
+	}
+
+	int16_t quantizeSnorm(float value)
+	{
+		float steps = std::min(std::max(value, -1.0f), 1.0f) * SNORM16_MAX;
+		return static_cast<int16_t>(std::nearbyint(steps));
+	}
+
+	void encodeOctahedral(const glm::vec3& normal, int16_t* out)
+	{
+		float sum = std::max(std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z), MIN_NORMAL_LENGTH);
+		float inverse = 1.0f / sum;
+		float x = normal.x * inverse;
+		float y = normal.y * inverse;
+
+		// The lower hemisphere folds over the diagonals
+		if (normal.z < 0.0f)
+		{
+			float foldedX = (1.0f - std::abs(y)) * std::copysign(1.0f, x);
+			float foldedY = (1.0f - std::abs(x)) * std::copysign(1.0f, y);
+			x = foldedX;
+			y = foldedY;
+		}
+
+		out[0] = quantizeSnorm(x);
+		out[1] = quantizeSnorm(y);
+	}
+
+	glm::vec3 decodeOctahedral(const int16_t* encoded)
+	{
+		float x = std::max(encoded[0] / SNORM16_MAX, -1.0f);
+		float y = std::max(encoded[1] / SNORM16_MAX, -1.0f);
+
+		glm::vec3 normal(x, y, 1.0f - std::abs(x) - std::abs(y));
+		float fold = std::max(-normal.z, 0.0f);
+		normal.x += normal.x >= 0.0f ? -fold : fold;
+		normal.y += normal.y >= 0.0f ? -fold : fold;
+
+		return glm::normalize(normal);
+	}
+
+#ifdef VERTEX_FORMAT_X86
+	bool cpuHasF16c()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		return osSavesYmm && (info[2] & (1 << 29)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+#endif
+	}
+
+	// Four (u, v) pairs as 32-bit words, u in the low half
+	F16C_TARGET __m128i packHalfPairsF16c(__m128 u, __m128 v)
+	{
+		__m128 limit = _mm_set1_ps(HALF_MAX);
+		__m128 negativeLimit = _mm_set1_ps(-HALF_MAX);
+		__m128i halfU = _mm_cvtps_ph(_mm_max_ps(_mm_min_ps(u, limit), negativeLimit), _MM_FROUND_TO_NEAREST_INT);
+		__m128i halfV = _mm_cvtps_ph(_mm_max_ps(_mm_min_ps(v, limit), negativeLimit), _MM_FROUND_TO_NEAREST_INT);
+		return _mm_unpacklo_epi16(halfU, halfV);
+	}
+
+	__m128i packHalfPairsScalar(const Vertex* vertices)
+	{
+		uint32_t words[4];
+		for (int i = 0; i < 4; i++)
+		{
+			words[i] = VertexFormat::floatToHalf(vertices[i].texCoord.x) | (uint32_t(VertexFormat::floatToHalf(vertices[i].texCoord.y)) << 16);
+		}
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(words));
+	}
+
+	inline __m128 copySign(__m128 magnitude, __m128 signSource)
+	{
+		__m128 signMask = _mm_set1_ps(-0.0f);
+		return _mm_or_ps(_mm_andnot_ps(signMask, magnitude), _mm_and_ps(signMask, signSource));
+	}
+
+	inline __m128i quantizeSnormSse(__m128 value)
+	{
+		value = _mm_min_ps(_mm_max_ps(value, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+		return _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(SNORM16_MAX)));
+	}
+
+	// Four vertices per iteration: each attribute is computed for all four lanes as 32-bit words,
+	// then interleaving pairs of words gives two whole 8 byte stream elements per store
+	size_t quantizeSse(const Vertex* vertices, size_t vertexCount, const QuantizeConstants& constants, bool f16c,
+		CompactPosition* positions, CompactAttributes* attributes)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 unormMax = _mm_set1_ps(UNORM16_MAX);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128i lowHalf = _mm_set1_epi32(0xffff);
+
+		size_t i = 0;
+		for (; i + 4 <= vertexCount; i += 4)
+		{
+			const Vertex* v = vertices + i;
+
+			auto quantizeAxis = [&](int axis)
+			{
+				__m128 value = _mm_setr_ps(v[0].pos[axis], v[1].pos[axis], v[2].pos[axis], v[3].pos[axis]);
+				__m128 steps = _mm_mul_ps(_mm_sub_ps(value, _mm_set1_ps(constants.offset[axis])), _mm_set1_ps(constants.factor[axis]));
+				return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(steps, zero), unormMax));
+			};
+
+			__m128i x = quantizeAxis(0);
+			__m128i y = quantizeAxis(1);
+			__m128i z = quantizeAxis(2);
+			__m128i material = _mm_setr_epi32(v[0].material, v[1].material, v[2].material, v[3].material);
+
+			__m128 nx = _mm_setr_ps(v[0].normal.x, v[1].normal.x, v[2].normal.x, v[3].normal.x);
+			__m128 ny = _mm_setr_ps(v[0].normal.y, v[1].normal.y, v[2].normal.y, v[3].normal.y);
+			__m128 nz = _mm_setr_ps(v[0].normal.z, v[1].normal.z, v[2].normal.z, v[3].normal.z);
+
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_and_ps(nx, absMask), _mm_and_ps(ny, absMask)), _mm_and_ps(nz, absMask));
+			__m128 inverse = _mm_div_ps(one, _mm_max_ps(sum, _mm_set1_ps(MIN_NORMAL_LENGTH)));
+			__m128 ox = _mm_mul_ps(nx, inverse);
+			__m128 oy = _mm_mul_ps(ny, inverse);
+
+			__m128 foldedX = copySign(_mm_sub_ps(one, _mm_and_ps(oy, absMask)), ox);
+			__m128 foldedY = copySign(_mm_sub_ps(one, _mm_and_ps(ox, absMask)), oy);
+			__m128 lower = _mm_cmplt_ps(nz, zero);
+			ox = _mm_or_ps(_mm_and_ps(lower, foldedX), _mm_andnot_ps(lower, ox));
+			oy = _mm_or_ps(_mm_and_ps(lower, foldedY), _mm_andnot_ps(lower, oy));
+
+			__m128i normal = _mm_or_si128(_mm_and_si128(quantizeSnormSse(ox), lowHalf), _mm_slli_epi32(quantizeSnormSse(oy), 16));
+
+			__m128i texCoord;
+			if (f16c)
+			{
+				__m128 u = _mm_setr_ps(v[0].texCoord.x, v[1].texCoord.x, v[2].texCoord.x, v[3].texCoord.x);
+				__m128 tv = _mm_setr_ps(v[0].texCoord.y, v[1].texCoord.y, v[2].texCoord.y, v[3].texCoord.y);
+				texCoord = packHalfPairsF16c(u, tv);
+			}
+			else
+			{
+				texCoord = packHalfPairsScalar(v);
+			}
+
+			// Position words (x | y << 16, z | material << 16), attribute words (normal, texCoord)
+			__m128i xy = _mm_or_si128(x, _mm_slli_epi32(y, 16));
+			__m128i zw = _mm_or_si128(z, _mm_slli_epi32(material, 16));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(positions + i), _mm_unpacklo_epi32(xy, zw));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(positions + i + 2), _mm_unpackhi_epi32(xy, zw));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(attributes + i), _mm_unpacklo_epi32(normal, texCoord));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(attributes + i + 2), _mm_unpackhi_epi32(normal, texCoord));
+		}
+
+		return i;
+	}
+#endif
+}
+
+namespace VertexFormat
+{
+	VertexQuantization computeQuantization(const glm::vec3& min, const glm::vec3& max)
+	{
+		VertexQuantization quantization;
+		quantization.offset = min;
+
+		// A flat axis still needs a usable step
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = max[axis] - min[axis];
+			quantization.scale[axis] = extent > 0.0f ? extent : 1.0f;
+		}
+
+		return quantization;
+	}
+
+	void split(const Vertex* vertices, size_t vertexCount, FloatPosition* positions, FloatAttributes* attributes)
+	{
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			positions[i].pos = vertices[i].pos;
+			attributes[i].normal = vertices[i].normal;
+			attributes[i].texCoord = vertices[i].texCoord;
+			attributes[i].material = vertices[i].material;
+		}
+	}
+
+	void quantizeScalar(const Vertex* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		CompactPosition* positions, CompactAttributes* attributes)
+	{
+		QuantizeConstants constants = makeConstants(quantization);
+
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			const Vertex& vertex = vertices[i];
+
+			for (int axis = 0; axis < 3; axis++)
+				positions[i].pos[axis] = quantizeUnorm(vertex.pos[axis], constants.offset[axis], constants.factor[axis]);
+			positions[i].pos[3] = static_cast<uint16_t>(vertex.material);
+
+			encodeOctahedral(vertex.normal, attributes[i].normal);
+
+			attributes[i].texCoord[0] = floatToHalf(vertex.texCoord.x);
+			attributes[i].texCoord[1] = floatToHalf(vertex.texCoord.y);
+		}
+	}
+
+	void quantize(const Vertex* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		CompactPosition* positions, CompactAttributes* attributes)
+	{
+		size_t done = 0;
+
+#ifdef VERTEX_FORMAT_X86
+		static const bool f16c = cpuHasF16c();
+		done = quantizeSse(vertices, vertexCount, makeConstants(quantization), f16c, positions, attributes);
+#endif
+
+		// Tail of fewer than four vertices
+		quantizeScalar(vertices + done, vertexCount - done, quantization, positions + done, attributes + done);
+	}
+
+	QuantizationError measureError(const Vertex* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		const CompactPosition* positions, const CompactAttributes* attributes)
+	{
+		QuantizationError error;
+
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			const Vertex& vertex = vertices[i];
+			const CompactPosition& position = positions[i];
+			const CompactAttributes& compact = attributes[i];
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				// In double so the measurement does not add float rounding of its own
+				double decoded = quantization.offset[axis] + position.pos[axis] / double(UNORM16_MAX) * quantization.scale[axis];
+				error.position = std::max(error.position, static_cast<float>(std::abs(decoded - vertex.pos[axis])));
+			}
+
+			float length = glm::length(vertex.normal);
+			if (length > 0.0f)
+			{
+				// atan2 keeps small angles exact where acos of a cosine near 1 does not
+				glm::vec3 source = vertex.normal / length;
+				glm::vec3 decoded = decodeOctahedral(compact.normal);
+				error.normal = std::max(error.normal, std::atan2(glm::length(glm::cross(source, decoded)), glm::dot(source, decoded)));
+			}
+
+			error.texCoord = std::max(error.texCoord, std::abs(halfToFloat(compact.texCoord[0]) - vertex.texCoord.x));
+			error.texCoord = std::max(error.texCoord, std::abs(halfToFloat(compact.texCoord[1]) - vertex.texCoord.y));
+		}
+
+		return error;
+	}
+
+	uint16_t floatToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+		uint32_t magnitude = bits & 0x7fffffff;
+
+		// NaN stays NaN, everything past the largest half clamps to it
+		if (magnitude > 0x7f800000) return sign | 0x7e00;
+		if (magnitude >= 0x477fe000) return sign | 0x7bff;
+
+		// Below the smallest normal half: steps of 2^-24, rounded in float
+		if (magnitude < 0x38800000)
+		{
+			float absolute;
+			std::memcpy(&absolute, &magnitude, sizeof(absolute));
+			return sign | static_cast<uint16_t>(std::nearbyint(absolute * 16777216.0f));
+		}
+
+		// Rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits to nearest even
+		uint32_t half = (magnitude - 0x38000000) >> 13;
+		uint32_t remainder = magnitude & 0x1fff;
+		if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) half++;
+
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	float halfToFloat(uint16_t half)
+	{
+		uint32_t sign = uint32_t(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x3ff;
+
+		float value;
+		if (exponent == 0)
+		{
+			value = std::ldexp(static_cast<float>(mantissa), -24);
+		}
+		else if (exponent == 31)
+		{
+			value = mantissa ? NAN : INFINITY;
+		}
+		else
+		{
+			uint32_t bits = ((exponent + 112) << 23) | (mantissa << 13);
+			std::memcpy(&value, &bits, sizeof(value));
+		}
+
+		return sign ? -value : value;
+	}
+
+	bool runBenchmark(const std::string& path)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+
+		try
+		{
+			ThreadPool pool;
+			ObjLoader::loadFile(path, pool, vertices, indices);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+
+		MeshOptimizer::weldVertices(vertices, indices);
+
+		glm::vec3 min = vertices.empty() ? glm::vec3(0.0f) : vertices[0].pos;
+		glm::vec3 max = min;
+		for (const Vertex& vertex : vertices)
+		{
+			min = glm::min(min, vertex.pos);
+			max = glm::max(max, vertex.pos);
+		}
+
+		VertexQuantization quantization = computeQuantization(min, max);
+
+		std::vector<CompactPosition> referencePositions(vertices.size()), positions(vertices.size());
+		std::vector<CompactAttributes> referenceAttributes(vertices.size()), attributes(vertices.size());
+
+		auto time = [&](auto&& function)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < QUANTIZE_BENCHMARK_ITERATIONS; i++) function();
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / QUANTIZE_BENCHMARK_ITERATIONS;
+		};
+
+		double scalarMs = time([&]() { quantizeScalar(vertices.data(), vertices.size(), quantization, referencePositions.data(), referenceAttributes.data()); });
+		double simdMs = time([&]() { quantize(vertices.data(), vertices.size(), quantization, positions.data(), attributes.data()); });
+
+		bool match = std::memcmp(referencePositions.data(), positions.data(), sizeof(CompactPosition) * positions.size()) == 0 &&
+			std::memcmp(referenceAttributes.data(), attributes.data(), sizeof(CompactAttributes) * attributes.size()) == 0;
+
+		QuantizationError error = measureError(vertices.data(), vertices.size(), quantization, positions.data(), attributes.data());
+
+		// Half a step, plus float rounding of (pos - offset) * factor
+		float largestScale = std::max(quantization.scale.x, std::max(quantization.scale.y, quantization.scale.z));
+		float largestMagnitude = std::max(glm::length(min), glm::length(max));
+		float positionBound = largestScale / (2.0f * UNORM16_MAX) + 2.0f * std::numeric_limits<float>::epsilon() * largestMagnitude;
+
+		std::cout << path << ": " << vertices.size() << " vertices" << std::endl;
+		std::cout << "  scalar: " << scalarMs << " ms (" << vertices.size() / (scalarMs * 1000.0) << " Mvertices/s)" << std::endl;
+		std::cout << "  SIMD: " << simdMs << " ms (" << vertices.size() / (simdMs * 1000.0) << " Mvertices/s)"
+			<< (match ? "" : ", MISMATCH against scalar") << std::endl;
+		std::cout << "  max error: position " << error.position << " (bound " << positionBound << "), normal "
+			<< error.normal << " rad, texCoord " << error.texCoord << std::endl;
+
+		// What one pass over every vertex fetches: shading passes read both streams, position-only passes binding 0
+		auto reportFetch = [&](const char* name, uint32_t allStreams, uint32_t positionStream)
+		{
+			std::cout << "  " << name << ": shading " << uint64_t(allStreams) * vertices.size() << " bytes (" << allStreams
+				<< " B/vertex), position-only " << uint64_t(positionStream) * vertices.size() << " bytes (" << positionStream
+				<< " B/vertex, " << 100.0 * positionStream / allStreams << "%)" << std::endl;
+		};
+
+		reportFetch(FloatVertexFormat::NAME, FloatVertexFormat::Layout::STRIDE, FloatVertexFormat::PositionLayout::STRIDE);
+		reportFetch(CompactVertexFormat::NAME, CompactVertexFormat::Layout::STRIDE, CompactVertexFormat::PositionLayout::STRIDE);
+
+		return match && error.position <= positionBound;
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include "ApplicationData.h"
+
+// One vertex attribute: its shader location, format and byte offset in its stream's element
+template<uint32_t Location, VkFormat Format, uint32_t Offset>
+struct VertexAttribute
+{
+	static constexpr uint32_t LOCATION = Location;
+	static constexpr VkFormat FORMAT = Format;
+	static constexpr uint32_t OFFSET = Offset;
+};
+
+// One vertex buffer binding: the element type stored in it and the attributes read from it
+template<uint32_t Binding, typename ElementType, typename... Attributes>
+struct VertexStream
+{
+	using Element = ElementType;
+	static constexpr uint32_t BINDING = Binding;
+	static constexpr uint32_t ATTRIBUTE_COUNT = sizeof...(Attributes);
+
+	static constexpr VkVertexInputBindingDescription getBindingDescription()
+	{
+		return { Binding, static_cast<uint32_t>(sizeof(ElementType)), VK_VERTEX_INPUT_RATE_VERTEX };
+	}
+
+	static constexpr std::array<VkVertexInputAttributeDescription, ATTRIBUTE_COUNT> getAttributeDescriptions()
+	{
+		return { { { Attributes::LOCATION, Binding, Attributes::FORMAT, Attributes::OFFSET }... } };
+	}
+};
+
+// Pipeline vertex input over a set of streams, generated at compile time.
+// A pipeline that needs fewer attributes lists fewer streams and never fetches the others.
+template<typename... Streams>
+struct VertexLayout
+{
+	static constexpr uint32_t BINDING_COUNT = sizeof...(Streams);
+	static constexpr uint32_t ATTRIBUTE_COUNT = (Streams::ATTRIBUTE_COUNT + ...);
+	// Bytes fetched per vertex
+	static constexpr uint32_t STRIDE = (static_cast<uint32_t>(sizeof(typename Streams::Element)) + ...);
+
+	static constexpr std::array<VkVertexInputBindingDescription, BINDING_COUNT> getBindingDescriptions()
+	{
+		return { { Streams::getBindingDescription()... } };
+	}
+
+	static constexpr std::array<VkVertexInputAttributeDescription, ATTRIBUTE_COUNT> getAttributeDescriptions()
+	{
+		std::array<VkVertexInputAttributeDescription, ATTRIBUTE_COUNT> attributes{};
+		size_t next = 0;
+		(append(attributes, next, Streams::getAttributeDescriptions()), ...);
+		return attributes;
+	}
+private:
+	template<size_t Count>
+	static constexpr void append(std::array<VkVertexInputAttributeDescription, ATTRIBUTE_COUNT>& attributes, size_t& next,
+		const std::array<VkVertexInputAttributeDescription, Count>& streamAttributes)
+	{
+		for (size_t i = 0; i < Count; i++) attributes[next++] = streamAttributes[i];
+	}
+};
+
+// Vertex buffers hold two streams: positions in binding 0, everything else in binding 1,
+// so position-only passes such as the depth prepass fetch only binding 0
+struct FloatPosition
+{
+	glm::vec3 pos;
+};
+
+struct FloatAttributes
+{
+	glm::vec3 normal;
+	glm::vec2 texCoord;
+	uint32_t material;
+};
+
+// 16-bit unorm inside the mesh bounds
+struct CompactPosition
+{
+	uint16_t pos[4]; // w is the material index, read back as unorm by the shading vertex shaders
+};
+
+// Octahedral normal and half float texture coordinates
+struct CompactAttributes
+{
+	int16_t normal[2];
+	uint16_t texCoord[2];
+};
+
+static_assert(sizeof(FloatPosition) == 12 && sizeof(FloatAttributes) == 24, "Float streams must stay tightly packed");
+static_assert(sizeof(CompactPosition) == 8 && sizeof(CompactAttributes) == 8, "Compact streams must stay 8 bytes each");
+
+struct FloatVertexFormat
+{
+	using Position = FloatPosition;
+	using Attributes = FloatAttributes;
+
+	using PositionStream = VertexStream<0, FloatPosition,
+		VertexAttribute<0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(FloatPosition, pos)>>;
+	using AttributeStream = VertexStream<1, FloatAttributes,
+		VertexAttribute<1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(FloatAttributes, normal)>,
+		VertexAttribute<2, VK_FORMAT_R32G32_SFLOAT, offsetof(FloatAttributes, texCoord)>,
+		VertexAttribute<3, VK_FORMAT_R32_UINT, offsetof(FloatAttributes, material)>>;
+
+	using Layout = VertexLayout<PositionStream, AttributeStream>;
+	using PositionLayout = VertexLayout<PositionStream>;
+
+	static constexpr const char* NAME = "float";
+	static constexpr bool QUANTIZED = false;
+};
+
+struct CompactVertexFormat
+{
+	using Position = CompactPosition;
+	using Attributes = CompactAttributes;
+
+	using PositionStream = VertexStream<0, CompactPosition,
+		VertexAttribute<0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactPosition, pos)>>;
+	using AttributeStream = VertexStream<1, CompactAttributes,
+		VertexAttribute<1, VK_FORMAT_R16G16_SNORM, offsetof(CompactAttributes, normal)>,
+		VertexAttribute<2, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactAttributes, texCoord)>>;
+
+	using Layout = VertexLayout<PositionStream, AttributeStream>;
+	using PositionLayout = VertexLayout<PositionStream>;
+
+	static constexpr const char* NAME = "compact";
+	static constexpr bool QUANTIZED = true;
+};
+
+// Vertex buffer format, picked at compile time. The shaders are built for both, see CMakeLists.txt.
+#ifdef COMPACT_VERTICES
+using GpuVertexFormat = CompactVertexFormat;
+#else
+using GpuVertexFormat = FloatVertexFormat;
+#endif
+
+// Maps quantized positions back into model space: pos = offset + unorm * scale
+struct VertexQuantization
+{
+	glm::vec3 offset = glm::vec3(0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// Largest error of a quantized vertex set, measured by decoding it
+struct QuantizationError
+{
+	float position = 0.0f; // Model units, per axis
+	float normal = 0.0f;   // Radians
+	float texCoord = 0.0f;
+};
+
+namespace VertexFormat
+{
+	// Positions between min and max use the whole 16-bit range on every axis
+	VertexQuantization computeQuantization(const glm::vec3& min, const glm::vec3& max);
+
+	// Copies interleaved vertices into the two float streams
+	void split(const Vertex* vertices, size_t vertexCount, FloatPosition* positions, FloatAttributes* attributes);
+
+	// Rounds to nearest on every attribute: positions land within scale / 131070 of the source per axis plus float
+	// rounding, normals within about 1e-4 radians, texture coordinates within half float precision.
+	// Material indices are stored as is and must stay below 65536.
+	// SSE2 for positions and normals, F16C for texture coordinates when the CPU has it.
+	void quantize(const Vertex* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		CompactPosition* positions, CompactAttributes* attributes);
+	// Reference for the SIMD path
+	void quantizeScalar(const Vertex* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		CompactPosition* positions, CompactAttributes* attributes);
+
+	// Fills the streams of either format; quantization is only used by the compact one
+	inline void convert(const Vertex* vertices, size_t vertexCount, const VertexQuantization&, FloatPosition* positions, FloatAttributes* attributes)
+	{
+		split(vertices, vertexCount, positions, attributes);
+	}
+	inline void convert(const Vertex* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		CompactPosition* positions, CompactAttributes* attributes)
+	{
+		quantize(vertices, vertexCount, quantization, positions, attributes);
+	}
+
+	// Adds base to the material index of converted streams, for meshes sharing a merged material library
+	inline void offsetMaterials(uint32_t base, size_t vertexCount, FloatPosition*, FloatAttributes* attributes)
+	{
+		for (size_t i = 0; i < vertexCount; i++) attributes[i].material += base;
+	}
+	inline void offsetMaterials(uint32_t base, size_t vertexCount, CompactPosition* positions, CompactAttributes*)
+	{
+		for (size_t i = 0; i < vertexCount; i++) positions[i].pos[3] = static_cast<uint16_t>(positions[i].pos[3] + base);
+	}
+
+	// Decodes the streams the way the vertex shader does and compares against the source
+	QuantizationError measureError(const Vertex* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		const CompactPosition* positions, const CompactAttributes* attributes);
+
+	// Round to nearest even, clamped to the largest finite half
+	uint16_t floatToHalf(float value);
+	float halfToFloat(uint16_t half);
+
+	// Loads and welds the OBJ, then reports quantization speed of both paths, the error, and the bytes every
+	// format and stream set fetches per mesh
+	bool runBenchmark(const std::string& path);
+}
@@ -1,13 +1,100 @@
 
-
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
 
 #include "Application.h"
 
-int main()
+int main(int argc, char** argv)
 {
 	Application* app = Application::Create();
 
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+		{
+			app->setFramesInFlight(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--no-mips") == 0)
+		{
+			app->setTextureMips(false);
+		}
+		else if (std::strcmp(argv[i], "--view-distance-scale") == 0 && i + 1 < argc)
+		{
+			app->setViewDistanceScale(static_cast<float>(std::atof(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--resize-benchmark") == 0 && i + 1 < argc)
+		{
+			app->setResizeBenchmark(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc)
+		{
+			app->setRecordThreads(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--record-benchmark") == 0)
+		{
+			app->setRecordBenchmark(true);
+		}
+		else if (std::strcmp(argv[i], "--mesh-count") == 0 && i + 1 < argc)
+		{
+			app->setMeshCount(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--instanced") == 0)
+		{
+			app->setInstancing(true);
+		}
+		else if (std::strcmp(argv[i], "--no-cull") == 0)
+		{
+			app->setFrustumCulling(false);
+		}
+		else if (std::strcmp(argv[i], "--gpu-cull") == 0)
+		{
+			app->setGpuCulling(true);
+		}
+		else if (std::strcmp(argv[i], "--meshlets") == 0)
+		{
+			app->setMeshletCulling(true);
+		}
+		else if (std::strcmp(argv[i], "--depth-prepass") == 0)
+		{
+			app->setDepthPrepass(true);
+		}
+		else if (std::strcmp(argv[i], "--per-draw-materials") == 0)
+		{
+			app->setBindlessMaterials(false);
+		}
+		else if (std::strcmp(argv[i], "--no-multi-draw") == 0)
+		{
+			app->setMultiDrawIndirect(false);
+		}
+		else if (std::strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+		{
+			app->addModel(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--lod-threshold") == 0 && i + 1 < argc)
+		{
+			app->setLodThreshold(static_cast<float>(std::atof(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+		{
+			app->setProfileOutput(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+		{
+			uint32_t frameCount = static_cast<uint32_t>(std::atoi(argv[++i]));
+
+			// Optional: where to write the last frame
+			std::string readbackPath;
+			if (i + 2 < argc && std::strcmp(argv[i + 1], "--readback") == 0)
+			{
+				readbackPath = argv[i + 2];
+				i += 2;
+			}
+
+			app->setHeadless(frameCount, readbackPath);
+		}
+	}
+
 try
 	{
 		app->run();
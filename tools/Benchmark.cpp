@@ -0,0 +1,132 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Application.h"
+
+const uint32_t DEFAULT_WARMUP_FRAMES = 60;
+const uint32_t DEFAULT_MEASURED_FRAMES = 600;
+
+static void printUsage()
+{
+	std::cerr << "Usage: Vulkan-Study-bench [--warmup N] [--frames N] [--resolution WxH] [--mesh-count N] [--texture-size N]\n"
+		<< "                          [--frames-in-flight N] [--record-threads N] [--instanced] [--no-cull] [--gpu-cull] [--meshlets] [--depth-prepass] [--lod-threshold px]\n"
+		<< "                          [--per-draw-materials] [--no-multi-draw] [--model path.obj]... [--trace trace.json] [--output report.json]\n"
+		<< "Renders headless along a scripted camera path and reports startup and frame time percentiles as JSON." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t warmupFrames = DEFAULT_WARMUP_FRAMES;
+	uint32_t measuredFrames = DEFAULT_MEASURED_FRAMES;
+	std::string reportPath;
+
+	Application* app = Application::Create();
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--warmup") == 0 && hasValue)
+		{
+			warmupFrames = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--frames") == 0 && hasValue)
+		{
+			measuredFrames = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--resolution") == 0 && hasValue)
+		{
+			unsigned width = 0, height = 0;
+			if (std::sscanf(argv[++i], "%ux%u", &width, &height) != 2)
+			{
+				printUsage();
+				return EXIT_FAILURE;
+			}
+
+			app->setResolution(width, height);
+		}
+		else if (std::strcmp(argv[i], "--mesh-count") == 0 && hasValue)
+		{
+			app->setMeshCount(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--texture-size") == 0 && hasValue)
+		{
+			app->setTextureSize(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--frames-in-flight") == 0 && hasValue)
+		{
+			app->setFramesInFlight(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--record-threads") == 0 && hasValue)
+		{
+			app->setRecordThreads(static_cast<uint32_t>(std::atoi(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--instanced") == 0)
+		{
+			app->setInstancing(true);
+		}
+		else if (std::strcmp(argv[i], "--no-cull") == 0)
+		{
+			app->setFrustumCulling(false);
+		}
+		else if (std::strcmp(argv[i], "--gpu-cull") == 0)
+		{
+			app->setGpuCulling(true);
+		}
+		else if (std::strcmp(argv[i], "--meshlets") == 0)
+		{
+			app->setMeshletCulling(true);
+		}
+		else if (std::strcmp(argv[i], "--depth-prepass") == 0)
+		{
+			app->setDepthPrepass(true);
+		}
+		else if (std::strcmp(argv[i], "--per-draw-materials") == 0)
+		{
+			app->setBindlessMaterials(false);
+		}
+		else if (std::strcmp(argv[i], "--no-multi-draw") == 0)
+		{
+			app->setMultiDrawIndirect(false);
+		}
+		else if (std::strcmp(argv[i], "--model") == 0 && hasValue)
+		{
+			app->addModel(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--lod-threshold") == 0 && hasValue)
+		{
+			app->setLodThreshold(static_cast<float>(std::atof(argv[++i])));
+		}
+		else if (std::strcmp(argv[i], "--trace") == 0 && hasValue)
+		{
+			app->setProfileOutput(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--output") == 0 && hasValue)
+		{
+			reportPath = argv[++i];
+		}
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	// After --trace, so a requested trace is kept
+	app->setBenchmark(warmupFrames, measuredFrames, reportPath);
+
+	try
+	{
+		app->run();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
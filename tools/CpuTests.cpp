@@ -0,0 +1,60 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include "MemoryAllocator.h"
+#include "ObjLoader.h"
+#include "FrustumCulling.h"
+#include "MeshSimplifier.h"
+#include "VertexFormat.h"
+#include "RenderQueue.h"
+
+static void printUsage()
+{
+	std::cerr << "Usage: Vulkan-Study-cpu-tests --allocator-selftest\n"
+		<< "                              | --obj-benchmark model.obj | --lod-benchmark model.obj | --vertex-benchmark model.obj\n"
+		<< "                              | --cull-benchmark objectCount | --queue-benchmark packetCount\n"
+		<< "Runs one CPU-only test or benchmark, no window, Vulkan device or GPU needed." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 2 && std::strcmp(argv[1], "--allocator-selftest") == 0)
+	{
+		return MemoryAllocator::runSelfTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc != 3)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	if (std::strcmp(argv[1], "--obj-benchmark") == 0)
+	{
+		return ObjLoader::runBenchmark(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (std::strcmp(argv[1], "--lod-benchmark") == 0)
+	{
+		return MeshSimplifier::runBenchmark(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (std::strcmp(argv[1], "--vertex-benchmark") == 0)
+	{
+		return VertexFormat::runBenchmark(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (std::strcmp(argv[1], "--cull-benchmark") == 0)
+	{
+		return FrustumCulling::runBenchmark(static_cast<uint32_t>(std::atoi(argv[2]))) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (std::strcmp(argv[1], "--queue-benchmark") == 0)
+	{
+		return RenderQueue::runBenchmark(static_cast<uint32_t>(std::atoi(argv[2]))) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	printUsage();
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+
+#include "Ktx2.h"
+#include "MappedFile.h"
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+
+// Written next to each source image as <name>.<format>.ktx2, the runtime picks the first one the device samples
+const TextureFormat COOKED_FORMATS[] = { TextureFormat::BC7_SRGB, TextureFormat::BC1_RGB_SRGB, TextureFormat::ETC2_RGB8_SRGB, TextureFormat::RGBA8_SRGB };
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static std::string stripExtension(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path;
+	return path.substr(0, dot);
+}
+
+static bool cookTexture(const std::string& path, ThreadPool& pool)
+{
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+	if (!pixels)
+	{
+		std::cerr << "Failed to load " << path << ": " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	double decodeTime = millisecondsSince(decodeStart);
+
+	std::cout << path << ": " << width << "x" << height << ", decoded in " << decodeTime << " ms, "
+		<< width * height * 4 / 1024 << " KiB as RGBA8 without mips" << std::endl;
+
+	std::vector<TextureImage> mips = TextureCompressor::buildMipChain(pixels, width, height, true);
+	stbi_image_free(pixels);
+
+	for (TextureFormat format : COOKED_FORMATS)
+	{
+		auto encodeStart = std::chrono::high_resolution_clock::now();
+
+		std::vector<std::vector<uint8_t>> levels;
+		size_t totalSize = 0;
+
+		for (const auto& mip : mips)
+		{
+			levels.push_back(TextureCompressor::compress(mip, format, pool));
+			totalSize += levels.back().size();
+		}
+
+		double encodeTime = millisecondsSince(encodeStart);
+
+		std::string outputPath = stripExtension(path) + "." + TextureCompressor::formatName(format) + ".ktx2";
+		if (!Ktx2::write(outputPath, format, width, height, levels))
+		{
+			std::cerr << "Failed to write " << outputPath << std::endl;
+			return false;
+		}
+
+		// What the application pays before uploading: map the file and read the level index
+		auto loadStart = std::chrono::high_resolution_clock::now();
+
+		MappedFile file;
+		Ktx2Texture texture;
+		if (!file.open(outputPath) || !Ktx2::parse(file.data(), file.size(), texture))
+		{
+			std::cerr << "Failed to read back " << outputPath << std::endl;
+			return false;
+		}
+
+		double loadTime = millisecondsSince(loadStart);
+
+		TextureImage decoded = TextureCompressor::decompress(levels[0].data(), width, height, format);
+
+		std::cout << "  " << TextureCompressor::formatName(format) << ": " << totalSize / 1024 << " KiB for "
+			<< levels.size() << " levels, encoded in " << encodeTime << " ms, loaded in " << loadTime << " ms, "
+			<< "PSNR " << TextureCompressor::psnr(mips[0], decoded) << " dB -> " << outputPath << std::endl;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: TextureCooker <image> [<image> ...]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	ThreadPool pool;
+	bool succeeded = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		succeeded = cookTexture(argv[i], pool) && succeeded;
+	}
+
+	return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}